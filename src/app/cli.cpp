@@ -54,12 +54,7 @@ class CliOut : public panglos::Out
 
 void run_cli()
 {
-#if defined(FREERTOS)
-    Mutex *mutex = 0;
-#else
-    Mutex *mutex = Mutex::create();
-#endif
-    Event::Queue *queue = Event::create_queue(10, mutex);
+    Event::Queue *queue = Event::create_queue(10);
     ASSERT(queue);
 
     Objects::objects->add("cli_queue", queue);
@@ -75,7 +70,7 @@ void run_cli()
         out = & cli_out;
     }
 
-    FmtOut fmt_out(out, 0);
+    BufferedFmtOut<64> fmt_out(out, 0);
 
     static CLI cli { 0 };
 
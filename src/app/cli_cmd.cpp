@@ -1228,21 +1228,23 @@ static void cmd_verbose(CLI *cli, CliCommand *cmd)
     {
         for (struct Verbose *v = Verbose::verboses; v; v = v->next)
         {
-            cli_print(cli, "%s %d%s", v->name, v->verbose, cli->eol);
+            cli_print(cli, "%s %d %s%s", v->name, v->verbose, lut(Severity_lut, v->severity), cli->eol);
         }
         return;
     }
 
     const char *t = cli_get_arg(cli, idx++);
 
-    if (!(s || t))
+    if (!(s && t))
     {
-        cli_print(cli, "expects 'list' or '<name> 0|1'%s", cli->eol);
+        cli_print(cli, "expects 'list', '<name> 0|1' or '<name> <severity>'%s", cli->eol);
         return;
     }
 
+    // either a severity name or a verbose state
+    const LUT *sv = lut_find(Severity_lut, t);
     int state = 0;
-    if (!cli_parse_int(t, & state, 0))
+    if ((!sv) && !cli_parse_int(t, & state, 0))
     {
         cli_print(cli, "can't set verbose %s to state %s%s", s, t, cli->eol);
         return;
@@ -1252,8 +1254,15 @@ static void cmd_verbose(CLI *cli, CliCommand *cmd)
     {
         if (!strcmp(s, v->name))
         {
-            v->verbose = state != 0;
-            cli_print(cli, "%s %d%s", v->name, v->verbose, cli->eol);
+            if (sv)
+            {
+                v->severity = (Severity) sv->code;
+            }
+            else
+            {
+                v->verbose = state != 0;
+            }
+            cli_print(cli, "%s %d %s%s", v->name, v->verbose, lut(Severity_lut, v->severity), cli->eol);
             return;
         }
     }    
@@ -1635,15 +1644,15 @@ static void cmd_logging(CLI *cli, CliCommand *)
         return;
     }
 
-    const int sv = rlut(Severity_lut, s);
+    const LUT *sv = lut_find(Severity_lut, s);
 
-    if (sv == 0)
+    if (!sv)
     {
         cmd_logging_error(cli);
         return;
     }
 
-    logger->set_severity((Severity) sv);
+    logger->set_severity((Severity) sv->code);
     cli_print(cli, "set severity=%s%s", s, cli->eol);
 }
 
@@ -1689,7 +1698,7 @@ static CliCommand cli_commands[] = {
     { "mem", cmd_heap, "mem [dump|walk|mark|show|diff|release]", 0, 0, 0 },
 #endif
     { "gpio",   cmd_gpio,   "gpio [show|toggle|flash] <gpio> [0|1|?]", 0, 0, 0 },
-    { "verbose", cmd_verbose, "verbose", 0, 0, 0 },
+    { "verbose", cmd_verbose, "list|<name> 0|1|<severity>", 0, 0, 0 },
     { "banner", cmd_banner,   "banner", 0, 0, 0 },
     { "db",     cli_nowt,     "list|del|get|set|blob", & st_del, 0, 0 },
 
@@ -1,47 +1,503 @@
 
+#include <stdlib.h>
+
+#include <atomic>
+
 #include "panglos/debug.h"
+#include "panglos/arch.h"
 #include "panglos/queue.h"
-
-#include "panglos/list.h"
+#include "panglos/mutex.h"
+#include "panglos/semaphore.h"
+#include "panglos/pool.h"
 
 #include "panglos/app/event.h"
 
 namespace panglos {
 
     /*
+     *  Event Queue with priority lanes.
      *
+     *  The Events are stored in one pool of num slots, shared by all the lanes.
+     *  Each lane is a ring of slot indexes. get() takes from the highest priority
+     *  lane that has anything in it, FIFO within a lane. Types set to
+     *  coalesce replace their pending event in place, rather than adding
+     *  another, so only the latest value is handled.
+     *
+     *  A token is put in a standard Queue for every event added to a lane,
+     *  so readers block / timeout on that, as they would on the old queue.
+     *  The lanes are protected by a CRITICAL_SECTION mutex, so events can be
+     *  put from interrupt handlers. These don't wait for space : if the queue
+     *  is full the event is dropped.
      */
 
-typedef Queue eQueue;
+class PriorityQueue : public Event::Queue
+{
+    struct TypeInfo {
+        uint8_t priority;
+        bool coalesce;
+        // pending event that can be replaced
+        bool pending;
+        int slot;
+    };
+
+    struct Lane {
+        // indexes into events
+        int *slots;
+        uint32_t rd;
+        uint32_t wr;
+        int max_depth;
+    };
+
+    const int num;
+    Lane lanes[Event::PRIORITIES];
+    Event *events;
+    // stack of unused slots in events
+    int *free_slots;
+    int nfree;
+    TypeInfo *types;
+    int ntypes;
+
+    // slots in use or reserved, in all lanes
+    int used;
+    // tasks waiting for space
+    int waiting;
+    int coalesced;
+    int dropped;
+
+    Mutex *mutex;
+    Semaphore *space;
+    panglos::Queue *tokens;
+
+    TypeInfo *info(int type)
+    {
+        return ((type >= 0) && (type < ntypes)) ? & types[type] : 0;
+    }
+
+        /*
+         *  call with the mutex held
+         */
+
+    // replace a pending event of the same type, if the type coalesces
+    bool _coalesce(const Event *event)
+    {
+        TypeInfo *ti = info(event->type);
+        if (!(ti && ti->coalesce && ti->pending))
+        {
+            return false;
+        }
+        events[ti->slot] = *event;
+        coalesced += 1;
+        return true;
+    }
+
+    // space must already be taken in 'used'
+    void _insert(const Event *event)
+    {
+        TypeInfo *ti = info(event->type);
+        const uint8_t priority = ti ? ti->priority : uint8_t(Event::NORMAL);
+        Lane *lane = & lanes[priority];
+
+        // 'used' <= num, so there is always a free slot
+        ASSERT(nfree > 0);
+        const int idx = free_slots[--nfree];
+        events[idx] = *event;
+        lane->slots[lane->wr++ % uint32_t(num)] = idx;
+        if (ti && ti->coalesce)
+        {
+            ti->pending = true;
+            ti->slot = idx;
+        }
+
+        const int depth = int(lane->wr - lane->rd);
+        if (depth > lane->max_depth)
+        {
+            lane->max_depth = depth;
+        }
+    }
+
+    void _remove(Event *event)
+    {
+        for (uint8_t i = 0; i < Event::PRIORITIES; i++)
+        {
+            Lane *lane = & lanes[i];
+            if (lane->rd == lane->wr)
+            {
+                continue;
+            }
+
+            const int idx = lane->slots[lane->rd++ % uint32_t(num)];
+            *event = events[idx];
+            free_slots[nfree++] = idx;
+
+            // the event can no longer be replaced
+            TypeInfo *ti = info(event->type);
+            if (ti && ti->pending && (ti->slot == idx))
+            {
+                ti->pending = false;
+            }
+            return;
+        }
+
+        // there is always an event for each token
+        ASSERT(0);
+    }
+
+    // free space in 'used'. Returns true if a waiting task should be woken.
+    bool _free()
+    {
+        used -= 1;
+        if (waiting)
+        {
+            waiting -= 1;
+            return true;
+        }
+        return false;
+    }
+
+        /*
+         *
+         */
+
+    // take space for an event. Returns false if it was coalesced, or dropped.
+    bool take_space(const Event *event, bool *ok)
+    {
+        const bool irq = arch_in_irq();
+
+        while (true)
+        {
+            mutex->lock();
+
+            if (event && _coalesce(event))
+            {
+                mutex->unlock();
+                *ok = true;
+                return false;
+            }
+
+            if (used < num)
+            {
+                used += 1;
+                if (event)
+                {
+                    _insert(event);
+                }
+                mutex->unlock();
+                return true;
+            }
+
+            if (irq)
+            {
+                dropped += 1;
+                mutex->unlock();
+                *ok = false;
+                return false;
+            }
+
+            waiting += 1;
+            mutex->unlock();
+            space->wait();
+        }
+    }
+
+    void free_space()
+    {
+        mutex->lock();
+        const bool wake = _free();
+        mutex->unlock();
+        if (wake)
+        {
+            space->post();
+        }
+    }
+
+    void ring()
+    {
+        const uint8_t token = 0;
+        const bool ok = tokens->put((const panglos::Queue::Message*) & token);
+        ASSERT(ok);
+    }
+
+    bool wait(int timeout)
+    {
+        uint8_t token;
+        return tokens->get((panglos::Queue::Message*) & token, timeout);
+    }
+
+public:
+    PriorityQueue(int _num)
+    :   num(_num),
+        events(0),
+        free_slots(0),
+        nfree(0),
+        types(0),
+        ntypes(0),
+        used(0),
+        waiting(0),
+        coalesced(0),
+        dropped(0),
+        mutex(0),
+        space(0),
+        tokens(0)
+    {
+        ASSERT(num > 0);
+        events = new Event[num];
+        free_slots = new int[num];
+        for (nfree = 0; nfree < num; nfree++)
+        {
+            free_slots[nfree] = nfree;
+        }
+        // any lane may hold every event
+        for (int i = 0; i < Event::PRIORITIES; i++)
+        {
+            Lane *lane = & lanes[i];
+            lane->slots = new int[num];
+            lane->rd = lane->wr = 0;
+            lane->max_depth = 0;
+        }
+
+        mutex = Mutex::create(Mutex::CRITICAL_SECTION);
+        space = Semaphore::create(Semaphore::COUNTING, num, 0);
+        tokens = panglos::Queue::create(sizeof(uint8_t), num, 0);
+
+        // defaults : control events first, stale status updates coalesce
+        set(Event::STOP, Event::HIGH, false);
+        set(Event::KEY, Event::HIGH, false);
+        set(Event::INIT, Event::HIGH, false);
+        set(Event::IDLE, Event::NORMAL, false);
+        set(Event::UART, Event::NORMAL, false);
+        set(Event::MQTT, Event::NORMAL, false);
+        set(Event::DISPLAY, Event::LOW, true);
+        set(Event::DATE_TIME, Event::LOW, true);
+        set(Event::LOCATION, Event::LOW, true);
+    }
+
+    virtual ~PriorityQueue()
+    {
+        delete tokens;
+        delete space;
+        delete mutex;
+        free(types);
+        for (int i = 0; i < Event::PRIORITIES; i++)
+        {
+            delete[] lanes[i].slots;
+        }
+        delete[] free_slots;
+        delete[] events;
+    }
+
+    void set(int type, Event::Priority priority, bool coalesce)
+    {
+        ASSERT(type >= 0);
+        ASSERT((priority >= 0) && (priority < Event::PRIORITIES));
+
+        // allocate outside the lock, it may disable interrupts
+        TypeInfo *grown = 0;
+        int size = 0;
+        if (type >= ntypes)
+        {
+            size = type + 1;
+            grown = (TypeInfo*) malloc(sizeof(TypeInfo) * size_t(size));
+            ASSERT(grown);
+        }
+
+        TypeInfo *old = 0;
+        mutex->lock();
+        if (grown)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                const TypeInfo def = { uint8_t(Event::NORMAL), false, false, 0 };
+                grown[i] = (i < ntypes) ? types[i] : def;
+            }
+            old = types;
+            types = grown;
+            ntypes = size;
+        }
+        TypeInfo *ti = & types[type];
+        if (ti->priority != priority)
+        {
+            // the pending event stays in its old lane : don't replace it
+            ti->pending = false;
+        }
+        ti->priority = uint8_t(priority);
+        ti->coalesce = coalesce;
+        if (!coalesce)
+        {
+            ti->pending = false;
+        }
+        mutex->unlock();
+
+        free(old);
+    }
+
+    bool put(const Event *event)
+    {
+        ASSERT(event);
+        bool ok = true;
+        if (take_space(event, & ok))
+        {
+            ring();
+        }
+        return ok;
+    }
+
+    bool get(Event *event, int timeout)
+    {
+        ASSERT(event);
+        if (!wait(timeout))
+        {
+            return false;
+        }
+
+        mutex->lock();
+        _remove(event);
+        const bool wake = _free();
+        mutex->unlock();
+        if (wake)
+        {
+            space->post();
+        }
+        return true;
+    }
+
+        /*
+         *  The in-place API uses an Event outside the lanes, so reserve()
+         *  and peek() hold a slot of space until commit() / release().
+         */
+
+    Event *reserve()
+    {
+        ASSERT(!arch_in_irq());
+        bool ok;
+        take_space(0, & ok);
+        return (Event*) PoolAllocator::alloc(sizeof(Event));
+    }
+
+    void commit(Event *event)
+    {
+        ASSERT(event);
+        mutex->lock();
+        const bool added = !_coalesce(event);
+        bool wake = false;
+        if (added)
+        {
+            _insert(event);
+        }
+        else
+        {
+            wake = _free();
+        }
+        mutex->unlock();
+
+        PoolAllocator::free(event, sizeof(Event));
+        if (wake)
+        {
+            space->post();
+        }
+        if (added)
+        {
+            ring();
+        }
+    }
+
+    Event *peek(int timeout)
+    {
+        if (!wait(timeout))
+        {
+            return 0;
+        }
+
+        Event *event = (Event*) PoolAllocator::alloc(sizeof(Event));
+        mutex->lock();
+        _remove(event);
+        mutex->unlock();
+        return event;
+    }
 
-static eQueue *create(int num, Mutex *mutex)
+    void release(Event *event)
+    {
+        ASSERT(event);
+        PoolAllocator::free(event, sizeof(Event));
+        free_space();
+    }
+
+    int queued()
+    {
+        mutex->lock();
+        int n = 0;
+        for (int i = 0; i < Event::PRIORITIES; i++)
+        {
+            n += int(lanes[i].wr - lanes[i].rd);
+        }
+        mutex->unlock();
+        return n;
+    }
+
+    void get_stats(Event::Stats *stats)
+    {
+        ASSERT(stats);
+        mutex->lock();
+        for (int i = 0; i < Event::PRIORITIES; i++)
+        {
+            stats->queued[i] = int(lanes[i].wr - lanes[i].rd);
+            stats->max_queued[i] = lanes[i].max_depth;
+        }
+        stats->coalesced = coalesced;
+        stats->dropped = dropped;
+        mutex->unlock();
+    }
+};
+
+    /*
+     *
+     */
+
+Event::Queue *Event::create_queue(int num, Mutex *mutex)
 {
-    return Queue::create(sizeof(Event), num, mutex);
+    // the queue does its own locking
+    IGNORE(mutex);
+    return new PriorityQueue(num);
 }
-   
-Event::Queue *Event::create_queue(int num, Mutex *mutex)
+
+static PriorityQueue *pq(Event::Queue *queue)
 {
-    return (Event::Queue*) create(num, mutex);
+    ASSERT(queue);
+    return (PriorityQueue*) queue;
 }
 
 bool Event::put(Queue *queue)
 {
-    ASSERT(queue);
-    eQueue *q = (eQueue*) queue;
-    return q->put((eQueue::Message*) this);
+    return pq(queue)->put(this);
 }
 
 bool Event::get(Queue *queue, int timeout)
 {
-    ASSERT(queue);
-    eQueue *q = (eQueue*) queue;
-    return q->get((eQueue::Message*) this, timeout);
+    return pq(queue)->get(this, timeout);
+}
+
+Event *Event::reserve(Queue *queue)
+{
+    return pq(queue)->reserve();
+}
+
+void Event::commit(Queue *queue, Event *event)
+{
+    pq(queue)->commit(event);
+}
+
+Event *Event::peek(Queue *queue, int timeout)
+{
+    return pq(queue)->peek(timeout);
+}
+
+void Event::release(Queue *queue, Event *event)
+{
+    pq(queue)->release(event);
 }
 
 int Event::queued(Queue *queue)
 {
-    eQueue *q = (eQueue*) queue;
-    return q->queued();
+    return pq(queue)->queued();
 }
 
 void Event::stop(Queue *queue)
@@ -51,6 +507,16 @@ void Event::stop(Queue *queue)
     event.put(queue);
 }
 
+void Event::set_priority(Queue *queue, enum Type type, enum Priority priority, bool coalesce)
+{
+    pq(queue)->set(type, priority, coalesce);
+}
+
+void Event::get_stats(Queue *queue, Stats *stats)
+{
+    pq(queue)->get_stats(stats);
+}
+
     /*
      *
      */
@@ -71,75 +537,272 @@ const LUT Event::type_lut[] = {
 
     /*
      *  Modules can register and remove event handlers
+     *
+     *  The Table, and the Chain of handlers for each type, are never
+     *  modified once published. Writers hold the mutex, build a copy and
+     *  swap the table pointer. The old table (and the chain it replaced)
+     *  are retired, and freed when there are no readers.
      */
 
-typedef List<struct EventHandler*> Handlers;
+struct Chain
+{
+    int count;
+    struct EventHandler *handlers[1];
+};
+
+struct Table
+{
+    // retired tables
+    struct Table *next;
+    // the chain this table's successor replaced, freed with it
+    struct Chain *stale;
+    int size;
+    struct Chain *chains[1];
+};
+
+static std::atomic<struct Table*> table(0);
+static std::atomic<int> readers(0);
+
+static struct Table *retired_tables;
+static struct EventHandler *retired_handlers;
+// set while either retired list is non-empty, read without the mutex
+static std::atomic<bool> retired(false);
+
+static Mutex *get_mutex()
+{
+    static Mutex *mutex = Mutex::create();
+    return mutex;
+}
+
+static struct Chain *chain_create(int count)
+{
+    const size_t size = sizeof(Chain) + (sizeof(EventHandler*) * size_t(count ? (count - 1) : 0));
+    struct Chain *chain = (struct Chain*) malloc(size);
+    ASSERT(chain);
+    chain->count = count;
+    return chain;
+}
+
+static struct Table *table_create(int size)
+{
+    const size_t bytes = sizeof(Table) + (sizeof(Chain*) * size_t(size - 1));
+    struct Table *t = (struct Table*) malloc(bytes);
+    ASSERT(t);
+    t->next = 0;
+    t->stale = 0;
+    t->size = size;
+    for (int i = 0; i < size; i++)
+    {
+        t->chains[i] = 0;
+    }
+    return t;
+}
+
+    // call with the mutex held
+
+static void reclaim()
+{
+    // see handle_event() : a reader that arrives after this test
+    // will see the new table, so can't hold anything retired.
+    if (readers.load())
+    {
+        return;
+    }
+
+    while (retired_tables)
+    {
+        struct Table *t = retired_tables;
+        retired_tables = t->next;
+        free(t->stale);
+        free(t);
+    }
+
+    while (retired_handlers)
+    {
+        struct EventHandler *eh = retired_handlers;
+        retired_handlers = eh->next;
+        delete eh;
+    }
+
+    retired = false;
+}
+
+    // call with the mutex held. Replace the chain for type, growing the table if needed.
+
+static void publish(int type, struct Chain *chain)
+{
+    struct Table *old = table.load();
+    const int have = old ? old->size : 0;
+    const int size = (type < have) ? have : (type + 1);
+
+    struct Table *t = table_create(size);
+    for (int i = 0; i < have; i++)
+    {
+        t->chains[i] = old->chains[i];
+    }
+    t->chains[type] = chain;
+
+    table.store(t);
+
+    if (old)
+    {
+        if (type < have)
+        {
+            old->stale = old->chains[type];
+        }
+        old->next = retired_tables;
+        retired_tables = old;
+        retired = true;
+    }
+
+    reclaim();
+}
 
-static Handlers handlers(EventHandler::get_next);
+static void retire(struct EventHandler *eh)
+{
+    eh->next = retired_handlers;
+    retired_handlers = eh;
+    retired = true;
+}
 
 void EventHandler::add_handler(enum Event::Type type, bool (*fn)(void *arg, Event *event, Event::Queue *), void *arg)
 {
+    ASSERT(type >= 0);
     struct EventHandler* eh = new struct EventHandler;
     eh->type = type;
     eh->fn = fn;
     eh->arg = arg;
     eh->next = 0;
     PO_DEBUG("type=%s=%d fn=%p eh=%p", lut(Event::type_lut, type), type, fn, eh);
-    handlers.push(eh, 0);
+
+    Lock lock(get_mutex());
+
+    struct Table *t = table.load();
+    struct Chain *old = (t && (type < t->size)) ? t->chains[type] : 0;
+    const int count = old ? old->count : 0;
+
+    // most recently added handler is called first
+    struct Chain *chain = chain_create(count + 1);
+    chain->handlers[0] = eh;
+    for (int i = 0; i < count; i++)
+    {
+        chain->handlers[i+1] = old->handlers[i];
+    }
+
+    publish(type, chain);
 }
 
 bool EventHandler::del_handler(EventHandler *eh)
 {
     PO_DEBUG("%p", eh);
-    const bool ok = handlers.remove(eh, 0);
-    delete eh;
-    return ok;
+    ASSERT(eh);
+
+    Lock lock(get_mutex());
+
+    struct Table *t = table.load();
+    struct Chain *old = (t && (eh->type < t->size)) ? t->chains[eh->type] : 0;
+    const int count = old ? old->count : 0;
+
+    bool found = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (old->handlers[i] == eh)
+        {
+            found = true;
+            break;
+        }
+    }
+
+    if (!found)
+    {
+        delete eh;
+        return false;
+    }
+
+    struct Chain *chain = 0;
+    if (count > 1)
+    {
+        chain = chain_create(count - 1);
+        int j = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (old->handlers[i] != eh)
+            {
+                chain->handlers[j++] = old->handlers[i];
+            }
+        }
+    }
+
+    retire(eh);
+    publish(eh->type, chain);
+    return true;
 }
 
 struct EventHandler *EventHandler::handle_event(Event::Queue *queue, Event *event)
 {
-    for (struct EventHandler *eh = handlers.head; eh; eh = eh->next)
+    ASSERT(event);
+    struct EventHandler *found = 0;
+
+    // Writers only free retired memory if they see no readers after
+    // publishing. Register as a reader before loading the table.
+    readers.fetch_add(1);
+
+    struct Table *t = table.load();
+    const int type = event->type;
+    struct Chain *chain = (t && (type >= 0) && (type < t->size)) ? t->chains[type] : 0;
+
+    if (chain)
     {
-        if (eh->type == event->type)
+        for (int i = 0; i < chain->count; i++)
         {
+            struct EventHandler *eh = chain->handlers[i];
             ASSERT(eh->fn);
-            const bool ok = eh->fn(eh->arg, event, queue);
-            if (ok)
+            if (eh->fn(eh->arg, event, queue))
             {
-                return eh;
+                found = eh;
+                break;
             }
         }
     }
 
-    return 0;
-}
-
-static int type_match(struct EventHandler *eh, void *arg)
-{
-    ASSERT(eh);
-    ASSERT(arg);
-    Event::Type *type = (Event::Type *) arg;
-    return eh->type == *type;
+    // the last reader out frees anything retired during dispatch,
+    // eg. by a handler that adds / deletes handlers. Never wait for the
+    // mutex here : a writer holding it will reclaim when it publishes.
+    if ((readers.fetch_sub(1) == 1) && retired.load())
+    {
+        Mutex *mutex = get_mutex();
+        if (mutex->try_lock())
+        {
+            reclaim();
+            mutex->unlock();
+        }
+    }
+    return found;
 }
 
 void EventHandler::unlink_handlers(Event::Type type)
 {
-    while (true)
+    Lock lock(get_mutex());
+
+    struct Table *t = table.load();
+    struct Chain *old = (t && (type < t->size)) ? t->chains[type] : 0;
+    if (!old)
     {
-        struct EventHandler *ev = handlers.find(type_match, & type, 0);
-        if (!ev)
-        {
-            break;
-        }
-        handlers.remove(ev, 0);
-        PO_DEBUG("unlink %s handler %p", lut(Event::type_lut, type), ev);
-        delete ev;
+        return;
     }
+
+    for (int i = 0; i < old->count; i++)
+    {
+        PO_DEBUG("unlink %s handler %p", lut(Event::type_lut, type), old->handlers[i]);
+        retire(old->handlers[i]);
+    }
+
+    publish(type, 0);
 }
 
 enum Event::Type EventHandler::get_user_code()
 {
-    static int code = Event::USER;
+    static std::atomic<int> code(Event::USER);
     return (enum Event::Type) ++code;
 }
 
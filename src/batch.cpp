@@ -4,6 +4,7 @@
 #include "panglos/debug.h"
 #include "panglos/object.h"
 #include "panglos/thread.h"
+#include "panglos/mutex.h"
 #include "panglos/semaphore.h"
 
 #include "panglos/batch.h"
@@ -14,79 +15,389 @@ namespace panglos {
      *
      */
 
-class Queue::Message { };
-
-class BatchEvent : public panglos::Queue::Message
+class BatchTask::Worker
 {
 public:
-    BatchTask::Job *job;
+    Semaphore *semaphore;
+    bool idle;
+    bool high_only;
+
+    Worker(bool high)
+    :   semaphore(0),
+        idle(false),
+        high_only(high)
+    {
+        semaphore = Semaphore::create();
+    }
+
+    ~Worker()
+    {
+        delete semaphore;
+    }
 };
 
     /*
-     *
+     *  Handle
      */
 
-BatchTask::BatchTask(Thread *t)
-:   thread(t),
-    queue(0)
+BatchTask::Handle::Handle(BatchTask *b, Job *j, Priority p)
+:   batch(b),
+    job(j),
+    next(0),
+    priority(p),
+    state(QUEUED),
+    // one for the queue, one for the caller
+    refs(2),
+    then_fn(0),
+    then_arg(0),
+    semaphore(0),
+    waiters(0),
+    queued_at(Time::get())
 {
-    queue = Queue::create(sizeof(BatchEvent), 10, 0);
-    ASSERT(queue);
 }
 
-BatchTask::~BatchTask()
+BatchTask::Handle::~Handle()
 {
-    execute(0);
-    thread->join();
-    delete thread;
-    delete queue;
-    Objects::objects->remove("batch_task");
+    delete semaphore;
 }
 
-void BatchTask::run()
+bool BatchTask::Handle::poll()
 {
-    PO_DEBUG("");
+    const State s = get_state();
+    return (s == DONE) || (s == CANCELLED);
+}
 
-    while (true)
+void BatchTask::Handle::wait()
+{
     {
-        BatchEvent event;
+        Lock lock(batch->mutex);
+        if (poll())
+        {
+            return;
+        }
+        if (!semaphore)
+        {
+            semaphore = Semaphore::create(Semaphore::COUNTING, 0x100, 0);
+        }
+        waiters += 1;
+    }
 
-        if (!queue->get(& event, 100))
+    semaphore->wait();
+}
+
+void BatchTask::Handle::then(void (*fn)(void *arg, State state), void *arg)
+{
+    ASSERT(fn);
+    {
+        Lock lock(batch->mutex);
+        if (!poll())
         {
-            continue;
+            then_fn = fn;
+            then_arg = arg;
+            return;
         }
+    }
+
+    fn(arg, get_state());
+}
 
-        if (!event.job)
+bool BatchTask::Handle::cancel()
+{
+    {
+        Lock lock(batch->mutex);
+        if (!batch->_unlink(this))
         {
-            break;
+            return false;
         }
+    }
+
+    batch->complete(this, CANCELLED);
+    return true;
+}
 
-        //PO_DEBUG("running event %p", event.job);
-        event.job->run();
+void BatchTask::Handle::release()
+{
+    if (--refs == 0)
+    {
+        delete this;
     }
 }
 
-void BatchTask::execute(Job *job)
+    /*
+     *
+     */
+
+BatchTask::BatchTask(int n, int _reserved)
+:   pool(0),
+    workers(0),
+    count(n),
+    reserved(_reserved),
+    started(0),
+    dead(false),
+    registered(false),
+    mutex(0)
+{
+    ASSERT(count > 0);
+    ASSERT((reserved >= 0) && (reserved < count));
+
+    mutex = Mutex::create();
+    for (int i = 0; i < PRIORITIES; i++)
+    {
+        lanes[i].head = lanes[i].tail = 0;
+        Stats *s = & stats[i];
+        s->run = s->cancelled = 0;
+        s->wait_total = s->wait_max = s->run_total = s->run_max = 0;
+    }
+
+    workers = new Worker* [size_t(count)];
+    for (int i = 0; i < count; i++)
+    {
+        workers[i] = new Worker(i < reserved);
+    }
+
+    pool = new ThreadPool((count == 1) ? "batch" : "batch_%d", count);
+    pool->start(run_worker, this);
+}
+
+BatchTask::~BatchTask()
 {
-    BatchEvent event;
-    event.job = job;
-    queue->put(& event);
+    // workers run the queued jobs, then exit
+    {
+        Lock lock(mutex);
+        dead = true;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        workers[i]->semaphore->post();
+    }
+    pool->join();
+    delete pool;
+
+    for (int i = 0; i < count; i++)
+    {
+        delete workers[i];
+    }
+    delete[] workers;
+    delete mutex;
+
+    if (registered)
+    {
+        Objects::objects->remove("batch_task");
+    }
+}
+
+    /*
+     *  call with the mutex held
+     */
+
+BatchTask::Handle *BatchTask::_take(Worker *w)
+{
+    const int lanes_allowed = w->high_only ? 1 : int(PRIORITIES);
+    for (int i = 0; i < lanes_allowed; i++)
+    {
+        Lane *lane = & lanes[i];
+        Handle *h = lane->head;
+        if (h)
+        {
+            lane->head = h->next;
+            if (!lane->head)
+            {
+                lane->tail = 0;
+            }
+            h->next = 0;
+            return h;
+        }
+    }
+    return 0;
+}
+
+    // wake an idle worker that can run this priority
+
+void BatchTask::_wake(Priority priority)
+{
+    // prefer a general worker, to leave the reserved ones free
+    for (int i = count - 1; i >= 0; i--)
+    {
+        Worker *w = workers[i];
+        if (w->idle && ((priority == HIGH) || !w->high_only))
+        {
+            w->idle = false;
+            w->semaphore->post();
+            return;
+        }
+    }
+}
+
+bool BatchTask::_unlink(Handle *h)
+{
+    if (h->get_state() != QUEUED)
+    {
+        return false;
+    }
+
+    Lane *lane = & lanes[h->priority];
+    Handle *prev = 0;
+    for (Handle *item = lane->head; item; prev = item, item = item->next)
+    {
+        if (item != h)
+        {
+            continue;
+        }
+        if (prev)
+        {
+            prev->next = h->next;
+        }
+        else
+        {
+            lane->head = h->next;
+        }
+        if (lane->tail == h)
+        {
+            lane->tail = prev;
+        }
+        h->next = 0;
+        h->state = CANCELLED;
+        stats[h->priority].cancelled += 1;
+        return true;
+    }
+    return false;
 }
 
     /*
      *
      */
 
-void BatchTask::run(void *arg)
+void BatchTask::complete(Handle *h, State state)
 {
-    PO_DEBUG("");
+    void (*fn)(void *arg, State state) = 0;
+    void *arg = 0;
+    int wake = 0;
+
+    {
+        Lock lock(mutex);
+        h->state = state;
+        fn = h->then_fn;
+        arg = h->then_arg;
+        wake = h->waiters;
+        h->waiters = 0;
+    }
+
+    if (fn)
+    {
+        fn(arg, state);
+    }
+    for (int i = 0; i < wake; i++)
+    {
+        h->semaphore->post();
+    }
 
+    // the queue's reference
+    h->release();
+}
+
+void BatchTask::run_worker(void *arg)
+{
     ASSERT(arg);
     BatchTask *task = (BatchTask *) arg;
-    task->run();
+    const int idx = task->started++;
+    ASSERT(idx < task->count);
+    task->run(task->workers[idx]);
+}
+
+void BatchTask::run(Worker *w)
+{
+    PO_DEBUG("");
+
+    while (true)
+    {
+        Handle *h = 0;
+        {
+            Lock lock(mutex);
+            h = _take(w);
+            if (h)
+            {
+                h->state = RUNNING;
+            }
+            else if (dead)
+            {
+                break;
+            }
+            else
+            {
+                w->idle = true;
+            }
+        }
+
+        if (!h)
+        {
+            w->semaphore->wait();
+            continue;
+        }
+
+        const Time::tick_t start = Time::get();
+        h->job->run();
+        // the job may have been deleted by now
+        h->job = 0;
+        const Time::tick_t end = Time::get();
+
+        {
+            Lock lock(mutex);
+            Stats *s = & stats[h->priority];
+            const Time::tick_t waited = Time::tick_t(start - h->queued_at);
+            const Time::tick_t ran = Time::tick_t(end - start);
+            s->run += 1;
+            s->wait_total += waited;
+            s->run_total += ran;
+            if (waited > s->wait_max) s->wait_max = waited;
+            if (ran > s->run_max) s->run_max = ran;
+        }
+
+        complete(h, DONE);
+    }
+}
+
+BatchTask::Handle *BatchTask::submit(Job *job, Priority priority)
+{
+    ASSERT(job);
+    ASSERT((priority >= 0) && (priority < PRIORITIES));
+
+    Handle *h = new Handle(this, job, priority);
+
+    Lock lock(mutex);
+    ASSERT(!dead);
+    Lane *lane = & lanes[priority];
+    if (lane->tail)
+    {
+        lane->tail->next = h;
+    }
+    else
+    {
+        lane->head = h;
+    }
+    lane->tail = h;
+    _wake(priority);
+    return h;
+}
+
+void BatchTask::execute(Job *job, Priority priority)
+{
+    Handle *h = submit(job, priority);
+    h->release();
+}
+
+void BatchTask::get_stats(Priority priority, Stats *s)
+{
+    ASSERT((priority >= 0) && (priority < PRIORITIES));
+    ASSERT(s);
+    Lock lock(mutex);
+    *s = stats[priority];
 }
 
-BatchTask *BatchTask::start()
+    /*
+     *
+     */
+
+BatchTask *BatchTask::start(int workers, int reserved)
 {
     BatchTask *task = (BatchTask*) Objects::objects->get("batch_task");
 
@@ -96,10 +407,9 @@ BatchTask *BatchTask::start()
         return task;
     }
  
-    Thread *thread = Thread::create("batch");
-    task = new BatchTask(thread);
+    task = new BatchTask(workers, reserved);
+    task->registered = true;
     Objects::objects->add("batch_task", task);
-    thread->start(BatchTask::run, task);
     return task;
 }
 
@@ -42,7 +42,7 @@ class CliClient : public Client
     CliCommand *commands;
     CLI cli;
     SocketOut out;
-    FmtOut fmt_out;
+    BufferedFmtOut<64> fmt_out;
     CliOutput cli_out;
     CliCommand cmd_exit;
     CliCommand cmd_log;
@@ -3,6 +3,10 @@
 
 #include "panglos/debug.h"
 
+#include "panglos/mutex.h"
+#include "panglos/hash.h"
+#include "panglos/semaphore.h"
+#include "panglos/thread.h"
 #include "panglos/object.h"
 #include "panglos/device.h"
 
@@ -64,100 +68,495 @@ const char *Device::find_has(const char *part)
 }
 
     /*
+     *  Dependency graph of the devices to initialise.
      *
+     *  Built once : names are hashed, each 'needs' becomes an edge from
+     *  the needed device to its user, and a topological sort (Kahn's
+     *  algorithm) gives an init order, or finds a loop.
      */
 
-bool Device::init_device(List<Device *> & done, List<Device *> & todo, bool verbose, int nest)
+class DeviceGraph
 {
-    if (verbose) PO_DEBUG("name=%s", name);
+public:
+    int count;
+    Device **devs;
+    // number of todo devices each device is waiting for
+    int *pending;
+    // users of device i are users[first[i] .. first[i+1])
+    int *first;
+    int *users;
+    // topological order
+    int *order;
+
+private:
+    // open addressing hash of todo device names -> index
+    int *hash;
+    uint32_t mask;
+
+    static uint32_t hash_fn(const char *s)
+    {
+        return fnv1a(s);
+    }
 
-    if (!nest)
+    void add_name(int idx)
     {
-        PO_ERROR("nest limit exceeded. Loop in device precursors?");
-        return false;
+        uint32_t h = hash_fn(devs[idx]->name);
+        while (hash[h & mask] != -1)
+        {
+            h += 1;
+        }
+        hash[h & mask] = idx;
+    }
+
+    void report_loop(bool *stuck);
+
+public:
+    DeviceGraph(List<Device *> & todo)
+    :   count(todo.size(0)),
+        devs(0),
+        pending(0),
+        first(0),
+        users(0),
+        order(0),
+        hash(0),
+        mask(0)
+    {
+        devs = new Device* [size_t(count)];
+        pending = new int [size_t(count)];
+        first = new int [size_t(count + 1)];
+        order = new int [size_t(count)];
+
+        uint32_t size = 8;
+        while (size < uint32_t(count * 2))
+        {
+            size *= 2;
+        }
+        mask = size - 1;
+        hash = new int [size];
+        for (uint32_t i = 0; i < size; i++)
+        {
+            hash[i] = -1;
+        }
+
+        int i = 0;
+        for (Device *dev = todo.head; dev; dev = dev->next)
+        {
+            devs[i] = dev;
+            add_name(i);
+            i += 1;
+        }
+    }
+
+    ~DeviceGraph()
+    {
+        delete[] hash;
+        delete[] order;
+        delete[] users;
+        delete[] first;
+        delete[] pending;
+        delete[] devs;
+    }
+
+    // index of the todo device, or -1
+    int find(const char *name)
+    {
+        for (uint32_t h = hash_fn(name); hash[h & mask] != -1; h++)
+        {
+            const int idx = hash[h & mask];
+            if (!strcmp(name, devs[idx]->name))
+            {
+                return idx;
+            }
+        }
+        return -1;
     }
 
-    // Initialise all the devices that this device needs
-    if (needs)
+    bool build(List<Device *> *done, bool verbose);
+    bool sort();
+};
+
+bool DeviceGraph::build(List<Device *> *done, bool verbose)
+{
+    // count the edges, and check every need is known
+    int edges = 0;
+    for (int i = 0; i < count; i++)
     {
-        for (const char **needed = needs; *needed; needed += 1)
+        Device *dev = devs[i];
+        pending[i] = 0;
+        first[i] = 0;
+        if (!dev->needs)
         {
-            if (verbose) PO_DEBUG("%s needs=%s", name, *needed);
+            continue;
         }
 
-        for (const char **needed = needs; *needed; needed += 1)
+        for (const char **needed = dev->needs; *needed; needed += 1)
         {
-            Device *dev = done.find(Device::match_name, (void*) *needed, 0);
+            if (verbose) PO_DEBUG("%s needs=%s", dev->name, *needed);
+
+            if (find(*needed) != -1)
+            {
+                pending[i] += 1;
+                edges += 1;
+                continue;
+            }
 
-            if (dev)
+            if (done && done->find(Device::match_name, (void*) *needed, 0))
             {
                 if (verbose) PO_DEBUG("%s already initialised", *needed);
                 continue;
             }
 
-            dev = todo.find(Device::match_name, (void*) *needed, 0);
+            PO_ERROR("%s not found", *needed);
+            return false;
+        }
+    }
 
-            if (!dev)
+    // count users of each device, then convert to offsets
+    for (int i = 0; i < count; i++)
+    {
+        if (!devs[i]->needs)
+        {
+            continue;
+        }
+        for (const char **needed = devs[i]->needs; *needed; needed += 1)
+        {
+            const int idx = find(*needed);
+            if (idx != -1)
             {
-                PO_ERROR("%s not found", *needed);
-                return false;
+                first[idx] += 1;
             }
+        }
+    }
 
-            if (!dev->init_device(done, todo, verbose, nest - 1))
+    int offset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const int n = first[i];
+        first[i] = offset;
+        offset += n;
+    }
+    first[count] = offset;
+
+    users = new int [size_t(edges ? edges : 1)];
+    int *fill = new int [size_t(count ? count : 1)];
+    for (int i = 0; i < count; i++)
+    {
+        fill[i] = first[i];
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (!devs[i]->needs)
+        {
+            continue;
+        }
+        for (const char **needed = devs[i]->needs; *needed; needed += 1)
+        {
+            const int idx = find(*needed);
+            if (idx != -1)
             {
-                return false;
+                users[fill[idx]++] = i;
             }
         }
     }
+    delete[] fill;
+
+    return true;
+}
 
-    // init this device
-    ASSERT(init);
-    if (!init(this, arg))
+    // Kahn's algorithm. Returns false if there is a loop.
+
+bool DeviceGraph::sort()
+{
+    int *waiting = new int [size_t(count ? count : 1)];
+    int n = 0;
+    for (int i = 0; i < count; i++)
     {
-        PO_ERROR("failed to init device '%s'", name);
-        if (!(flags & F_CAN_FAIL))
+        waiting[i] = pending[i];
+        if (!waiting[i])
         {
-            return false;
+            order[n++] = i;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        const int idx = order[i];
+        for (int u = first[idx]; u < first[idx+1]; u++)
+        {
+            const int user = users[u];
+            if (--waiting[user] == 0)
+            {
+                order[n++] = user;
+            }
+        }
+    }
+
+    if (n == count)
+    {
+        delete[] waiting;
+        return true;
+    }
+
+    // the devices left over are in, or wait on, a loop
+    bool *stuck = new bool [size_t(count)];
+    for (int i = 0; i < count; i++)
+    {
+        stuck[i] = waiting[i] != 0;
+    }
+    report_loop(stuck);
+    delete[] stuck;
+    delete[] waiting;
+    return false;
+}
+
+void DeviceGraph::report_loop(bool *stuck)
+{
+    // follow stuck needs until a device repeats
+    int idx = 0;
+    while (!stuck[idx])
+    {
+        idx += 1;
+    }
+
+    int *seen = new int [size_t(count)];
+    int *path = new int [size_t(count)];
+    for (int i = 0; i < count; i++)
+    {
+        seen[i] = -1;
+    }
+
+    int steps = 0;
+    while (seen[idx] == -1)
+    {
+        seen[idx] = steps;
+        path[steps++] = idx;
+        for (const char **needed = devs[idx]->needs; *needed; needed += 1)
+        {
+            const int need = find(*needed);
+            if ((need != -1) && stuck[need])
+            {
+                idx = need;
+                break;
+            }
         }
-        PO_INFO("'%s' can fail, continue init", name);
     }
 
-    // Move to the done list
-    bool ok = todo.remove(this, 0);
-    ASSERT(ok);
-    done.push(this, 0);
+    PO_ERROR("loop in device precursors :");
+    for (int i = seen[idx]; i < steps; i++)
+    {
+        PO_ERROR("  '%s' needs ...", devs[path[i]]->name);
+    }
+    PO_ERROR("  '%s'", devs[idx]->name);
+
+    delete[] path;
+    delete[] seen;
+}
+
+    /*
+     *
+     */
+
+static bool init_one(Device *dev, bool verbose)
+{
+    if (verbose) PO_DEBUG("name=%s", dev->name);
 
+    ASSERT(dev->init);
+    if (!dev->init(dev, dev->arg))
+    {
+        PO_ERROR("failed to init device '%s'", dev->name);
+        if (!(dev->flags & Device::F_CAN_FAIL))
+        {
+            return false;
+        }
+        PO_INFO("'%s' can fail, continue init", dev->name);
+    }
     return true;
 }
 
+    // Move the initialised devices to the done list, in init order
+
+static void move_done(DeviceGraph *graph, const int *inited, int n, List<Device *> & todo, List<Device *> *done)
+{
+    for (int i = 0; i < n; i++)
+    {
+        Device *dev = graph->devs[inited[i]];
+        bool ok = todo.remove(dev, 0);
+        ASSERT(ok);
+        done->push(dev, 0);
+    }
+}
+
 bool Device::init_devices(List<Device *> & todo, bool verbose, List<Device *> *_done, int loops)
 {
-    List<Device *> xdone(Device::get_next);
+    // loops are found by the topological sort
+    IGNORE(loops);
 
+    List<Device *> xdone(Device::get_next);
     List<Device *> *done = _done ? _done : & xdone;
 
-    int loop_detect = 0;
+    DeviceGraph graph(todo);
+    if (!(graph.build(done, verbose) && graph.sort()))
+    {
+        return false;
+    }
 
-    while (!todo.empty())
+    int n = 0;
+    bool ok = true;
+    for (; n < graph.count; n++)
     {
-        Device *dev = todo.head;
+        if (!init_one(graph.devs[graph.order[n]], verbose))
+        {
+            ok = false;
+            break;
+        }
+    }
+
+    move_done(& graph, graph.order, n, todo, done);
+    return ok;
+}
 
-        if (!dev->init_device(*done, todo, verbose, loops))
+    /*
+     *  Parallel init.
+     *
+     *  Devices whose needs have all been initialised go on a ready stack.
+     *  Each worker takes a ready device, initialises it, then releases
+     *  its users. A failure (without F_CAN_FAIL) stops any new inits.
+     */
+
+struct ParallelInit
+{
+    DeviceGraph *graph;
+    bool verbose;
+    int workers;
+
+    Mutex *mutex;
+    Semaphore *ready_sem;
+
+    int *ready;
+    int nready;
+    // devices initialised, in the order they finished
+    int *inited;
+    int ninited;
+    bool finished;
+    bool failed;
+
+    // call with the mutex held
+    void finish()
+    {
+        finished = true;
+        for (int i = 0; i < workers; i++)
         {
-            return false;
+            ready_sem->post();
         }
+    }
+};
 
-        if (++loop_detect > loops)
+static void init_worker(void *arg)
+{
+    ASSERT(arg);
+    ParallelInit *pi = (ParallelInit *) arg;
+    DeviceGraph *graph = pi->graph;
+
+    while (true)
+    {
+        pi->ready_sem->wait();
+
+        int idx;
         {
-            PO_ERROR("loop not terminating");
-            return false;
+            Lock lock(pi->mutex);
+            if (pi->finished)
+            {
+                return;
+            }
+            ASSERT(pi->nready);
+            idx = pi->ready[--pi->nready];
+        }
+
+        const bool ok = init_one(graph->devs[idx], pi->verbose);
+
+        Lock lock(pi->mutex);
+        if (!ok)
+        {
+            pi->failed = true;
+            pi->finish();
+            continue;
+        }
+
+        pi->inited[pi->ninited++] = idx;
+        if (pi->finished)
+        {
+            continue;
+        }
+
+        for (int u = graph->first[idx]; u < graph->first[idx+1]; u++)
+        {
+            const int user = graph->users[u];
+            if (--graph->pending[user] == 0)
+            {
+                pi->ready[pi->nready++] = user;
+                pi->ready_sem->post();
+            }
+        }
+
+        if (pi->ninited == graph->count)
+        {
+            pi->finish();
         }
     }
+}
 
-    // Restore the todo list
-    //todo.head = done.head;
+bool Device::init_devices_parallel(List<Device *> & todo, int threads, bool verbose, List<Device *> *_done)
+{
+    ASSERT(threads > 0);
 
-    return true;
+    List<Device *> xdone(Device::get_next);
+    List<Device *> *done = _done ? _done : & xdone;
+
+    DeviceGraph graph(todo);
+    if (!(graph.build(done, verbose) && graph.sort()))
+    {
+        return false;
+    }
+
+    if (!graph.count)
+    {
+        return true;
+    }
+
+    ParallelInit pi;
+    pi.graph = & graph;
+    pi.verbose = verbose;
+    pi.workers = threads;
+    pi.mutex = Mutex::create();
+    pi.ready_sem = Semaphore::create(Semaphore::COUNTING, graph.count + threads, 0);
+    pi.ready = new int [size_t(graph.count)];
+    pi.nready = 0;
+    pi.inited = new int [size_t(graph.count)];
+    pi.ninited = 0;
+    pi.finished = false;
+    pi.failed = false;
+
+    for (int i = 0; i < graph.count; i++)
+    {
+        if (!graph.pending[i])
+        {
+            pi.ready[pi.nready++] = i;
+            pi.ready_sem->post();
+        }
+    }
+
+    ThreadPool pool("dev_init_%d", threads);
+    pool.start(init_worker, & pi);
+    pool.join();
+
+    move_done(& graph, pi.inited, pi.ninited, todo, done);
+
+    const bool ok = !pi.failed;
+    delete[] pi.inited;
+    delete[] pi.ready;
+    delete pi.ready_sem;
+    delete pi.mutex;
+    return ok;
 }
 
 void Device::add(Objects *objects, void *obj)
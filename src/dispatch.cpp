@@ -10,11 +10,19 @@ namespace panglos {
      *
      */
 
-Dispatch::Dispatch()
-: deque(Callback::next_fn), mutex(0), semaphore(0), dead(false)
+Dispatch::Dispatch(Mode m)
+:   mode(m),
+    deque(Callback::next_fn),
+    inbox(0),
+    mutex(0),
+    semaphore(0),
+    dead(false)
 {
-    // needs to be irq_safe, not just thread safe
-    mutex = Mutex::create(Mutex::CRITICAL_SECTION);
+    if (mode == LOCKED)
+    {
+        // needs to be irq_safe, not just thread safe
+        mutex = Mutex::create(Mutex::CRITICAL_SECTION);
+    }
     semaphore = Semaphore::create();
 }
 
@@ -28,8 +36,24 @@ Dispatch::~Dispatch()
 void Dispatch::put(Callback *cb)
 {
     ASSERT(cb);
-    deque.push_tail(cb, mutex);
-    semaphore->post();
+
+    if (mode == LOCKED)
+    {
+        deque.push_tail(cb, mutex);
+        semaphore->post();
+        return;
+    }
+
+    Callback *head = inbox.load(std::memory_order_relaxed);
+    do {
+        cb->next = head;
+    }   while (!inbox.compare_exchange_weak(head, cb, std::memory_order_release, std::memory_order_relaxed));
+
+    // only wake the dispatch task if it may have emptied the inbox
+    if (!head)
+    {
+        semaphore->post();
+    }
 }
 
 void Dispatch::kill()
@@ -38,6 +62,40 @@ void Dispatch::kill()
     semaphore->post();
 }
 
+void Dispatch::execute(Callback *cb)
+{
+    if (cb->debug)
+    {
+        PO_DEBUG("debug=%s", cb->debug);
+    }
+    cb->execute();
+}
+
+/// run every callback in the inbox, in the order they were put()
+void Dispatch::drain()
+{
+    Callback *cb = inbox.exchange(0, std::memory_order_acquire);
+
+    // reverse the list
+    Callback *fifo = 0;
+    while (cb)
+    {
+        Callback *next = cb->next;
+        cb->next = fifo;
+        fifo = cb;
+        cb = next;
+    }
+
+    while (fifo)
+    {
+        // the callback may be put() again once it has been unlinked
+        Callback *next = fifo->next;
+        fifo->next = 0;
+        execute(fifo);
+        fifo = next;
+    }
+}
+
 /// main dispatch loop
 void Dispatch::run()
 {
@@ -47,14 +105,16 @@ void Dispatch::run()
     {
         semaphore->wait();
 
+        if (mode == LOCK_FREE)
+        {
+            drain();
+            continue;
+        }
+
         Callback *cb = deque.pop_head(mutex);
         if (cb)
         {
-            if (cb->debug)
-            {
-                PO_DEBUG("debug=%s", cb->debug);
-            }
-            cb->execute();
+            execute(cb);
         }
     }
 
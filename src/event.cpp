@@ -28,8 +28,13 @@ static int event_cmp(Event* event1, Event* event2)
      *
      */
 
-EventQueue::EventQueue(Rescheduler *r, Mutex *m)
-: mutex(m), delete_mutex(0), rescheduler(r), events(Event::next_fn)
+EventQueue::EventQueue(Rescheduler *r, Mutex *m, Backend b)
+:   mutex(m),
+    delete_mutex(0),
+    rescheduler(r),
+    backend(b),
+    events(Event::next_fn),
+    heap(Event::link_fn, event_cmp)
 {
     if (!mutex)
     {
@@ -99,15 +104,30 @@ bool EventQueue::add(Event *ev)
 {
     Lock lock(mutex);
 
-    events.add_sorted(ev, event_cmp, 0);
+    if (backend == HEAP)
+    {
+        heap.add(ev, 0);
+    }
+    else
+    {
+        events.add_sorted(ev, event_cmp, 0);
+        show(__FUNCTION__, & events);
+    }
     // return true if the new event is now at the head of the queue
-    const bool first = (ev == events.head);
-    show(__FUNCTION__, & events);
-    return first;
+    return ev == next_event();
+}
+
+Event* EventQueue::next_event()
+{
+    return (backend == HEAP) ? heap.head : events.head;
 }
 
 Event* EventQueue::_remove(Event *ev, Mutex *mutex)
 {
+    if (backend == HEAP)
+    {
+        return heap.remove(ev, mutex) ? ev : 0;
+    }
     return events.remove(ev, mutex) ? ev : 0;
 }
 
@@ -118,6 +138,10 @@ Event* EventQueue::remove(Event *ev)
 
 bool EventQueue::waiting(Event *ev)
 {
+    if (backend == HEAP)
+    {
+        return heap.has(ev, mutex);
+    }
     return events.has(ev, mutex);
 }
 
@@ -131,9 +155,8 @@ d_timer_t EventQueue::check()
 
     Lock lock(mutex);
 
-    while (events.head)
+    while (Event *event = next_event())
     {
-        Event *event = events.head;
         const int diff = timer_cmp(now, event->time);
 
         if (diff > 0)
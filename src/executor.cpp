@@ -0,0 +1,443 @@
+
+#include <stddef.h>
+
+#include "panglos/debug.h"
+
+#include "panglos/mutex.h"
+#include "panglos/semaphore.h"
+#include "panglos/thread.h"
+#include "panglos/pool.h"
+
+#include "panglos/executor.h"
+
+namespace panglos {
+
+    /*
+     *  WaitGroup
+     */
+
+WaitGroup::WaitGroup()
+:   count(0),
+    mutex(0),
+    semaphore(0)
+{
+    mutex = Mutex::create();
+    semaphore = Semaphore::create();
+}
+
+WaitGroup::~WaitGroup()
+{
+    // wait for any done() still inside the lock
+    {
+        Lock lock(mutex);
+    }
+    delete semaphore;
+    delete mutex;
+}
+
+void WaitGroup::add(int n)
+{
+    count += n;
+}
+
+void WaitGroup::done()
+{
+    Lock lock(mutex);
+    const int was = count--;
+    ASSERT(was > 0);
+    if (was == 1)
+    {
+        semaphore->post();
+    }
+}
+
+void WaitGroup::wait()
+{
+    while (count)
+    {
+        semaphore->wait();
+    }
+}
+
+bool WaitGroup::wait(int ticks)
+{
+    if (count)
+    {
+        semaphore->wait_timeout(ticks);
+    }
+    return count == 0;
+}
+
+    /*
+     *
+     */
+
+struct Executor::Task : public Pooled
+{
+    void (*fn)(void *arg);
+    void *arg;
+    WaitGroup *wg;
+    // parallel_for() range, if range_fn is set
+    void (*range_fn)(void *arg, int lo, int hi);
+    int lo;
+    int hi;
+    int grain;
+    // shared queue
+    Task *next;
+};
+
+class Executor::Worker
+{
+public:
+    enum { DEQUE_SIZE = 1024 };
+
+    Executor *executor;
+    StealDeque<Task*> deque;
+    uint32_t seed;
+
+    Worker(Executor *ex, int idx)
+    :   executor(ex),
+        deque(DEQUE_SIZE),
+        seed(uint32_t(idx + 1) * 2654435761u)
+    {
+    }
+
+    // xorshift, to pick a victim
+    uint32_t random()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+};
+
+    // the worker running on this thread, if any
+static thread_local Executor::Worker *current = 0;
+
+    /*
+     *
+     */
+
+Executor::Executor(const char *name, int n, size_t stack)
+:   pool(0),
+    workers(0),
+    count(n),
+    started(0),
+    mutex(0),
+    head(0),
+    tail(0),
+    queued(0),
+    idle(0),
+    sleepers(0),
+    dead(false),
+    steals(0)
+{
+    ASSERT(count > 0);
+    mutex = Mutex::create();
+    idle = Semaphore::create(Semaphore::COUNTING, 0x10000, 0);
+
+    workers = new Worker* [size_t(count)];
+    for (int i = 0; i < count; i++)
+    {
+        workers[i] = new Worker(this, i);
+    }
+
+    pool = new ThreadPool(name, count, stack);
+    pool->start(run_worker, this);
+}
+
+Executor::~Executor()
+{
+    // workers run any remaining tasks before they exit
+    dead = true;
+    for (int i = 0; i < count; i++)
+    {
+        idle->post();
+    }
+    pool->join();
+    delete pool;
+
+    for (int i = 0; i < count; i++)
+    {
+        delete workers[i];
+    }
+    delete[] workers;
+    delete idle;
+    delete mutex;
+}
+
+    /*
+     *  Shared queue, for tasks from non worker threads
+     */
+
+void Executor::put(Task *task)
+{
+    task->next = 0;
+    Lock lock(mutex);
+    if (tail)
+    {
+        tail->next = task;
+    }
+    else
+    {
+        head = task;
+    }
+    tail = task;
+    queued += 1;
+}
+
+Executor::Task *Executor::get_shared()
+{
+    if (!queued)
+    {
+        return 0;
+    }
+
+    Lock lock(mutex);
+    Task *task = head;
+    if (task)
+    {
+        head = task->next;
+        if (!head)
+        {
+            tail = 0;
+        }
+        queued -= 1;
+    }
+    return task;
+}
+
+void Executor::wake()
+{
+    // order the push before reading sleepers. See worker_loop()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers)
+    {
+        idle->post();
+    }
+}
+
+    /*
+     *
+     */
+
+Executor::Task *Executor::find(Worker *w)
+{
+    Task *task;
+
+    if (w)
+    {
+        task = w->deque.take();
+        if (task)
+        {
+            return task;
+        }
+    }
+
+    task = get_shared();
+    if (task)
+    {
+        return task;
+    }
+
+    // steal, starting from a random worker
+    const int start = int(w ? (w->random() % uint32_t(count)) : 0);
+    for (int i = 0; i < count; i++)
+    {
+        Worker *victim = workers[(start + i) % count];
+        if (victim == w)
+        {
+            continue;
+        }
+        task = victim->deque.steal();
+        if (task)
+        {
+            steals += 1;
+            return task;
+        }
+    }
+
+    return 0;
+}
+
+void Executor::run(Task *task)
+{
+    if (task->range_fn)
+    {
+        // split off the upper halves for other workers to steal
+        while ((task->hi - task->lo) > task->grain)
+        {
+            const int mid = task->lo + ((task->hi - task->lo) / 2);
+
+            Task *t = new Task(*task);
+            t->lo = mid;
+            task->hi = mid;
+            task->wg->add();
+
+            Worker *w = current;
+            if (!(w && (w->executor == this) && w->deque.push(t)))
+            {
+                put(t);
+            }
+            wake();
+        }
+
+        task->range_fn(task->arg, task->lo, task->hi);
+    }
+    else
+    {
+        task->fn(task->arg);
+    }
+
+    if (task->wg)
+    {
+        task->wg->done();
+    }
+    delete task;
+}
+
+void Executor::run_worker(void *arg)
+{
+    ASSERT(arg);
+    Executor *ex = (Executor*) arg;
+    const int idx = ex->started++;
+    ASSERT(idx < ex->count);
+    ex->worker_loop(ex->workers[idx]);
+}
+
+void Executor::worker_loop(Worker *w)
+{
+    current = w;
+
+    while (true)
+    {
+        Task *task = find(w);
+        if (task)
+        {
+            run(task);
+            continue;
+        }
+
+        if (dead)
+        {
+            break;
+        }
+
+        // announce that we are going to sleep, then check again for work,
+        // so a task pushed before wake() read 'sleepers' isn't missed.
+        sleepers += 1;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool work = queued != 0;
+        for (int i = 0; !work && (i < count); i++)
+        {
+            work = !workers[i]->deque.empty();
+        }
+
+        if (!(work || dead))
+        {
+            idle->wait();
+        }
+        sleepers -= 1;
+    }
+
+    current = 0;
+}
+
+    /*
+     *
+     */
+
+void Executor::submit(void (*fn)(void *arg), void *arg, WaitGroup *wg)
+{
+    ASSERT(fn);
+    Task *task = new Task;
+    task->fn = fn;
+    task->arg = arg;
+    task->wg = wg;
+    task->range_fn = 0;
+    task->lo = task->hi = task->grain = 0;
+    task->next = 0;
+
+    if (wg)
+    {
+        wg->add();
+    }
+
+    Worker *w = current;
+    if (w && (w->executor == this))
+    {
+        if (!w->deque.push(task))
+        {
+            // deque is full : run it now
+            run(task);
+            return;
+        }
+    }
+    else
+    {
+        put(task);
+    }
+    wake();
+}
+
+void Executor::parallel_for(int begin, int end, int grain, void (*fn)(void *arg, int lo, int hi), void *arg)
+{
+    ASSERT(fn);
+    if (begin >= end)
+    {
+        return;
+    }
+
+    WaitGroup wg;
+    wg.add();
+
+    Task *task = new Task;
+    task->fn = 0;
+    task->arg = arg;
+    task->wg = & wg;
+    task->range_fn = fn;
+    task->lo = begin;
+    task->hi = end;
+    task->grain = (grain > 0) ? grain : 1;
+    task->next = 0;
+
+    // the caller does the first range, while the rest are stolen
+    run(task);
+    wait(& wg);
+}
+
+void Executor::wait(WaitGroup *wg)
+{
+    ASSERT(wg);
+    Worker *w = current;
+    if (w && (w->executor != this))
+    {
+        w = 0;
+    }
+
+    while (wg->pending())
+    {
+        Task *task = find(w);
+        if (task)
+        {
+            run(task);
+            continue;
+        }
+
+        if (!w)
+        {
+            // not a worker : the workers will finish the tasks
+            wg->wait();
+            return;
+        }
+
+        // a worker can't block, its deque may be needed
+        wg->wait(1);
+    }
+}
+
+}   //  namespace panglos
+
+//  FIN
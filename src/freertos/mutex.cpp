@@ -31,6 +31,12 @@ private:
         xTaskResumeAll();
     }
 
+    virtual bool try_lock() override
+    {
+        lock();
+        return true;
+    }
+
 public:
     FreeRtosMutex()
     {
@@ -58,6 +64,12 @@ private:
         xSemaphoreGiveRecursive(handle);
     }
 
+    virtual bool try_lock() override
+    {
+        ASSERT(!arch_in_irq());
+        return xSemaphoreTakeRecursive(handle, 0) == pdTRUE;
+    }
+
 public:
     FreeRtosRecursive()
     {
@@ -91,6 +103,12 @@ private:
         xSemaphoreGive(handle);
     }
 
+    virtual bool try_lock() override
+    {
+        ASSERT(!arch_in_irq());
+        return xSemaphoreTake(handle, 0) == pdTRUE;
+    }
+
 public:
     FreeRtosSystem()
     {
@@ -122,6 +140,12 @@ private:
         arch_restore_irq(old);
     }
 
+    virtual bool try_lock() override
+    {
+        lock();
+        return true;
+    }
+
 public:
     FreeRtosCriticalSection()
     {
@@ -1,6 +1,9 @@
 
+#include <atomic>
+
 extern "C" {
     #include <freertos/FreeRTOS.h>
+    #include <freertos/task.h>
     #include <freertos/queue.h>
 }
 
@@ -19,22 +22,79 @@ namespace panglos {
      *
      */
 
+// uxQueueGetQueueItemSize() was added in FreeRTOS 10.5
+#if (tskKERNEL_VERSION_MAJOR > 10) || ((tskKERNEL_VERSION_MAJOR == 10) && (tskKERNEL_VERSION_MINOR >= 5))
+#define HAS_QUEUE_ITEM_SIZE
+#endif
+
 class RTOS_Queue : public Queue
 {
     QueueHandle_t handle;
     bool delete_me;
+    // message size, needed by get_many() / put_many()
+    int size;
+    // FreeRTOS queues always copy, so reserve() / peek() hand out a staging buffer.
+    // One is preallocated : the heap is only used while it is taken.
+    uint8_t *staging;
+    std::atomic<bool> staged;
+
+    Message *msg_at(const Message *msgs, int idx)
+    {
+        ASSERT_ERROR(size, "message size unknown : pass it to queue_wrap()");
+        return (Message *) & ((const uint8_t *) msgs)[idx * size];
+    }
+
+    uint8_t *alloc_msg()
+    {
+        ASSERT_ERROR(!arch_in_irq(), "reserve() / peek() not allowed in an ISR");
+        ASSERT_ERROR(size, "message size unknown : pass it to queue_wrap()");
+        if (!staged.exchange(true))
+        {
+            return staging;
+        }
+        return new uint8_t[size];
+    }
+
+    void free_msg(Message *msg)
+    {
+        ASSERT_ERROR(!arch_in_irq(), "commit() / release() not allowed in an ISR");
+        if ((uint8_t *) msg == staging)
+        {
+            staged = false;
+            return;
+        }
+        delete[] (uint8_t *) msg;
+    }
 
 public:
-    RTOS_Queue(int size, int num)
-    :   delete_me(true)
+    RTOS_Queue(int _size, int num)
+    :   delete_me(true),
+        size(_size),
+        staging(0),
+        staged(false)
     {
         handle = xQueueCreate(num, size);
         ASSERT(handle);
+        staging = new uint8_t[size];
     }
-    RTOS_Queue(QueueHandle_t _handle)
-    :   delete_me(false)
+    RTOS_Queue(QueueHandle_t _handle, int _size)
+    :   handle(_handle),
+        delete_me(false),
+        size(_size),
+        staging(0),
+        staged(false)
     {
-        handle = _handle;
+        ASSERT(handle);
+#if defined(HAS_QUEUE_ITEM_SIZE)
+        if (!size)
+        {
+            size = int(uxQueueGetQueueItemSize(handle));
+        }
+#endif
+        if (size)
+        {
+            staging = new uint8_t[size];
+        }
     }
 
     ~RTOS_Queue()
@@ -43,6 +103,7 @@ public:
         {
             vQueueDelete(handle);
         }
+        delete[] staging;
     }
 
     virtual bool get(Message *msg, int timeout) override
@@ -77,6 +138,61 @@ public:
         return ok == pdTRUE;
     }
 
+    virtual int get_many(Message *msgs, int n, int timeout) override
+    {
+        // only wait for the first message
+        int i = 0;
+        for (; i < n; i++)
+        {
+            if (!get(msg_at(msgs, i), i ? 0 : timeout))
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+    virtual int put_many(const Message *msgs, int n) override
+    {
+        int i = 0;
+        for (; i < n; i++)
+        {
+            if (!put(msg_at(msgs, i)))
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+    // These copy through the staging buffer, so are not zero-copy here
+    virtual Message *reserve() override
+    {
+        return (Message *) alloc_msg();
+    }
+
+    virtual void commit(Message *msg) override
+    {
+        put(msg);
+        free_msg(msg);
+    }
+
+    virtual Message *peek(int timeout) override
+    {
+        Message *msg = (Message *) alloc_msg();
+        if (get(msg, timeout))
+        {
+            return msg;
+        }
+        free_msg(msg);
+        return 0;
+    }
+
+    virtual void release(Message *msg) override
+    {
+        free_msg(msg);
+    }
+
     virtual int queued()
     {
         return uxQueueMessagesWaiting(handle);
@@ -90,9 +206,9 @@ Queue *Queue::create(int size, int num, Mutex *m)
     return new RTOS_Queue(size, num);
 }
 
-Queue *queue_wrap(QueueHandle_t handle)
+Queue *queue_wrap(QueueHandle_t handle, int size)
 {
-    return new RTOS_Queue(handle);
+    return new RTOS_Queue(handle, size);
 }
 
 }   //  namespace panglos
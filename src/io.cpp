@@ -52,14 +52,45 @@ static void xputc(char c, void *arg)
 
 void FmtOut::tx(char c)
 {
-    out->tx(& c, 1);
+    if (!buff)
+    {
+        out->tx(& c, 1);
+        return;
+    }
+
+    if (idx >= size)
+    {
+        tx_flush();
+    }
+    buff[idx++] = c;
+}
+
+void FmtOut::tx_flush()
+{
+    if (!idx) return;
+
+    if (out)
+    {
+        out->tx(buff, idx);
+    }
+    idx = 0;
+}
+
+void FmtOut::set_buffer(char *_buff, int _size)
+{
+    Lock lock(mutex);
+    tx_flush();
+    buff = _buff;
+    size = _buff ? _size : 0;
 }
 
 int FmtOut::printf(const char *fmt, va_list va)
 {
     if (!out) return 0;
     Lock lock(mutex);
-    return vfctprintf(xputc, this, fmt, va);
+    const int n = vfctprintf(xputc, this, fmt, va);
+    tx_flush();
+    return n;
 }
 
 int FmtOut::xprintf(void *arg, const char *fmt, va_list va)
@@ -4,34 +4,203 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "panglos/debug.h"
+#include "panglos/mutex.h"
+#include "panglos/hash.h"
 
 #include "panglos/json.h"
 
 namespace panglos {
 namespace json {
 
-#define WHITESPACE " \t\r\n"
-static const char *whitespace = WHITESPACE;
-static const char *numeric = "0123456789+-.eE";
+    /*
+     *  Character classes
+     */
+
+enum {
+    C_WS    = 0x01, // whitespace
+    C_NUM   = 0x02, // can appear in a number
+    C_DELIM = 0x04, // can follow a primitive
+    C_ALPHA = 0x08, // can appear in a primitive
+    C_STR   = 0x10, // ends a string scan : '"' or '\\'
+};
 
-bool Section::skip(char c)
+static struct CharClass
 {
-    while (s <= e)
+    uint8_t lut[256];
+
+    void set(const char *chars, uint8_t cls)
     {
-        if (c == *s)
+        for (; *chars; chars++)
         {
-            s += 1;
-            return true;
+            lut[(uint8_t) *chars] |= cls;
         }
-        if (!strchr(whitespace, *s))
+    }
+
+    CharClass()
+    {
+        memset(lut, 0, sizeof(lut));
+        set(" \t\r\n", C_WS);
+        set("0123456789+-.eE", C_NUM);
+        set(" \t\r\n,}]", C_DELIM);
+        // end of a nul terminated document
+        lut[0] |= C_DELIM;
+        set("abcdefghijklmnopqrstuvwxyz", C_ALPHA);
+        set("\"\\", C_STR);
+    }
+}   char_class;
+
+static inline bool is_class(char c, uint8_t cls)
+{
+    return char_class.lut[(uint8_t) c] & cls;
+}
+
+    /*
+     *  Scanning kernels : all return a pointer to the first match in [s, e],
+     *  or a pointer > e if there is none. They never read beyond e.
+     */
+
+// first char that is not whitespace
+static const char *skip_ws(const char *s, const char *e)
+{
+    // gaps are usually 0 or 1 chars
+    for (int i = 0; i < 2; i++, s++)
+    {
+        if ((s > e) || !is_class(*s, C_WS))
         {
-            return false;
+            return s;
+        }
+    }
+
+#if defined(__AVX2__)
+    {
+        const __m256i sp = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i cr = _mm256_set1_epi8('\r');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        while ((e - s) >= 31)
+        {
+            const __m256i v = _mm256_loadu_si256((const __m256i*) s);
+            const __m256i ws = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+            const uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(ws);
+            if (mask)
+            {
+                return s + __builtin_ctz(mask);
+            }
+            s += 32;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i sp = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        while ((e - s) >= 15)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*) s);
+            const __m128i ws = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+            const uint32_t mask = ~(uint32_t) _mm_movemask_epi8(ws) & 0xffff;
+            if (mask)
+            {
+                return s + __builtin_ctz(mask);
+            }
+            s += 16;
+        }
+    }
+#endif
+
+    while ((s <= e) && is_class(*s, C_WS))
+    {
+        s += 1;
+    }
+    return s;
+}
+
+// first '"' or '\\'
+static const char *find_str(const char *s, const char *e)
+{
+#if defined(__AVX2__)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i slash = _mm256_set1_epi8('\\');
+        while ((e - s) >= 31)
+        {
+            const __m256i v = _mm256_loadu_si256((const __m256i*) s);
+            const __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash));
+            const uint32_t mask = (uint32_t) _mm256_movemask_epi8(m);
+            if (mask)
+            {
+                return s + __builtin_ctz(mask);
+            }
+            s += 32;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i slash = _mm_set1_epi8('\\');
+        while ((e - s) >= 15)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*) s);
+            const __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+            const uint32_t mask = (uint32_t) _mm_movemask_epi8(m);
+            if (mask)
+            {
+                return s + __builtin_ctz(mask);
+            }
+            s += 16;
         }
-        //PO_DEBUG("skip '%c'", *s);
+    }
+#endif
+
+    while ((s <= e) && !is_class(*s, C_STR))
+    {
         s += 1;
     }
+    return s;
+}
+
+// end of the closing '"' of a string, starting after the opening '"'
+static const char *end_str(const char *s, const char *e)
+{
+    while (true)
+    {
+        s = find_str(s, e);
+        if ((s > e) || (*s == '"'))
+        {
+            return s;
+        }
+        // skip the escaped char
+        s += 2;
+    }
+}
+
+bool Section::skip(char c)
+{
+    s = skip_ws(s, e);
+    if ((s <= e) && (c == *s))
+    {
+        s += 1;
+        return true;
+    }
     return false;
 }
 
@@ -203,6 +372,10 @@ const LUT Parser::err_lut[] = {
     {   "CLOSE_BRACE_EXPECTED", Parser::CLOSE_BRACE_EXPECTED },
     {   "CLOSE_BRACKET_EXPECTED", Parser::CLOSE_BRACKET_EXPECTED },
     {   "UNTERMINATED_STRING", Parser::UNTERMINATED_STRING },
+    {   "USER_ERROR", Parser::USER_ERROR },
+    {   "VALUE_EXPECTED", Parser::VALUE_EXPECTED },
+    {   "TOKEN_TOO_LONG", Parser::TOKEN_TOO_LONG },
+    {   "NESTING_TOO_DEEP", Parser::NESTING_TOO_DEEP },
     {   0, 0 },
 };
 
@@ -346,15 +519,14 @@ bool Parser::number(Section *sec)
     const char *s = sec->s;
     Section num(s, 0);
 
-    while (sec->s <= sec->e)
+    while ((s <= sec->e) && is_class(*s, C_NUM))
     {
-        if (!strchr(numeric, *s))
-        {
-            break;
-        }
-        num.e = s;
         s += 1;
     }
+    if (s != sec->s)
+    {
+        num.e = s - 1;
+    }
     sec->s = s;
 
     return error_check(sec, handler->on_number(& num));
@@ -367,19 +539,13 @@ bool Parser::string(Section *sec, bool key)
     ASSERT(sec->s[0] == '"');
 
     const char *s = sec->s + 1;
-    bool escape = false;
 
     Section str(s, 0);
-    while (s <= sec->e)
+    s = end_str(s, sec->e);
+    if (s <= sec->e)
     {
-        if ((*s == '"') && !escape)
-        {
-            // end of string
-            str.e = s - 1;
-            break;
-        }
-        escape = escape ? false : (*s == '\\');
-        s += 1;
+        // end of string
+        str.e = s - 1;
     }
 
     if (!str.e)
@@ -405,13 +571,17 @@ bool Parser::primitive(Section *sec)
     for (int i = 0; primitives[i]; i++)
     {
         const char *s = primitives[i];
+        if (*s != *sec->s)
+        {
+            continue;
+        }
         const int n = (int) strlen(s);
         if (strncmp(s, sec->s, size_t(n)))
         {
             continue;
         }
         // check for trailing chars
-        if (!strchr(WHITESPACE ",}]", sec->s[n]))
+        if (!is_class(sec->s[n], C_DELIM))
         {
             continue;
         }
@@ -434,7 +604,7 @@ bool Parser::value(Section *sec)
 
     sec->skip();
 
-    if (strchr(numeric, *sec->s))
+    if (is_class(*sec->s, C_NUM))
     {
         return number(sec);
     }
@@ -455,39 +625,677 @@ bool Parser::parse(Section *sec)
 }
 
     /*
+     *  StreamParser
+     */
+
+StreamParser::StreamParser(Handler *h, size_t _scratch_size, int _max_depth, bool v)
+:   handler(h),
+    verbose(v),
+    scratch(0),
+    scratch_size(_scratch_size),
+    used(0),
+    stack(0),
+    max_depth(_max_depth),
+    depth(0),
+    state(VALUE),
+    key(false),
+    escape(false),
+    offset(0),
+    err(Parser::OKAY),
+    err_offset(0)
+{
+    ASSERT(handler);
+    ASSERT(scratch_size > 0);
+    ASSERT(max_depth > 0);
+    scratch = new char[scratch_size];
+    stack = new char[size_t(max_depth)];
+}
+
+StreamParser::~StreamParser()
+{
+    delete[] stack;
+    delete[] scratch;
+}
+
+void StreamParser::reset()
+{
+    used = 0;
+    depth = 0;
+    state = VALUE;
+    key = false;
+    escape = false;
+    offset = 0;
+    err = Parser::OKAY;
+    err_offset = 0;
+}
+
+enum Parser::Error StreamParser::get_error(size_t *at)
+{
+    if (at)
+    {
+        *at = err_offset;
+    }
+    return err;
+}
+
+bool StreamParser::fail(enum Parser::Error e, size_t at)
+{
+    err = e;
+    err_offset = at;
+    state = FAILED;
+    if (verbose)
+    {
+        PO_ERROR("%s offset=%d", lut(Parser::err_lut, err), (int) at);
+    }
+    return false;
+}
+
+bool StreamParser::user_error(enum Handler::Error e, size_t at)
+{
+    if (e == Handler::OKAY)
+    {
+        return true;
+    }
+    err = Parser::USER_ERROR;
+    err_offset = at;
+    state = FAILED;
+    if (verbose)
+    {
+        PO_ERROR("%s %d", lut(handler->get_lut(), e), e);
+    }
+    return false;
+}
+
+    // keep the start of a token that spans the end of a chunk
+
+bool StreamParser::save(const char *s, const char *e, size_t at)
+{
+    const size_t n = size_t(e - s);
+    if ((used + n) > scratch_size)
+    {
+        return fail(Parser::TOKEN_TOO_LONG, at);
+    }
+    memcpy(& scratch[used], s, n);
+    used += n;
+    return true;
+}
+
+    // the complete token [s, e) : join it to any saved part
+
+bool StreamParser::token(const char *s, const char *e, Section *sec, size_t at)
+{
+    if (!used)
+    {
+        *sec = Section(s, e - 1);
+        return true;
+    }
+    if (!save(s, e, at))
+    {
+        return false;
+    }
+    *sec = Section(scratch, & scratch[used-1]);
+    used = 0;
+    return true;
+}
+
+bool StreamParser::value_done()
+{
+    state = depth ? NEXT : DONE;
+    return true;
+}
+
+bool StreamParser::open(char c, size_t at)
+{
+    if (depth >= max_depth)
+    {
+        return fail(Parser::NESTING_TOO_DEEP, at);
+    }
+    stack[depth++] = c;
+    if (c == '{')
+    {
+        state = OBJ_KEY;
+        return user_error(handler->on_object(true), at);
+    }
+    state = ARR_VALUE;
+    return user_error(handler->on_array(true), at);
+}
+
+bool StreamParser::close(char c, size_t at)
+{
+    const char top = stack[depth-1];
+    if ((top == '{') && (c != '}'))
+    {
+        return fail(Parser::CLOSE_BRACE_EXPECTED, at);
+    }
+    if ((top == '[') && (c != ']'))
+    {
+        return fail(Parser::CLOSE_BRACKET_EXPECTED, at);
+    }
+    depth -= 1;
+    value_done();
+    return user_error((top == '{') ? handler->on_object(false) : handler->on_array(false), at);
+}
+
+bool StreamParser::start_value(char c, size_t at)
+{
+    switch (c)
+    {
+        case '{' :
+        case '[' :
+            return open(c, at);
+        case '"' :
+            key = false;
+            escape = false;
+            state = STRING;
+            return true;
+        default :
+            break;
+    }
+
+    if (is_class(c, C_NUM))
+    {
+        state = NUMBER;
+        return true;
+    }
+    if (is_class(c, C_ALPHA))
+    {
+        state = PRIMITIVE;
+        return true;
+    }
+    return fail(Parser::VALUE_EXPECTED, at);
+}
+
+bool StreamParser::primitive(Section *sec, size_t at)
+{
+    static const char *primitives[] = {
+        "false",
+        "true",
+        "null",
+        0,
+    };
+
+    const size_t n = size_t(1 + sec->e - sec->s);
+    for (int i = 0; primitives[i]; i++)
+    {
+        const char *s = primitives[i];
+        if ((strlen(s) != n) || strncmp(s, sec->s, n))
+        {
+            continue;
+        }
+        Section primitive = { s, s+n-1 };
+        if (!user_error(handler->on_primitive(& primitive), at))
+        {
+            return false;
+        }
+        return value_done();
+    }
+
+    return fail(Parser::VALUE_EXPECTED, at);
+}
+
+bool StreamParser::parse(const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = & data[len];
+
+    while (p < end)
+    {
+        size_t at = offset + size_t(p - data);
+
+        switch (state)
+        {
+            case STRING :
+            {
+                const char *t = p;
+                if (escape)
+                {
+                    escape = false;
+                    t += 1;
+                }
+                t = end_str(t, end - 1);
+                if (t > end)
+                {
+                    // the chunk ends with '\\'
+                    escape = true;
+                }
+                if (t >= end)
+                {
+                    t = end;
+                }
+                if (t == end)
+                {
+                    // need more data
+                    if (!save(p, t, at)) return false;
+                    p = t;
+                    continue;
+                }
+                Section sec;
+                if (!token(p, t, & sec, at)) return false;
+                p = t + 1;
+                if (key)
+                {
+                    state = COLON;
+                }
+                else
+                {
+                    value_done();
+                }
+                if (!user_error(handler->on_string(& sec, key), at)) return false;
+                continue;
+            }
+            case NUMBER :
+            case PRIMITIVE :
+            {
+                const bool num = state == NUMBER;
+                const uint8_t cls = num ? C_NUM : C_ALPHA;
+                const char *t = p;
+                while ((t < end) && is_class(*t, cls))
+                {
+                    t += 1;
+                }
+                if (t == end)
+                {
+                    // the token may continue in the next chunk
+                    if (!save(p, t, at)) return false;
+                    p = t;
+                    continue;
+                }
+                Section sec;
+                if (!token(p, t, & sec, at)) return false;
+                // the terminating char is handled by the next state
+                p = t;
+                if (num)
+                {
+                    if (!user_error(handler->on_number(& sec), at)) return false;
+                    value_done();
+                    continue;
+                }
+                if (!primitive(& sec, at)) return false;
+                continue;
+            }
+            case DONE :
+                offset += len;
+                return true;
+            case FAILED :
+                return false;
+            default :
+                break;
+        }
+
+        p = skip_ws(p, end - 1);
+        if (p == end)
+        {
+            break;
+        }
+        at = offset + size_t(p - data);
+        const char c = *p++;
+
+        switch (state)
+        {
+            case VALUE :
+            {
+                if (!start_value(c, at)) return false;
+                break;
+            }
+            case ARR_VALUE :
+            {
+                if (c == ']')
+                {
+                    if (!close(c, at)) return false;
+                    break;
+                }
+                if (!start_value(c, at)) return false;
+                break;
+            }
+            case OBJ_KEY :
+            {
+                if (c == '}')
+                {
+                    if (!close(c, at)) return false;
+                    break;
+                }
+                if (c != '"')
+                {
+                    return fail(Parser::KEY_EXPECTED, at);
+                }
+                key = true;
+                escape = false;
+                state = STRING;
+                break;
+            }
+            case COLON :
+            {
+                if (c != ':')
+                {
+                    return fail(Parser::COLON_EXPECTED, at);
+                }
+                state = VALUE;
+                break;
+            }
+            case NEXT :
+            {
+                if (c == ',')
+                {
+                    state = (stack[depth-1] == '{') ? OBJ_KEY : ARR_VALUE;
+                    break;
+                }
+                if (!close(c, at)) return false;
+                break;
+            }
+            default :
+                ASSERT(0);
+        }
+
+        if ((state == NUMBER) || (state == PRIMITIVE))
+        {
+            // the first char is part of the token
+            p -= 1;
+        }
+    }
+
+    offset += len;
+    return state != FAILED;
+}
+
+bool StreamParser::finish()
+{
+    switch (state)
+    {
+        case NUMBER :
+        case PRIMITIVE :
+        {
+            // a token at the end of the input
+            if (depth)
+            {
+                break;
+            }
+            Section sec(scratch, & scratch[used-1]);
+            used = 0;
+            if (state == NUMBER)
+            {
+                if (!user_error(handler->on_number(& sec), offset)) return false;
+                return value_done();
+            }
+            return primitive(& sec, offset);
+        }
+        case DONE :
+            return true;
+        case FAILED :
+            return false;
+        case STRING :
+            return fail(Parser::UNTERMINATED_STRING, offset);
+        default :
+            break;
+    }
+
+    if (!depth)
+    {
+        return fail(Parser::VALUE_EXPECTED, offset);
+    }
+    if (stack[depth-1] == '{')
+    {
+        return fail(Parser::CLOSE_BRACE_EXPECTED, offset);
+    }
+    return fail(Parser::CLOSE_BRACKET_EXPECTED, offset);
+}
+
+    /*
+     *  Trie of key paths.
      *
+     *  Each node's children are hashed, so resolving a key costs O(1)
+     *  however many items are registered.
+     */
+
+static uint32_t hash_key(const char *s, size_t len)
+{
+    return fnv1a(s, len);
+}
+
+static uint32_t hash_index(int idx)
+{
+    // keep clear of the key hashes of short strings
+    return (uint32_t(idx) * 2654435761u) ^ 0x5bd1e995u;
+}
+
+class Match::Node
+{
+public:
+    Node *next;     // hash chain
+    char *key;      // 0 for an array index
+    size_t len;
+    int index;
+    uint32_t hash;
+
+    Node **buckets;
+    uint32_t mask;
+    int count;
+    Node *wild;
+
+    Item **items;
+    int nitems;
+
+    Node(const char *k, size_t n, int idx, uint32_t h)
+    :   next(0),
+        key(0),
+        len(n),
+        index(idx),
+        hash(h),
+        buckets(0),
+        mask(0),
+        count(0),
+        wild(0),
+        items(0),
+        nitems(0)
+    {
+        if (k)
+        {
+            key = (char*) malloc(n + 1);
+            memcpy(key, k, n);
+            key[n] = '\0';
+        }
+    }
+
+    ~Node()
+    {
+        for (uint32_t i = 0; buckets && (i <= mask); i++)
+        {
+            while (Node *node = buckets[i])
+            {
+                buckets[i] = node->next;
+                delete node;
+            }
+        }
+        delete[] buckets;
+        delete wild;
+        free(items);
+        free(key);
+    }
+
+    Node *find(const char *k, size_t n, int idx, uint32_t h)
+    {
+        if (!buckets)
+        {
+            return 0;
+        }
+        for (Node *node = buckets[h & mask]; node; node = node->next)
+        {
+            if (node->hash != h) continue;
+            if (k)
+            {
+                if (node->key && (node->len == n) && !memcmp(node->key, k, n)) return node;
+            }
+            else
+            {
+                if (!node->key && (node->index == idx)) return node;
+            }
+        }
+        return 0;
+    }
+
+    void grow()
+    {
+        const uint32_t size = buckets ? (mask + 1) : 0;
+        if (uint32_t(count) < size)
+        {
+            return;
+        }
+        const uint32_t new_size = size ? (size * 2) : 4;
+        Node **old = buckets;
+        buckets = new Node*[new_size];
+        memset(buckets, 0, sizeof(Node*) * new_size);
+        mask = new_size - 1;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            while (Node *node = old[i])
+            {
+                old[i] = node->next;
+                node->next = buckets[node->hash & mask];
+                buckets[node->hash & mask] = node;
+            }
+        }
+        delete[] old;
+    }
+
+    // "[n]" with only digits between the brackets is an array index, else -1
+    static int parse_index(const char *seg, size_t n)
+    {
+        if ((n < 3) || (seg[0] != '[') || (seg[n-1] != ']')) return -1;
+
+        for (size_t i = 1; i < (n - 1); i++)
+        {
+            if (!isdigit((unsigned char) seg[i])) return -1;
+        }
+
+        errno = 0;
+        char *end = 0;
+        const long idx = strtol(& seg[1], & end, 10);
+        if (errno || (end != & seg[n-1]) || (idx > INT_MAX)) return -1;
+        return (int) idx;
+    }
+
+    // find or create the child for a path segment : anything not a valid index is a key
+    Node *add(const char *seg)
+    {
+        if (!strcmp(seg, "*"))
+        {
+            if (!wild)
+            {
+                wild = new Node("*", 1, -1, 0);
+            }
+            return wild;
+        }
+
+        const size_t n = strlen(seg);
+        const int idx = parse_index(seg, n);
+
+        const char *k = (idx == -1) ? seg : 0;
+        const uint32_t h = k ? hash_key(seg, n) : hash_index(idx);
+        Node *node = find(k, n, idx, h);
+        if (node)
+        {
+            return node;
+        }
+
+        grow();
+        node = new Node(k, n, idx, h);
+        node->next = buckets[h & mask];
+        buckets[h & mask] = node;
+        count += 1;
+        return node;
+    }
+
+    void add_item(Item *item)
+    {
+        items = (Item**) realloc(items, sizeof(Item*) * size_t(nitems + 1));
+        ASSERT(items);
+        items[nitems++] = item;
+    }
+};
+
+    /*
+     *  State for each level of nesting.
+     *
+     *  active : trie nodes that match the path to this level's key / index.
+     *  held : nodes with items that match a path above this level.
      */
 
 class Match::Level
 {
 public:
     enum Type { OBJECT, ARRAY, NONE };
-    Section key;
+
     enum Type type;
     int idx;
 
+    // grown as needed, and kept for the next parse
+    Node **active;
+    int nactive;
+    int sactive;
+    Node **held;
+    int nheld;
+    int sheld;
+
+    static void push(Node ***nodes, int *n, int *size, Node *node)
+    {
+        if (*n == *size)
+        {
+            *size = *size ? (*size * 2) : 8;
+            *nodes = (Node**) realloc(*nodes, sizeof(Node*) * size_t(*size));
+            ASSERT(*nodes);
+        }
+        (*nodes)[(*n)++] = node;
+    }
+
     Level()
     :   type(NONE),
-        idx(-1)
+        idx(-1),
+        active(0),
+        nactive(0),
+        sactive(0),
+        held(0),
+        nheld(0),
+        sheld(0)
     {
-        set_key(0);
+    }
+
+    ~Level()
+    {
+        free(held);
+        free(active);
     }
 
     void init(enum Type t)
     {
         type = t;
-        set_key(0);
         idx = -1;
+        nactive = 0;
+        nheld = 0;
+    }
+
+    void add(Node *node)
+    {
+        if (node)
+        {
+            push(& active, & nactive, & sactive, node);
+        }
     }
-    void set_key(Section *sec)
+
+    // set up the paths from the parent level
+    void inherit(Level *parent)
     {
-        if (sec)
+        nactive = 0;
+        nheld = 0;
+        for (int i = 0; i < parent->nheld; i++)
         {
-            key = *sec;
+            push(& held, & nheld, & sheld, parent->held[i]);
         }
-        else
+        for (int i = 0; i < parent->nactive; i++)
         {
-            key.s = key.e = 0;
+            Node *node = parent->active[i];
+            if (node->nitems)
+            {
+                push(& held, & nheld, & sheld, node);
+            }
         }
     }
 };
@@ -497,14 +1305,17 @@ Match::Match(bool _verbose, int nlevels)
     nest(0),
     max_nest(nlevels),
     levels(0),
-    items(Item::get_next)
+    root(0)
 {
     if (verbose) PO_DEBUG("");
     levels = new Level[size_t(nlevels)];
+    root = new Node(0, 0, -1, 0);
+    levels[0].add(root);
 }
 
 Match::~Match()
 {
+    delete root;
     delete[] levels;
 }
 
@@ -518,7 +1329,60 @@ LUT Match::type_lut[] = {
 void Match::add_item(struct Item *item, Mutex *m)
 {
     if (verbose) PO_DEBUG("");
-    items.push(item, m);
+    ASSERT(item);
+    ASSERT(item->keys);
+    ASSERT(item->keys[0]);
+
+    {
+        Lock lock(m);
+        Node *node = root;
+        for (const char **key = item->keys; *key; key++)
+        {
+            node = node->add(*key);
+        }
+        node->add_item(item);
+    }
+}
+
+    // the key at this level has been set : resolve it in the trie
+
+void Match::descend(Section *key)
+{
+    Level *level = & levels[nest];
+    Level *parent = & levels[nest-1];
+    level->inherit(parent);
+
+    const size_t n = size_t(1 + key->e - key->s);
+    const uint32_t h = hash_key(key->s, n);
+    for (int i = 0; i < parent->nactive; i++)
+    {
+        Node *node = parent->active[i];
+        level->add(node->find(key->s, n, -1, h));
+        level->add(node->wild);
+    }
+}
+
+    // the next array element at this level
+
+void Match::element()
+{
+    Level *level = & levels[nest];
+    if ((nest == 0) || (level->type != Level::ARRAY))
+    {
+        return;
+    }
+
+    Level *parent = & levels[nest-1];
+    level->idx += 1;
+    level->inherit(parent);
+
+    const uint32_t h = hash_index(level->idx);
+    for (int i = 0; i < parent->nactive; i++)
+    {
+        Node *node = parent->active[i];
+        level->add(node->find(0, 0, level->idx, h));
+        level->add(node->wild);
+    }
 }
 
 void Match::check(Section *sec, enum Type type)
@@ -529,35 +1393,42 @@ void Match::check(Section *sec, enum Type type)
         PO_DEBUG("%s", p.get());
     }
     if (nest >= max_nest) return;
+    if (nest == 0) return;
 
-    struct Item *item = 0;
+    element();
 
-    for (item = items.head; item; item = item->next)
-    {
-        const char **keys = item->keys;
+    Level *level = & levels[nest];
 
-        for (int i = 1; i <= nest; i++)
+    for (int i = 0; i < level->nheld; i++)
+    {
+        Node *node = level->held[i];
+        for (int j = 0; j < node->nitems; j++)
         {
-            Level *level = & levels[i];
-            const char *key = keys[i-1];
-            //PO_DEBUG("nest=%d i=%d %s", nest, i, key);
-            if (!key)
-                break;
-            if (!level->key.match(key))
-                break;
+            Item *item = node->items[j];
+            ASSERT(item->on_match);
+            item->on_match(item->arg, sec, type, item->keys);
+        }
+    }
 
-            if (keys[i] == 0)
-            {
-                ASSERT(item->on_match);
-                item->on_match(item->arg, sec, type, item->keys);
-                break;
-            }
+    for (int i = 0; i < level->nactive; i++)
+    {
+        Node *node = level->active[i];
+        for (int j = 0; j < node->nitems; j++)
+        {
+            Item *item = node->items[j];
+            ASSERT(item->on_match);
+            item->on_match(item->arg, sec, type, item->keys);
         }
     }
 }
 
 enum Match::Error Match::on_object(bool push)
 {
+    if (push && (nest < max_nest))
+    {
+        // an object can be an array element
+        element();
+    }
     nest += push ? 1 : -1;
     //PO_DEBUG("nest=%d push=%d", nest, push);
     if (nest >= max_nest) return OKAY;
@@ -570,6 +1441,10 @@ enum Match::Error Match::on_object(bool push)
 
 enum Match::Error Match::on_array(bool push)
 {
+    if (push && (nest < max_nest))
+    {
+        element();
+    }
     nest += push ? 1 : -1;
     //PO_DEBUG("nest=%d push=%d", nest, push);
     if (nest >= max_nest) return OKAY;
@@ -584,7 +1459,6 @@ enum Match::Error Match::on_number(Section *sec)
 {
     if (nest >= max_nest) return OKAY;
     check(sec, Match::NUMBER);
-    levels[nest].set_key(0);
     return OKAY;
 }
 
@@ -599,12 +1473,11 @@ enum Match::Error Match::on_string(Section *sec, bool key)
             PO_DEBUG("key:%s", p.get());
         }
         ASSERT(levels[nest].type == Level::OBJECT);
-        levels[nest].set_key(sec);
+        descend(sec);
     }
     else
     {
         check(sec, Match::STRING);
-        levels[nest].set_key(0);
     }
     return OKAY;
 }
@@ -613,7 +1486,6 @@ enum Match::Error Match::on_primitive(Section *sec)
 {
     if (nest >= max_nest) return OKAY;
     check(sec, Match::PRIMITIVE);
-    levels[nest].set_key(0);
     return OKAY;
 }
 
@@ -1,4 +1,5 @@
 
+#include <errno.h>
 #include <pthread.h>
 
 #include <panglos/debug.h>
@@ -35,6 +36,13 @@ private:
         int err = pthread_mutex_unlock(& mutex);
         ASSERT(err == 0);
     }
+
+    virtual bool try_lock()
+    {
+        int err = pthread_mutex_trylock(& mutex);
+        ASSERT((err == 0) || (err == EBUSY));
+        return err == 0;
+    }
 };
 
 namespace panglos {
@@ -1,12 +1,14 @@
 
 #include <atomic>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "panglos/debug.h"
 
 #include "panglos/queue.h"
 #include "panglos/time.h"
-#include "panglos/semaphore.h"
 #include "panglos/mutex.h"
 
 using namespace panglos;
@@ -17,48 +19,78 @@ using namespace panglos;
 
 class Linux_Queue : public Queue
 {
-    Semaphore *sem_get_wait;
-    Semaphore *sem_put_wait;
+    // the queue does its own locking, so it can wait on the condition variables
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
     int raw_size;
     int size;
     int num;
     uint8_t *data;
-    std::atomic<int> in;
-    std::atomic<int> out;
+
+    // Slots are used in ring order : out <= peeked <= ready <= in
+    enum State { FREE, RESERVED, COMMITTED, PEEKED };
+    uint8_t *state;
+    // oldest slot not yet released
+    int out;
+    // next slot for peek()
+    int peeked;
+    // first slot not yet committed
+    int ready;
+    // next slot for reserve()
+    int in;
+    // slots in use, from out to in
+    int used;
+    // slots from out to peeked
+    int held;
+    // slots from ready to in
+    int pending;
+    // committed, but not yet peeked : from peeked to ready
     std::atomic<int> count;
-    Mutex *mutex;
 public:
     Linux_Queue(int _size, int _num, Mutex *m)
-    :   sem_get_wait(0),
-        sem_put_wait(0),
-        raw_size(_size),
+    :   raw_size(_size),
         size(round(_size)),
         num(_num),
         data(0),
-        in(0),
+        state(0),
         out(0),
-        count(0),
-        mutex(m)
+        peeked(0),
+        ready(0),
+        in(0),
+        used(0),
+        held(0),
+        pending(0),
+        count(0)
     {
         ASSERT(size);
         ASSERT(num);
+        IGNORE(m);
 
-        sem_get_wait = Semaphore::create();
-        sem_put_wait  = Semaphore::create();
+        int err = pthread_mutex_init(& lock, 0);
+        ASSERT(err == 0);
 
-        // post() size-1 times, so we can wait on a full queue
-        for (int i = 0; i < (size-1); i++)
-        {
-            sem_put_wait->post();
-        }
+        // timeouts are measured against the monotonic clock
+        pthread_condattr_t attr;
+        pthread_condattr_init(& attr);
+        pthread_condattr_setclock(& attr, CLOCK_MONOTONIC);
+        err = pthread_cond_init(& not_empty, & attr);
+        ASSERT(err == 0);
+        err = pthread_cond_init(& not_full, & attr);
+        ASSERT(err == 0);
+        pthread_condattr_destroy(& attr);
 
         data = new uint8_t [size_t(size * num)];
+        state = new uint8_t [size_t(num)];
+        memset(state, FREE, size_t(num));
     }
 
     ~Linux_Queue()
     {
-        delete sem_get_wait;
-        delete sem_put_wait;
+        pthread_cond_destroy(& not_empty);
+        pthread_cond_destroy(& not_full);
+        pthread_mutex_destroy(& lock);
+        delete[] state;
         delete[] data;
     }
 
@@ -71,6 +103,19 @@ public:
         return (Message *) p;    
     }
 
+    int get_idx(Message *msg)
+    {
+        const int idx = int(((uint8_t *) msg - data) / size);
+        ASSERT((idx >= 0) && (idx < num));
+        ASSERT(get_data(__FUNCTION__, idx) == msg);
+        return idx;
+    }
+
+    Message *msg_at(const Message *msgs, int idx)
+    {
+        return (Message *) & ((const uint8_t *) msgs)[idx * raw_size];
+    }
+
     void copy(Message *dst, Message *src)
     {
         ASSERT(dst);
@@ -79,54 +124,221 @@ public:
         memcpy(dst, src, size_t(raw_size));
     }
 
-    virtual bool get(Message *msg, int timeout) override
+    static void deadline(struct timespec *ts, int ticks)
     {
-        ASSERT(msg);
-        IGNORE(timeout);
-        // TODO : wait on sempahore using sem_timedwait() ~
-        sem_get_wait->wait();
+        // Linux ticks are ms
+        clock_gettime(CLOCK_MONOTONIC, ts);
+        ts->tv_sec += ticks / 1000;
+        ts->tv_nsec += (ticks % 1000) * 1000000L;
+        if (ts->tv_nsec >= 1000000000L)
+        {
+            ts->tv_sec += 1;
+            ts->tv_nsec -= 1000000000L;
+        }
+    }
 
-        Lock lock(mutex);
+    // wake one waiter, or all of them if several items have changed
+    static void wake(pthread_cond_t *cond, int n)
+    {
+        if (n == 1)
+        {
+            pthread_cond_signal(cond);
+        }
+        else if (n > 1)
+        {
+            pthread_cond_broadcast(cond);
+        }
+    }
+
+        /*
+         *  Slot handling : must be called with the lock held
+         */
 
-        if (in == out)
+    Message *_reserve()
+    {
+        while (used == num)
         {
-            // Queue empty
-            return false;
+            // Queue is full, so wait on the next release()
+            pthread_cond_wait(& not_full, & lock);
         }
 
-        const int next = (out + 1) % num;
+        const int idx = in;
+        in = (in + 1) % num;
+        used += 1;
+        pending += 1;
+        state[idx] = RESERVED;
+        return get_data(__FUNCTION__, idx);
+    }
 
-        copy(msg, get_data(__FUNCTION__, out));
-        out = next;
-        count -= 1;
+    // returns the number of messages made available
+    int _commit(Message *msg)
+    {
+        const int idx = get_idx(msg);
+        ASSERT(state[idx] == RESERVED);
+        state[idx] = COMMITTED;
 
-        sem_put_wait->post();
+        // slots are made available in the order they were reserved
+        int n = 0;
+        while (pending && (state[ready] == COMMITTED))
+        {
+            ready = (ready + 1) % num;
+            pending -= 1;
+            n += 1;
+        }
+        count += n;
+        return n;
+    }
 
+    // wait for a committed message. Returns false on timeout.
+    bool _wait(int timeout)
+    {
+        struct timespec until;
+        if (timeout)
+        {
+            deadline(& until, timeout);
+        }
+
+        while (count == 0)
+        {
+            if (!timeout)
+            {
+                pthread_cond_wait(& not_empty, & lock);
+            }
+            else if (pthread_cond_timedwait(& not_empty, & lock, & until) == ETIMEDOUT)
+            {
+                return count != 0;
+            }
+        }
         return true;
     }
 
-    virtual bool put(const Message *msg) override
+    Message *_peek()
+    {
+        ASSERT(count > 0);
+        const int idx = peeked;
+        peeked = (peeked + 1) % num;
+        count -= 1;
+        held += 1;
+        state[idx] = PEEKED;
+        return get_data(__FUNCTION__, idx);
+    }
+
+    // returns the number of slots freed
+    int _release(Message *msg)
     {
-        while (true)
+        const int idx = get_idx(msg);
+        ASSERT(state[idx] == PEEKED);
+        state[idx] = FREE;
+
+        // slots are freed in ring order
+        int n = 0;
+        while (held && (state[out] == FREE))
         {
+            out = (out + 1) % num;
+            used -= 1;
+            held -= 1;
+            n += 1;
+        }
+        return n;
+    }
+
+        /*
+         *  In-place API
+         */
+
+    virtual Message *reserve() override
+    {
+        pthread_mutex_lock(& lock);
+        Message *msg = _reserve();
+        pthread_mutex_unlock(& lock);
+        return msg;
+    }
+
+    virtual void commit(Message *msg) override
+    {
+        ASSERT(msg);
+        pthread_mutex_lock(& lock);
+        wake(& not_empty, _commit(msg));
+        pthread_mutex_unlock(& lock);
+    }
+
+    virtual Message *peek(int timeout) override
+    {
+        pthread_mutex_lock(& lock);
+        Message *msg = _wait(timeout) ? _peek() : 0;
+        pthread_mutex_unlock(& lock);
+        return msg;
+    }
+
+    virtual void release(Message *msg) override
+    {
+        ASSERT(msg);
+        pthread_mutex_lock(& lock);
+        wake(& not_full, _release(msg));
+        pthread_mutex_unlock(& lock);
+    }
+
+        /*
+         *  Copying API
+         */
+
+    virtual int get_many(Message *msgs, int n, int timeout) override
+    {
+        ASSERT(msgs);
+        ASSERT(n > 0);
+
+        pthread_mutex_lock(& lock);
+
+        int i = 0;
+        int freed = 0;
+        if (_wait(timeout))
+        {
+            for (; (i < n) && (count > 0); i++)
             {
-                Lock lock(mutex);
+                Message *msg = _peek();
+                copy(msg_at(msgs, i), msg);
+                freed += _release(msg);
+            }
+        }
 
-                const int next = (in + 1) % num;
+        wake(& not_full, freed);
+        pthread_mutex_unlock(& lock);
+        return i;
+    }
 
-                if (next != out)
-                {
-                    copy(get_data(__FUNCTION__, in), (Message *) msg);
-                    in = next;
-                    count += 1;
+    virtual int put_many(const Message *msgs, int n) override
+    {
+        ASSERT(msgs);
 
-                    sem_get_wait->post();    
-                    return true;
-                }
+        pthread_mutex_lock(& lock);
+
+        int added = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (used == num)
+            {
+                // let readers in before blocking on a full queue
+                wake(& not_empty, added);
+                added = 0;
             }
-            // Queue is full, so wait on the next get()
-            sem_put_wait->wait();
+            Message *msg = _reserve();
+            copy(msg, msg_at(msgs, i));
+            added += _commit(msg);
         }
+
+        wake(& not_empty, added);
+        pthread_mutex_unlock(& lock);
+        return n;
+    }
+
+    virtual bool get(Message *msg, int timeout) override
+    {
+        return get_many(msg, 1, timeout) == 1;
+    }
+
+    virtual bool put(const Message *msg) override
+    {
+        return put_many(msg, 1) == 1;
     }
 
     virtual int queued() override
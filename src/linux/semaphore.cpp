@@ -1,5 +1,7 @@
 
 #include <atomic>
+#include <errno.h>
+#include <time.h>
 #include <semaphore.h>
 
 #include <panglos/debug.h>
@@ -58,9 +60,39 @@ void LinuxSemaphore::wait()
 
 void LinuxSemaphore::wait_timeout(int ticks)
 {
-    // TODO
-    IGNORE(ticks);
-    ASSERT(0);
+    // as FreeRTOS, 0 means wait forever
+    if (ticks == 0)
+    {
+        wait();
+        return;
+    }
+
+    // Linux ticks are ms. Use an absolute CLOCK_MONOTONIC deadline, as Linux_Queue does,
+    // so a wall clock change can't stretch or cut short the wait
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    while (true)
+    {
+        int err = sem_clockwait(& semaphore, CLOCK_MONOTONIC, & ts);
+        if (err == 0)
+        {
+            posted -= 1;
+            return;
+        }
+        if (errno == ETIMEDOUT)
+        {
+            return;
+        }
+        ASSERT(errno == EINTR);
+    }
 }
 
 namespace panglos {
@@ -1,10 +1,17 @@
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <libgen.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "panglos/debug.h"
 #include "panglos/mutex.h"
-#include "panglos/list.h"
+#include "panglos/hash.h"
+#include "panglos/pool.h"
 #include "panglos/storage.h"
 
     /*
@@ -13,7 +20,7 @@
 
 namespace panglos {
 
-class KVPair
+class KVPair : public Pooled
 {
 public:
     struct Keys
@@ -21,16 +28,17 @@ public:
         const char *ns;
         const char *key;
 
-        static int match(const struct Keys *k1, const struct Keys *k2)
+        static uint32_t hash(const char *ns, const char *key)
         {
-            int cmp = strcmp(k1->ns, k2->ns);
-            if (cmp != 0) return 0;
-            return !strcmp(k1->key, k2->key);
+            // FNV-1a over "ns\0key"
+            return fnv1a(key, strlen(key), fnv1a(ns, strlen(ns) + 1));
         }
     };
 
+    // hash chain
     KVPair *next;
     struct Keys keys;
+    uint32_t hash;
     Storage::Type type;
     size_t size;
 
@@ -42,19 +50,27 @@ public:
         void *blob;
     };
 
-    static KVPair **get_next(KVPair *item) { return & item->next; }
-
-    static int match(KVPair *item, struct Keys *keys)
+    bool match(const char *ns, const char *key, uint32_t h)
     {
-        return Keys::match(& item->keys, keys);
+        if (hash != h) return false;
+        if (strcmp(keys.key, key)) return false;
+        return !strcmp(keys.ns, ns);
     }
 
-    static KVPair *create(const char *ns, const char *key)
+    static KVPair *create(const char *ns, const char *key, uint32_t hash)
     {
         KVPair *pair = new KVPair;
         memset(pair, 0, sizeof(*pair));
-        pair->keys.ns = strdup(ns);
-        pair->keys.key = strdup(key);
+        // ns and key share a single allocation
+        const size_t ns_len = strlen(ns) + 1;
+        const size_t key_len = strlen(key) + 1;
+        char *names = (char*) malloc(ns_len + key_len);
+        ASSERT(names);
+        memcpy(names, ns, ns_len);
+        memcpy(& names[ns_len], key, key_len);
+        pair->keys.ns = names;
+        pair->keys.key = & names[ns_len];
+        pair->hash = hash;
         return pair;
     }
 
@@ -62,7 +78,7 @@ public:
     {
         switch (type)
         {
-            case Storage::VAL_BLOB  : free(blob); blob = 0; break; 
+            case Storage::VAL_BLOB  : free(blob); blob = 0; break;
             case Storage::VAL_STR   : free((void*) s); s = 0; break;
             case Storage::VAL_INT32 : return;
             case Storage::VAL_INT16 : return;
@@ -70,84 +86,490 @@ public:
             case Storage::VAL_NONE  :
             case Storage::VAL_OTHER :
             default: ASSERT(0);
-        } 
+        }
     }
 
     void free_pair()
     {
         free_data();
         free((void*) keys.ns);
-        free((void*) keys.key);
+    }
+
+    const void *value(size_t *len)
+    {
+        switch (type)
+        {
+            case Storage::VAL_BLOB  : *len = size; return blob;
+            case Storage::VAL_STR   : *len = strlen(s) + 1; return s;
+            case Storage::VAL_INT32 : *len = sizeof(v32); return & v32;
+            case Storage::VAL_INT16 : *len = sizeof(v16); return & v16;
+            case Storage::VAL_INT8  : *len = sizeof(v8); return & v8;
+            case Storage::VAL_NONE  :
+            case Storage::VAL_OTHER :
+            default: ASSERT(0);
+        }
+        return 0;
     }
 };
 
+    /*
+     *  Append-only log.
+     *
+     *  The file is a sequence of frames : { magic, len, sum, ops[len] }.
+     *  commit() writes all the pending ops as a single frame and syncs it,
+     *  so a commit is either replayed in full or not at all.
+     *  A torn or corrupt frame at the end of the file is discarded on load :
+     *  every op in a frame is checked before any of it is applied.
+     *
+     *  Each op is : { op, type, ns_len, key_len, value_len, ns, key, value }
+     *  with the strings '\0' terminated. Values are stored in host byte order.
+     *
+     *  When the log grows to several times the size of the live data,
+     *  it is compacted : a snapshot is written to a temporary file, synced,
+     *  then renamed over the log.
+     */
+
+class Log
+{
+public:
+    enum { OP_SET=1, OP_ERASE=2, };
+
+    struct Frame
+    {
+        uint32_t magic;
+        uint32_t len;
+        uint32_t sum;
+    };
+
+    struct Op
+    {
+        uint8_t op;
+        uint8_t type;
+        uint16_t ns_len;
+        uint16_t key_len;
+        uint32_t value_len;
+    }   __attribute__((packed));
+
+    static const uint32_t MAGIC = 0x4b56504c; // "LPVK"
+
+    uint8_t *data;
+    size_t len;
+    size_t max;
+
+    Log() : data(0), len(0), max(0) { }
+    ~Log() { free(data); }
+
+    void reset()
+    {
+        len = 0;
+    }
+
+    void add(const void *d, size_t n)
+    {
+        if ((len + n) > max)
+        {
+            max = (max * 2) + n + 256;
+            data = (uint8_t*) realloc(data, max);
+            ASSERT(data);
+        }
+        memcpy(& data[len], d, n);
+        len += n;
+    }
+
+    static size_t op_size(const char *ns, const char *key, size_t value_len)
+    {
+        return sizeof(struct Op) + strlen(ns) + 1 + strlen(key) + 1 + value_len;
+    }
+
+    void add_op(uint8_t op, Storage::Type type, const char *ns, const char *key, const void *value, size_t value_len)
+    {
+        const size_t ns_len = strlen(ns) + 1;
+        const size_t key_len = strlen(key) + 1;
+        struct Op hdr = {
+            .op = op,
+            .type = (uint8_t) type,
+            .ns_len = (uint16_t) ns_len,
+            .key_len = (uint16_t) key_len,
+            .value_len = (uint32_t) value_len,
+        };
+        add(& hdr, sizeof(hdr));
+        add(ns, ns_len);
+        add(key, key_len);
+        if (value_len)
+        {
+            add(value, value_len);
+        }
+    }
+
+    // FNV-1a : detects torn writes, not tampering
+    static uint32_t checksum(const uint8_t *d, size_t n)
+    {
+        return fnv1a(d, n);
+    }
+
+    static bool write_all(int fd, const void *d, size_t n)
+    {
+        const uint8_t *p = (const uint8_t*) d;
+        while (n)
+        {
+            const ssize_t w = ::write(fd, p, n);
+            if (w <= 0) return false;
+            p += w;
+            n -= size_t(w);
+        }
+        return true;
+    }
+
+    // write the buffer as a single frame
+    bool write_frame(int fd)
+    {
+        struct Frame frame = {
+            .magic = MAGIC,
+            .len = (uint32_t) len,
+            .sum = checksum(data, len),
+        };
+        if (!write_all(fd, & frame, sizeof(frame))) return false;
+        return write_all(fd, data, len);
+    }
+};
+
+    /*
+     *
+     */
+
 class Helper
 {
     Mutex *mutex;
-    typedef List<KVPair*> Pairs;
+    KVPair **buckets;
+    uint32_t mask;
+    int count;
+
+    // persistence
+    char *path;
+    int fd;
+    size_t log_size;
+    // approx size of the live data, as log ops
+    size_t live_size;
+    Log pending;
+
+    static const size_t MIN_COMPACT = 64 * 1024;
 
-    Pairs pairs;
+    KVPair **bucket(uint32_t hash)
+    {
+        return & buckets[hash & mask];
+    }
 
-    KVPair *find(const char *ns, const char *key, Mutex *mutex)
+    KVPair *find(const char *ns, const char *key)
     {
         if (!ns) return 0;
         if (!key) return 0;
-        KVPair::Keys keys = {
-            .ns = ns,
-            .key = key,
-        };
-        return pairs.find((int (*)(KVPair*,void*)) KVPair::match, & keys, mutex);
+        const uint32_t h = KVPair::Keys::hash(ns, key);
+        for (KVPair *pair = *bucket(h); pair; pair = pair->next)
+        {
+            if (pair->match(ns, key, h)) return pair;
+        }
+        return 0;
     }
 
-    KVPair *find(const char *ns, const char *key, Storage::Type type, Mutex *mutex)
+    KVPair *find(const char *ns, const char *key, Storage::Type type)
     {
-        KVPair *pair = find(ns, key, mutex);
+        KVPair *pair = find(ns, key);
         if (!pair) return 0;
         if (pair->type != type) return 0;
         return pair;
     }
 
+    void grow()
+    {
+        const uint32_t size = mask + 1;
+        if (uint32_t(count) < size)
+        {
+            return;
+        }
+
+        KVPair **old = buckets;
+        buckets = new KVPair*[size * 2];
+        memset(buckets, 0, sizeof(KVPair*) * size * 2);
+        mask = (size * 2) - 1;
+
+        for (uint32_t i = 0; i < size; i++)
+        {
+            while (KVPair *pair = old[i])
+            {
+                old[i] = pair->next;
+                KVPair **b = bucket(pair->hash);
+                pair->next = *b;
+                *b = pair;
+            }
+        }
+        delete[] old;
+    }
+
+    size_t live(KVPair *pair)
+    {
+        size_t len = 0;
+        pair->value(& len);
+        return Log::op_size(pair->keys.ns, pair->keys.key, len);
+    }
+
+    // call with the value already set : logs it
+    void updated(KVPair *pair)
+    {
+        live_size += live(pair);
+        if (fd == -1) return;
+        size_t len = 0;
+        const void *v = pair->value(& len);
+        pending.add_op(Log::OP_SET, pair->type, pair->keys.ns, pair->keys.key, v, len);
+    }
+
     KVPair *find_set(const char *ns, const char *key)
     {
-        KVPair *pair = find(ns, key, 0);
+        KVPair *pair = find(ns, key);
         if (!pair)
         {
-            pair = KVPair::create(ns, key);
+            grow();
+            const uint32_t h = KVPair::Keys::hash(ns, key);
+            pair = KVPair::create(ns, key, h);
             ASSERT(pair);
-            pairs.push(pair, 0);
+            KVPair **b = bucket(h);
+            pair->next = *b;
+            *b = pair;
+            count += 1;
         }
         else
         {
+            live_size -= live(pair);
             pair->free_data();
         }
         return pair;
     }
 
+    void _erase(KVPair *pair)
+    {
+        for (KVPair **b = bucket(pair->hash); *b; b = & (*b)->next)
+        {
+            if (*b == pair)
+            {
+                *b = pair->next;
+                break;
+            }
+        }
+        live_size -= live(pair);
+        pair->free_pair();
+        delete pair;
+        count -= 1;
+    }
+
+    void _clear()
+    {
+        for (uint32_t i = 0; i <= mask; i++)
+        {
+            while (KVPair *pair = buckets[i])
+            {
+                buckets[i] = pair->next;
+                pair->free_pair();
+                delete pair;
+            }
+        }
+        count = 0;
+        live_size = 0;
+    }
+
+    void _set(uint8_t type, const char *ns, const char *key, const uint8_t *v, size_t len)
+    {
+        KVPair *pair = find_set(ns, key);
+        pair->type = (Storage::Type) type;
+        switch (pair->type)
+        {
+            case Storage::VAL_INT8  : memcpy(& pair->v8, v, sizeof(pair->v8)); break;
+            case Storage::VAL_INT16 : memcpy(& pair->v16, v, sizeof(pair->v16)); break;
+            case Storage::VAL_INT32 : memcpy(& pair->v32, v, sizeof(pair->v32)); break;
+            case Storage::VAL_STR   : pair->s = strndup((const char*) v, len); break;
+            case Storage::VAL_BLOB  :
+            {
+                pair->blob = malloc(len);
+                memcpy(pair->blob, v, len);
+                pair->size = len;
+                break;
+            }
+            case Storage::VAL_NONE  :
+            case Storage::VAL_OTHER :
+            default : ASSERT(0);
+        }
+        live_size += live(pair);
+    }
+
+    // check that one op from disk is well formed
+    static bool valid_op(const struct Log::Op & op, const char *ns, const char *key)
+    {
+        if ((op.ns_len < 1) || (op.key_len < 1)) return false;
+        if (ns[op.ns_len - 1] != '\0') return false;
+        if (key[op.key_len - 1] != '\0') return false;
+
+        if (op.op == Log::OP_ERASE) return true;
+        if (op.op != Log::OP_SET) return false;
+
+        switch (op.type)
+        {
+            case Storage::VAL_INT8  : return op.value_len == sizeof(int8_t);
+            case Storage::VAL_INT16 : return op.value_len == sizeof(int16_t);
+            case Storage::VAL_INT32 : return op.value_len == sizeof(int32_t);
+            case Storage::VAL_STR   : return true;
+            case Storage::VAL_BLOB  : return true;
+            default : return false;
+        }
+    }
+
+    // walk the ops in one frame, checking each one, and applying it if asked
+    bool walk(const uint8_t *d, size_t n, bool apply)
+    {
+        while (n)
+        {
+            struct Log::Op op;
+            if (n < sizeof(op)) return false;
+            memcpy(& op, d, sizeof(op));
+            const size_t len = sizeof(op) + op.ns_len + op.key_len + op.value_len;
+            if (n < len) return false;
+
+            const char *ns = (const char*) & d[sizeof(op)];
+            const char *key = & ns[op.ns_len];
+            const uint8_t *v = (const uint8_t*) & key[op.key_len];
+
+            if (!valid_op(op, ns, key)) return false;
+
+            if (apply && (op.op == Log::OP_SET))
+            {
+                _set(op.type, ns, key, v, op.value_len);
+            }
+            else if (apply)
+            {
+                KVPair *pair = find(ns, key);
+                if (pair) _erase(pair);
+            }
+            d += len;
+            n -= len;
+        }
+        return true;
+    }
+
+    // apply the ops from one frame : check them all first, so a bad frame changes nothing
+    bool replay(const uint8_t *d, size_t n)
+    {
+        if (!walk(d, n, false)) return false;
+        return walk(d, n, true);
+    }
+
+    // make a rename() durable
+    static bool sync_dir(const char *p)
+    {
+        char *copy = strdup(p);
+        const int d = ::open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        free(copy);
+        if (d == -1) return false;
+        const bool ok = !fsync(d);
+        close(d);
+        return ok;
+    }
+
+    // write a snapshot of the store : replaces the file atomically
+    bool snapshot(const char *p)
+    {
+        Log log;
+        for (uint32_t i = 0; i <= mask; i++)
+        {
+            for (KVPair *pair = buckets[i]; pair; pair = pair->next)
+            {
+                size_t len = 0;
+                const void *v = pair->value(& len);
+                log.add_op(Log::OP_SET, pair->type, pair->keys.ns, pair->keys.key, v, len);
+            }
+        }
+
+        const size_t tmp_len = strlen(p) + 8;
+        char *tmp = (char*) malloc(tmp_len);
+        snprintf(tmp, tmp_len, "%s.tmp", p);
+
+        bool ok = false;
+        const int f = ::open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (f != -1)
+        {
+            ok = (log.len == 0) || log.write_frame(f);
+            ok = ok && !fsync(f);
+            close(f);
+            ok = ok && !rename(tmp, p);
+            ok = ok && sync_dir(p);
+        }
+        if (!ok)
+        {
+            PO_ERROR("error writing %s", tmp);
+            unlink(tmp);
+        }
+        free(tmp);
+        return ok;
+    }
+
+    void detach()
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        fd = -1;
+        free(path);
+        path = 0;
+        pending.reset();
+        log_size = 0;
+    }
+
+    bool compact()
+    {
+        PO_DEBUG("path=%s log=%d live=%d", path, (int) log_size, (int) live_size);
+        if (!snapshot(path))
+        {
+            return false;
+        }
+        // the old fd refers to the replaced file
+        close(fd);
+        fd = ::open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd == -1)
+        {
+            PO_ERROR("error opening %s", path);
+            return false;
+        }
+        struct stat st;
+        fstat(fd, & st);
+        log_size = size_t(st.st_size);
+        return true;
+    }
+
 public:
     Helper()
     :   mutex(0),
-        pairs(KVPair::get_next)
+        buckets(0),
+        mask(15),
+        count(0),
+        path(0),
+        fd(-1),
+        log_size(0),
+        live_size(0)
     {
         mutex = Mutex::create();
+        buckets = new KVPair*[mask + 1];
+        memset(buckets, 0, sizeof(KVPair*) * (mask + 1));
     }
 
     ~Helper()
     {
         clear(mutex);
+        delete[] buckets;
         delete mutex;
     }
 
     void clear(Mutex *m=0)
     {
         Lock lock(m ? m : mutex);
-
-        while (true)
-        {
-            KVPair *pair = pairs.pop(0);
-            if (!pair) break;
-            pair->free_pair();
-            delete pair;
-        }
+        _clear();
+        detach();
     }
 
     bool set(const char *ns, const char *key, const char *value)
@@ -158,6 +580,7 @@ public:
         KVPair *pair = find_set(ns, key);
         pair->type = Storage::VAL_STR;
         pair->s = strdup(value);
+        updated(pair);
         return true;
     }
 
@@ -168,6 +591,7 @@ public:
         KVPair *pair = find_set(ns, key);
         pair->type = Storage::VAL_INT32;
         pair->v32 = value;
+        updated(pair);
         return true;
     }
 
@@ -178,6 +602,7 @@ public:
         KVPair *pair = find_set(ns, key);
         pair->type = Storage::VAL_INT16;
         pair->v16 = value;
+        updated(pair);
         return true;
     }
 
@@ -188,6 +613,7 @@ public:
         KVPair *pair = find_set(ns, key);
         pair->type = Storage::VAL_INT8;
         pair->v8 = value;
+        updated(pair);
         return true;
     }
 
@@ -204,6 +630,7 @@ public:
 
         pair->blob = blob;
         pair->size = sz;
+        updated(pair);
         return true;
     }
 
@@ -214,7 +641,7 @@ public:
 
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, Storage::VAL_STR, 0);
+        KVPair *pair = find(ns, key, Storage::VAL_STR);
         if (!pair) return false;
 
         size_t mx = strlen(pair->s) + 1; // space for '\0'
@@ -228,7 +655,7 @@ public:
     {
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, Storage::VAL_INT32, 0);
+        KVPair *pair = find(ns, key, Storage::VAL_INT32);
         if (!pair) return false;
 
         if (value) *value = pair->v32;
@@ -239,7 +666,7 @@ public:
     {
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, Storage::VAL_INT16, 0);
+        KVPair *pair = find(ns, key, Storage::VAL_INT16);
         if (!pair) return false;
 
         if (value) *value = pair->v16;
@@ -250,7 +677,7 @@ public:
     {
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, Storage::VAL_INT8, 0);
+        KVPair *pair = find(ns, key, Storage::VAL_INT8);
         if (!pair) return false;
 
         if (value) *value = pair->v8;
@@ -262,7 +689,7 @@ public:
         ASSERT(sz);
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, Storage::VAL_BLOB, 0);
+        KVPair *pair = find(ns, key, Storage::VAL_BLOB);
         if (!pair) return false;
 
         if (data)
@@ -278,12 +705,14 @@ public:
     {
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, 0);
+        KVPair *pair = find(ns, key);
         if (!pair) return false;
-        
-        pairs.remove(pair, 0);
-        pair->free_pair();
-        delete pair;
+
+        if (fd != -1)
+        {
+            pending.add_op(Log::OP_ERASE, Storage::VAL_NONE, ns, key, 0, 0);
+        }
+        _erase(pair);
         return true;
     }
 
@@ -291,23 +720,133 @@ public:
     {
         Lock lock(mutex);
 
-        KVPair *pair = find(ns, key, 0);
+        KVPair *pair = find(ns, key);
         if (!pair) return Storage::VAL_NONE;
         return pair->type;
     }
 
+        /*
+         *  Persistence
+         */
+
+    bool load(const char *p)
+    {
+        ASSERT(p);
+        Lock lock(mutex);
+
+        _clear();
+        detach();
+
+        fd = ::open(p, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            PO_ERROR("error opening %s", p);
+            return false;
+        }
+        path = strdup(p);
+
+        struct stat st;
+        if (fstat(fd, & st))
+        {
+            PO_ERROR("error reading %s", p);
+            return false;
+        }
+        const size_t file_size = size_t(st.st_size);
+
+        // replay every complete frame
+        size_t offset = 0;
+        uint8_t *buff = 0;
+        while (true)
+        {
+            struct Log::Frame frame;
+            if (pread(fd, & frame, sizeof(frame), off_t(offset)) != sizeof(frame)) break;
+            if (frame.magic != Log::MAGIC) break;
+            // the length is from disk : a frame past the end of the file is torn
+            if (size_t(frame.len) > (file_size - offset - sizeof(frame))) break;
+            buff = (uint8_t*) realloc(buff, size_t(frame.len) + 1);
+            ASSERT(buff);
+            const off_t at = off_t(offset + sizeof(frame));
+            if (pread(fd, buff, frame.len, at) != ssize_t(frame.len)) break;
+            if (Log::checksum(buff, frame.len) != frame.sum) break;
+            if (!replay(buff, frame.len)) break;
+            offset += sizeof(frame) + frame.len;
+        }
+        free(buff);
+
+        if (file_size != offset)
+        {
+            // discard the torn commit
+            PO_ERROR("%s : discarding %d bytes", p, int(file_size - offset));
+            if (ftruncate(fd, off_t(offset)) || fsync(fd))
+            {
+                PO_ERROR("error truncating %s", p);
+            }
+        }
+        lseek(fd, 0, SEEK_END);
+        log_size = offset;
+        return true;
+    }
+
+    bool save(const char *p)
+    {
+        ASSERT(p);
+        Lock lock(mutex);
+        return snapshot(p);
+    }
+
+    bool commit()
+    {
+        Lock lock(mutex);
+
+        if (fd == -1)
+        {
+            // no log file
+            return true;
+        }
+
+        if (pending.len)
+        {
+            if (!pending.write_frame(fd) || fdatasync(fd))
+            {
+                PO_ERROR("error writing %s", path);
+                return false;
+            }
+            log_size += sizeof(struct Log::Frame) + pending.len;
+            pending.reset();
+        }
+
+        if ((log_size > MIN_COMPACT) && (log_size > (4 * live_size)))
+        {
+            return compact();
+        }
+        return true;
+    }
+
+        /*
+         *
+         */
+
     class Iterator
     {
+        Helper *helper;
+        uint32_t idx;
         KVPair *item;
     public:
-        Iterator(KVPair *p)
-        :   item(p)
+        Iterator(Helper *h)
+        :   helper(h),
+            idx(0),
+            item(h->buckets[0])
         {
         }
 
         bool next(char *ns, char *key, Storage::Type *type, size_t max_sz)
         {
-            if (!item) return false;
+            while (!item)
+            {
+                if (idx >= helper->mask) return false;
+                idx += 1;
+                item = helper->buckets[idx];
+            }
             strncpy(ns, item->keys.ns, max_sz);
             strncpy(key, item->keys.key, max_sz);
             *type = item->type;
@@ -315,11 +854,6 @@ public:
             return true;
         }
     };
-
-    KVPair *start()
-    {
-        return pairs.head;
-    }
 };
 
 static Helper helper;
@@ -402,7 +936,7 @@ bool Storage::erase(const char *key)
 
 bool Storage::commit()
 {
-    return true;
+    return helper.commit();
 }
 
     /*
@@ -412,8 +946,8 @@ bool Storage::commit()
 class Storage::List::Iter : public Helper::Iterator
 {
 public:
-    Iter(KVPair *p)
-    :   Iterator(p)
+    Iter(Helper *h)
+    :   Iterator(h)
     {
     }
 };
@@ -422,14 +956,14 @@ Storage::List::List(const char *_ns)
 :   ns(_ns),
     iter(0)
 {
-    iter = new Storage::List::Iter(helper.start());
+    iter = new Storage::List::Iter(& helper);
 }
- 
+
 Storage::List::~List()
 {
     delete iter;
 }
- 
+
 bool Storage::List::get(char *_ns, char *key, Storage::Type *type, size_t max_sz)
 {
     while (true)
@@ -448,7 +982,17 @@ void Storage::clear_all()
 {
     helper.clear();
 }
- 
+
+bool Storage::load(const char *path)
+{
+    return helper.load(path);
+}
+
+bool Storage::save(const char *path)
+{
+    return helper.save(path);
+}
+
 }   //  panglos
 
 //  FIN
@@ -33,6 +33,7 @@ class NativeThread : public Thread
     pthread_t thread;
     void (*fn)(void*);
     void *arg;
+    int core;
 
     Thread *next;
 public:
@@ -47,6 +48,7 @@ public:
         thread(0),
         fn(0),
         arg(0),
+        core(-1),
         next(0)
     {
         if (!mutex)
@@ -75,12 +77,24 @@ public:
         return 0;
     }
 
-    virtual void start(void (*_fn)(void *arg), void *_arg, int) override
+    virtual void start(void (*_fn)(void *arg), void *_arg, int _core) override
     {
         fn = _fn;
         arg = _arg;
         int err = pthread_create(& thread, 0, wrap, this);
         ASSERT(err == 0);
+
+        if (_core >= 0)
+        {
+            // pin to a cpu, if there is one
+            cpu_set_t cpus;
+            CPU_ZERO(& cpus);
+            CPU_SET(size_t(_core), & cpus);
+            if (pthread_setaffinity_np(thread, sizeof(cpus), & cpus) == 0)
+            {
+                core = _core;
+            }
+        }
     }
 
     virtual void join() override
@@ -93,6 +107,11 @@ public:
     {
         return name;
     }
+
+    virtual int get_core() override
+    {
+        return core;
+    }
 };
 
 NativeThread::Threads NativeThread::threads(NativeThread::get_next);
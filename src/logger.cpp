@@ -1,10 +1,19 @@
 
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <new>
+
 #include "panglos/debug.h"
 
 #include "panglos/arch.h"
 #include "panglos/io.h"
+#include "panglos/mutex.h"
+#include "panglos/semaphore.h"
+#include "panglos/thread.h"
+#include "panglos/time.h"
 
 #include "panglos/logger.h"
 
@@ -25,18 +34,24 @@ const char *lut(const LUT *codes, int err)
     return "unknown";
 }
 
-int rlut(const LUT *lut, const char *s)
+const LUT *lut_find(const LUT *lut, const char *s)
 {
     for (; lut->text; lut++)
     {
         if (!strcmp(lut->text, s))
         {
-            return lut->code;
+            return lut;
         }
     }
     return 0;
 }
 
+int rlut(const LUT *lut, const char *s)
+{
+    const LUT *code = lut_find(lut, s);
+    return code ? code->code : 0;
+}
+
     /*
      *
      */
@@ -73,6 +88,604 @@ int Logging::Logger::match_out(struct Logging::Logger *logger, void *arg)
     return logger->out == out;
 }
 
+    /*
+     *  Render a message into a bounded buffer.
+     *
+     *  Returns the untruncated length, so the caller can tell if it fitted.
+     */
+
+static int format(char *buff, int size, int *len, const char *fmt, va_list ap)
+{
+    CharOut out(buff, size);
+    FmtOut formatter(& out, 0);
+    const int n = formatter.printf(fmt, ap);
+    *len = out.get_idx();
+    return n;
+}
+
+    /*
+     *  Binary (PO_TRACE) records : the caller's time, task and raw arg words.
+     */
+
+struct Logging::Trace
+{
+    uint32_t time;
+    char task[12];
+    int nargs;
+    uint64_t words[TRACE_ARGS];
+
+    static size_t size(int nargs)
+    {
+        return offsetof(Trace, words) + (sizeof(uint64_t) * size_t(nargs));
+    }
+
+    void init(const uint64_t *_words, int _nargs)
+    {
+        time = get_time();
+        strncpy(task, get_task(), sizeof(task) - 1);
+        task[sizeof(task) - 1] = '\0';
+        nargs = _nargs;
+        memcpy(words, _words, sizeof(uint64_t) * size_t(nargs));
+    }
+};
+
+    // digits of v, written backwards to end. Returns the start
+
+static char *int_text(char *end, long long v, bool is_signed, unsigned base)
+{
+    const bool neg = is_signed && (v < 0);
+    unsigned long long u = neg ? (0ull - (unsigned long long) v) : (unsigned long long) v;
+    char *p = end;
+    do {
+        const unsigned d = unsigned(u % base);
+        *--p = char((d < 10) ? ('0' + d) : ('a' + d - 10));
+        u /= base;
+    } while (u);
+    if (neg)
+    {
+        *--p = '-';
+    }
+    return p;
+}
+
+    /*
+     *  Format a single conversion spec, eg "%-08lx", with its arg word.
+     *
+     *  Integer args are widened to long long, after being cut to the
+     *  size the spec asks for. Plain %d %i %u %x, the common case,
+     *  skip printf and are written straight to out.
+     */
+
+static void render_arg(FmtOut *formatter, Out *out, const char *spec, int len, int longs, uint64_t w)
+{
+    const char conv = spec[len-1];
+    char f[16];
+    if (len > int(sizeof(f) - 3))
+    {
+        formatter->printf("%s", spec);
+        return;
+    }
+
+    switch (conv)
+    {
+        case 'd' :
+        case 'i' :
+        case 'u' :
+        case 'x' :
+        case 'X' :
+        case 'o' :
+        {
+            // replace the length modifiers with "ll"
+            int j = 0;
+            for (int i = 0; i < (len - 1); i++)
+            {
+                if (!strchr("hlzjtL", spec[i]))
+                {
+                    f[j++] = spec[i];
+                }
+            }
+            f[j++] = 'l';
+            f[j++] = 'l';
+            f[j++] = conv;
+            f[j] = '\0';
+
+            const bool is_signed = (conv == 'd') || (conv == 'i');
+            long long v;
+            if (longs == 0)
+            {
+                v = is_signed ? (long long) int(w) : (long long) unsigned(w);
+            }
+            else if (longs == 1)
+            {
+                v = is_signed ? (long long) long(w) : (long long) (unsigned long)(w);
+            }
+            else
+            {
+                v = (long long) w;
+            }
+
+            // no flags, width or precision : f is "%ll" conv
+            if ((j == 4) && (conv != 'X') && (conv != 'o'))
+            {
+                char text[24];
+                char *end = & text[sizeof(text)];
+                const char *start = int_text(end, v, is_signed, (conv == 'x') ? 16 : 10);
+                out->tx(start, int(end - start));
+                break;
+            }
+            formatter->printf(f, v);
+            break;
+        }
+        case 'c' :
+        {
+            memcpy(f, spec, size_t(len));
+            f[len] = '\0';
+            formatter->printf(f, int(w));
+            break;
+        }
+        case 's' :
+        {
+            memcpy(f, spec, size_t(len));
+            f[len] = '\0';
+            const char *str = (const char*) uintptr_t(w);
+            formatter->printf(f, str ? str : "(null)");
+            break;
+        }
+        case 'p' :
+        {
+            memcpy(f, spec, size_t(len));
+            f[len] = '\0';
+            formatter->printf(f, (void*) uintptr_t(w));
+            break;
+        }
+        case 'f' :
+        case 'F' :
+        case 'e' :
+        case 'E' :
+        case 'g' :
+        case 'G' :
+        {
+            memcpy(f, spec, size_t(len));
+            f[len] = '\0';
+            double d;
+            memcpy(& d, & w, sizeof(d));
+            formatter->printf(f, d);
+            break;
+        }
+        default :
+        {
+            // unsupported : show the spec
+            formatter->printf("%.*s", len, spec);
+            break;
+        }
+    }
+}
+
+static int render(char *buff, int size, const Logging::Site *site, const struct Logging::Trace *trace)
+{
+    CharOut out(buff, size);
+    // literal text is written straight to the buffer
+    Out *raw = & out;
+    // stage printf output, so it reaches the buffer in runs, not a char at a time
+    char stage[32];
+    FmtOut formatter(& out, 0, stage, sizeof(stage));
+
+    // the prefix, as _PO_PRINT() has it : "time task SEVERITY file +line fn() : "
+    char num[24];
+    char *end = & num[sizeof(num)];
+    const char *start = int_text(end, int(trace->time), true, 10);
+    raw->tx(start, int(end - start));
+    const char *parts[] = { " ", trace->task, " ", lut(Severity_lut, site->severity), " ", site->file, " +", };
+    for (const char *part : parts)
+    {
+        raw->tx(part, int(strlen(part)));
+    }
+    start = int_text(end, site->line, true, 10);
+    raw->tx(start, int(end - start));
+    raw->tx(" ", 1);
+    raw->tx(site->function, int(strlen(site->function)));
+    raw->tx("() : ", 5);
+
+    int arg = 0;
+    const char *fmt = site->fmt;
+    while (*fmt)
+    {
+        const char *pc = strchr(fmt, '%');
+        if (!pc)
+        {
+            raw->tx(fmt, int(strlen(fmt)));
+            break;
+        }
+        if (pc > fmt)
+        {
+            raw->tx(fmt, int(pc - fmt));
+        }
+
+        // parse the spec : %[flags][width][.precision][length]conv
+        const char *s = pc + 1;
+        if (*s == '%')
+        {
+            raw->tx(s, 1);
+            fmt = s + 1;
+            continue;
+        }
+        s += strspn(s, "-+ #0");
+        s += strspn(s, "0123456789");
+        if (*s == '.')
+        {
+            s += 1;
+            s += strspn(s, "0123456789");
+        }
+        int longs = 0;
+        for (; *s && strchr("hlzjtL", *s); s++)
+        {
+            longs += (*s != 'h') ? 1 : 0;
+        }
+        if (!*s)
+        {
+            raw->tx(pc, int(strlen(pc)));
+            break;
+        }
+        // 'z', 'j' and 't' are full width
+        if (longs && strchr("zjt", s[-1]))
+        {
+            longs = 2;
+        }
+
+        const uint64_t w = (arg < trace->nargs) ? trace->words[arg] : 0;
+        arg += 1;
+        render_arg(& formatter, raw, pc, int(s + 1 - pc), longs, w);
+        fmt = s + 1;
+    }
+
+    return out.get_idx();
+}
+
+    /*
+     *  Bounded MPSC ring of formatted records.
+     *
+     *  Each slot has a sequence number : producers claim a slot with a CAS
+     *  on head, format into it, then publish it by advancing its sequence.
+     *  The drain thread is the only consumer.
+     */
+
+class Logging::Async
+{
+    struct Record
+    {
+        std::atomic<uint32_t> seq;
+        Severity severity;
+        int len;
+        // set for binary records : data holds a Trace
+        const Site *site;
+        alignas(uint64_t) char data[];
+    };
+
+    Logging *logging;
+    uint8_t *block;
+    uint32_t nrecords;
+    int record_size;
+    size_t stride;
+    Overflow overflow;
+
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<int> dropped;
+
+    Semaphore *wake;
+    std::atomic<bool> sleeping;
+    // producers waiting for space (BLOCK)
+    Semaphore *space;
+    std::atomic<int> waiters;
+    // flush() : posted when tail reaches flush_to
+    Mutex *flush_mutex;
+    Semaphore *flushed;
+    std::atomic<uint32_t> flush_to;
+    std::atomic<bool> flushing;
+
+    std::atomic<bool> dead;
+    Thread *thread;
+
+    Record *at(uint32_t pos)
+    {
+        return (Record*) & block[(pos & (nrecords - 1)) * stride];
+    }
+
+    void wakeup()
+    {
+        if (sleeping.load() && sleeping.exchange(false))
+        {
+            wake->post();
+        }
+    }
+
+    bool empty()
+    {
+        const uint32_t t = tail.load();
+        return at(t)->seq.load(std::memory_order_acquire) != (t + 1);
+    }
+
+    bool drain_one()
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        Record *r = at(t);
+        if (r->seq.load(std::memory_order_acquire) != (t + 1))
+        {
+            return false;
+        }
+
+        if (r->site)
+        {
+            char line[LINE_SIZE];
+            const int n = render(line, sizeof(line), r->site, (const struct Trace*) r->data);
+            logging->write(r->severity, line, n);
+        }
+        else
+        {
+            logging->write(r->severity, r->data, r->len);
+        }
+
+        // free the slot
+        r->seq.store(t + nrecords, std::memory_order_release);
+        tail.store(t + 1);
+
+        if (waiters.load())
+        {
+            space->post();
+        }
+        if (flushing.load() && (int32_t((t + 1) - flush_to.load()) >= 0) && flushing.exchange(false))
+        {
+            flushed->post();
+        }
+        return true;
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            if (drain_one())
+            {
+                continue;
+            }
+            if (dead)
+            {
+                break;
+            }
+            sleeping = true;
+            if (!empty() || dead)
+            {
+                sleeping = false;
+                continue;
+            }
+            wake->wait();
+        }
+    }
+
+    static void run(void *arg)
+    {
+        ASSERT(arg);
+        Async *async = (Async*) arg;
+        async->run();
+    }
+
+public:
+    Async(Logging *_logging, int records, int size, Overflow _overflow)
+    :   logging(_logging),
+        block(0),
+        nrecords(1),
+        record_size(size),
+        stride(0),
+        overflow(_overflow),
+        head(0),
+        tail(0),
+        dropped(0),
+        wake(0),
+        sleeping(false),
+        space(0),
+        waiters(0),
+        flush_mutex(0),
+        flushed(0),
+        flush_to(0),
+        flushing(false),
+        dead(false),
+        thread(0)
+    {
+        ASSERT(records > 0);
+        ASSERT(record_size > 0);
+        while (nrecords < uint32_t(records))
+        {
+            nrecords *= 2;
+        }
+        // keep the slots aligned, for the Trace words
+        const size_t align = sizeof(uint64_t);
+        stride = (sizeof(Record) + size_t(record_size) + align - 1) & ~(align - 1);
+        block = (uint8_t*) malloc(stride * nrecords);
+        ASSERT(block);
+        for (uint32_t i = 0; i < nrecords; i++)
+        {
+            new (& at(i)->seq) std::atomic<uint32_t>(i);
+        }
+
+        wake = Semaphore::create();
+        space = Semaphore::create();
+        flush_mutex = Mutex::create();
+        flushed = Semaphore::create();
+        thread = Thread::create("log_drain");
+        thread->start(run, this);
+    }
+
+    ~Async()
+    {
+        // drain anything left, then stop
+        dead = true;
+        wake->post();
+        thread->join();
+        delete thread;
+        delete flushed;
+        delete flush_mutex;
+        delete space;
+        delete wake;
+        free(block);
+    }
+
+    // claim a free slot, or return 0 if it was dropped
+    Record *claim(uint32_t *claimed)
+    {
+        uint32_t pos = head.load(std::memory_order_relaxed);
+        Record *r = 0;
+
+        while (true)
+        {
+            r = at(pos);
+            const uint32_t seq = r->seq.load(std::memory_order_acquire);
+            const int32_t diff = int32_t(seq - pos);
+
+            if (diff == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (diff > 0)
+            {
+                // another producer took the slot
+                pos = head.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            // full. A sink logging on the drain thread can't wait for it to make space
+            if ((overflow == DROP) || (Thread::get_current() == thread))
+            {
+                dropped += 1;
+                return 0;
+            }
+
+            waiters += 1;
+            if (int32_t(at(pos)->seq.load() - pos) < 0)
+            {
+                wakeup();
+                space->wait();
+            }
+            waiters -= 1;
+            pos = head.load(std::memory_order_relaxed);
+        }
+
+        *claimed = pos;
+        return r;
+    }
+
+    void publish(Record *r, uint32_t pos)
+    {
+        r->seq.store(pos + 1, std::memory_order_release);
+        wakeup();
+    }
+
+    bool put(Severity s, const char *fmt, va_list ap)
+    {
+        uint32_t pos;
+        Record *r = claim(& pos);
+        if (!r)
+        {
+            return false;
+        }
+
+        // format once, on the caller's thread
+        format(r->data, record_size, & r->len, fmt, ap);
+        r->severity = s;
+        r->site = 0;
+
+        publish(r, pos);
+        return true;
+    }
+
+    bool put(const Site *site, const uint64_t *words, int nargs)
+    {
+        uint32_t pos;
+        Record *r = claim(& pos);
+        if (!r)
+        {
+            return false;
+        }
+
+        r->severity = site->severity;
+
+        const size_t size = Trace::size(nargs);
+        if (size <= size_t(record_size))
+        {
+            // capture straight into the slot
+            ((struct Trace*) r->data)->init(words, nargs);
+            r->len = int(size);
+            r->site = site;
+        }
+        else
+        {
+            // too big for a record : format it as text
+            struct Trace trace;
+            trace.init(words, nargs);
+            r->len = render(r->data, record_size, site, & trace);
+            r->site = 0;
+        }
+
+        publish(r, pos);
+        return true;
+    }
+
+    // wait for the drain thread to write everything up to pos
+    void flush_to_pos(uint32_t pos)
+    {
+        flush_to = pos;
+        flushing = true;
+
+        if (int32_t(tail.load() - pos) >= 0)
+        {
+            // already there : unless drain_one() took the flag and posted
+            if (flushing.exchange(false))
+            {
+                return;
+            }
+        }
+        else
+        {
+            wakeup();
+        }
+        flushed->wait();
+    }
+
+    // wait until the ring is empty
+    void flush()
+    {
+        // a sink flushing on the drain thread would wait on itself.
+        // The records behind it are written once it returns.
+        if (Thread::get_current() == thread)
+        {
+            return;
+        }
+
+        Lock lock(flush_mutex);
+        // the sinks may log more as they write
+        uint32_t pos = head.load();
+        while (true)
+        {
+            flush_to_pos(pos);
+            const uint32_t now = head.load();
+            if (now == pos)
+            {
+                break;
+            }
+            pos = now;
+        }
+    }
+
+    int get_dropped()
+    {
+        return dropped;
+    }
+};
+
     /*
      *
      */
@@ -81,12 +694,19 @@ Logging::Logging(Severity s, Mutex *_mutex)
 :   severity(s),
     loggers(Logger::get_next),
     irq_logger(0),
-    mutex(_mutex)
+    mutex(_mutex),
+    async(0),
+    async_users(0),
+    stopping(false),
+    idle(0)
 {
 }
 
 Logging::~Logging()
 {
+    stop_async();
+    delete idle;
+
     while (loggers.head)
     {
         struct Logger *logger = loggers.pop(0);
@@ -158,6 +778,28 @@ void Logging::log(Severity s, const char *fmt, va_list ap)
         return;
     }
 
+    if (Async *a = acquire_async())
+    {
+        a->put(s, fmt, ap);
+        release_async();
+        return;
+    }
+
+    // format once, outside the lock, then hand the same bytes to each sink
+    char line[LINE_SIZE];
+    int len = 0;
+    va_list copy;
+    va_copy(copy, ap);
+    const int n = format(line, sizeof(line), & len, fmt, copy);
+    va_end(copy);
+
+    if (n <= len)
+    {
+        write(s, line, len);
+        return;
+    }
+
+    // too long for the line buffer : stream it to each sink
     Lock lock(mutex);
 
     for (struct Logger *logger = loggers.head; logger; logger = logger->next)
@@ -169,9 +811,147 @@ void Logging::log(Severity s, const char *fmt, va_list ap)
 
         Lock lock(logger->mutex);
 
-        FmtOut formatter(logger->out, 0);
-        formatter.printf(fmt, ap);
+        // each pass consumes the va_list, so work on a copy
+        va_copy(copy, ap);
+        FmtOut formatter(logger->out, 0, line, sizeof(line));
+        formatter.printf(fmt, copy);
+        va_end(copy);
+    }
+}
+
+    /*
+     *  Binary logging
+     */
+
+void Logging::trace(const Site *site, const uint64_t *words, int nargs)
+{
+    ASSERT(nargs <= TRACE_ARGS);
+
+    if (!arch_in_irq())
+    {
+        if (Async *a = acquire_async())
+        {
+            a->put(site, words, nargs);
+            release_async();
+            return;
+        }
+    }
+
+    // no drain thread : format it now
+    struct Trace trace;
+    trace.init(words, nargs);
+    char line[LINE_SIZE];
+    const int n = render(line, sizeof(line), site, & trace);
+
+    if (arch_in_irq())
+    {
+        if (irq_logger && (site->severity <= irq_logger->severity))
+        {
+            irq_logger->out->tx(line, n);
+        }
+        return;
+    }
+
+    write(site->severity, line, n);
+}
+
+    // write a formatted record to the sinks
+
+void Logging::write(Severity s, const char *data, int n)
+{
+    Lock lock(mutex);
+
+    for (struct Logger *logger = loggers.head; logger; logger = logger->next)
+    {
+        if (s > logger->severity)
+        {
+            continue;
+        }
+
+        Lock lock(logger->mutex);
+        logger->out->tx(data, n);
+    }
+}
+
+    /*
+     *  Async mode
+     */
+
+    // count the caller in before reading async, so stop_async() can't delete it under us
+
+Logging::Async *Logging::acquire_async()
+{
+    async_users += 1;
+    Async *a = async.load();
+    if (!a)
+    {
+        release_async();
+    }
+    return a;
+}
+
+void Logging::release_async()
+{
+    // the last one out wakes a pending stop_async()
+    if ((async_users.fetch_sub(1) == 1) && stopping.load() && stopping.exchange(false))
+    {
+        idle->post();
+    }
+}
+
+void Logging::start_async(int records, int record_size, Overflow overflow)
+{
+    ASSERT(!async.load());
+    if (!idle)
+    {
+        idle = Semaphore::create();
+    }
+    async = new Async(this, records, record_size, overflow);
+}
+
+void Logging::stop_async()
+{
+    // new records are written synchronously
+    Async *a = async.exchange(0);
+    if (!a)
+    {
+        return;
+    }
+
+    // wait for any callers still putting records. The drain thread is
+    // still running, so BLOCK mode callers get their space.
+    // Count ourselves in, so no release_async() can see 0 before stopping is set.
+    async_users += 1;
+    stopping = true;
+    if (async_users.fetch_sub(1) == 1)
+    {
+        stopping = false;
+    }
+    else
+    {
+        idle->wait();
+    }
+    delete a;
+}
+
+void Logging::flush()
+{
+    if (Async *a = acquire_async())
+    {
+        a->flush();
+        release_async();
+    }
+}
+
+int Logging::get_dropped()
+{
+    int n = 0;
+    if (Async *a = acquire_async())
+    {
+        n = a->get_dropped();
+        release_async();
     }
+    return n;
 }
 
     /*
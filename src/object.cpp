@@ -1,10 +1,16 @@
 
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+
 #include "panglos/debug.h"
 
 #include "panglos/mutex.h"
+#include "panglos/hash.h"
 #include "panglos/list.h"
+#include "panglos/pool.h"
 
 #include "panglos/object.h"
 
@@ -14,7 +20,7 @@ namespace panglos {
      *  List of objects
      */
 
-struct Object
+struct Object : public Pooled
 {
     struct Object *next;
     const char *name;
@@ -101,43 +107,305 @@ public:
         delete item;
         return ok;
     }
+
+    struct VisitArg
+    {
+        Objects::visitor fn;
+        void *arg;
+    };
+
+    static int obj_visitor(Object *obj, void *arg)
+    {
+        ASSERT(arg);
+        struct VisitArg *va = (struct VisitArg*) arg;
+        va->fn(obj->name, obj->obj, va->arg);
+        return 0;
+    }
+
+    virtual void _visit(visitor fn, void *arg) override
+    {
+        struct VisitArg va = { .fn = fn, .arg = arg, };
+        objects.visit(obj_visitor, & va, 0);
+    }
 };
 
     /*
+     *  Hash table of objects.
+     *
+     *  Open addressing with linear probing. The names are copied (interned)
+     *  into the entries, so the caller's strings need not persist.
      *
+     *  get() takes no lock : entries are immutable once published,
+     *  and removed entries / outgrown tables are only freed by the destructor,
+     *  so a reader can never see freed memory. The table is intended for
+     *  registries that are built at startup and are then mostly read.
      */
 
-struct VisitArg
+struct HashEntry
 {
-    Objects::visitor fn;
-    void *arg;
+    struct HashEntry *next; // retired list
+    uint32_t hash;
+    void *obj;
+    char name[];
+
+    static HashEntry *create(const char *name, uint32_t hash, void *obj)
+    {
+        const size_t len = strlen(name) + 1;
+        HashEntry *entry = (HashEntry*) malloc(sizeof(HashEntry) + len);
+        ASSERT(entry);
+        entry->next = 0;
+        entry->hash = hash;
+        entry->obj = obj;
+        memcpy(entry->name, name, len);
+        return entry;
+    }
 };
 
-static int obj_visitor(Object *obj, void *arg)
+struct HashTable
 {
-    ASSERT(arg);
-    struct VisitArg *va = (struct VisitArg*) arg;
-    va->fn(obj->name, obj->obj, va->arg);
-    return 0;
-}
+    struct HashTable *next; // retired list
+    uint32_t mask;
+    std::atomic<HashEntry*> *slots;
+
+    HashTable(uint32_t size)
+    :   next(0),
+        mask(size - 1),
+        slots(0)
+    {
+        // size must be a power of 2
+        ASSERT((size & mask) == 0);
+        slots = new std::atomic<HashEntry*>[size];
+        for (uint32_t i = 0; i < size; i++)
+        {
+            slots[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~HashTable()
+    {
+        delete[] slots;
+    }
+};
+
+class HashObjects : public Objects
+{
+    Mutex *mutex;
+    bool verbose;
+    std::atomic<HashTable*> table;
+    // used + deleted slots in the current table
+    uint32_t used;
+    uint32_t count;
+    HashTable *old_tables;
+    HashEntry *old_entries;
+    // marks a removed entry, so probing continues past it
+    HashEntry deleted;
+
+    static uint32_t hash_fn(const char *name)
+    {
+        return fnv1a(name);
+    }
+
+    std::atomic<HashEntry*> *find_slot(HashTable *t, const char *name, uint32_t hash)
+    {
+        for (uint32_t i = hash; ; i++)
+        {
+            std::atomic<HashEntry*> *slot = & t->slots[i & t->mask];
+            HashEntry *entry = slot->load(std::memory_order_acquire);
+            if (!entry)
+            {
+                return 0;
+            }
+            if ((entry != & deleted) && (entry->hash == hash) && !strcmp(entry->name, name))
+            {
+                return slot;
+            }
+        }
+    }
+
+    // call with the mutex held
+    void insert(HashTable *t, HashEntry *entry)
+    {
+        for (uint32_t i = entry->hash; ; i++)
+        {
+            std::atomic<HashEntry*> *slot = & t->slots[i & t->mask];
+            if (!slot->load(std::memory_order_relaxed))
+            {
+                slot->store(entry, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // call with the mutex held
+    void retire(HashEntry *entry)
+    {
+        entry->next = old_entries;
+        old_entries = entry;
+    }
+
+    // call with the mutex held : keep the load (including deleted) <= 1/2
+    void grow()
+    {
+        HashTable *t = table.load(std::memory_order_relaxed);
+        const uint32_t size = t->mask + 1;
+        if ((2 * (used + 1)) <= size)
+        {
+            return;
+        }
+
+        // rehash, dropping the deleted markers
+        const uint32_t new_size = ((2 * (count + 1)) > (size / 2)) ? (size * 2) : size;
+        HashTable *nt = new HashTable(new_size);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            HashEntry *entry = t->slots[i].load(std::memory_order_relaxed);
+            if (entry && (entry != & deleted))
+            {
+                insert(nt, entry);
+            }
+        }
+        used = count;
+        table.store(nt, std::memory_order_release);
+
+        // readers may still be using the old table
+        t->next = old_tables;
+        old_tables = t;
+    }
+
+public:
+    HashObjects(bool _verbose)
+    :   mutex(0),
+        verbose(_verbose),
+        table(0),
+        used(0),
+        count(0),
+        old_tables(0),
+        old_entries(0)
+    {
+        mutex = Mutex::create();
+        table = new HashTable(16);
+    }
+
+    ~HashObjects()
+    {
+        HashTable *t = table;
+        for (uint32_t i = 0; i <= t->mask; i++)
+        {
+            HashEntry *entry = t->slots[i];
+            if (entry && (entry != & deleted))
+            {
+                free(entry);
+            }
+        }
+        delete t;
+
+        while (old_entries)
+        {
+            HashEntry *entry = old_entries;
+            old_entries = entry->next;
+            free(entry);
+        }
+        while (old_tables)
+        {
+            t = old_tables;
+            old_tables = t->next;
+            delete t;
+        }
+
+        delete mutex;
+    }
+
+    virtual void add(const char *name, void *obj) override
+    {
+        if (verbose) PO_DEBUG("name=%s obj=%p", name, obj);
+        ASSERT(name);
+        const uint32_t hash = hash_fn(name);
+        HashEntry *entry = HashEntry::create(name, hash, obj);
+
+        Lock lock(mutex);
+
+        // replace any existing entry of the same name
+        std::atomic<HashEntry*> *slot = find_slot(table, name, hash);
+        if (slot)
+        {
+            retire(slot->exchange(entry, std::memory_order_acq_rel));
+            return;
+        }
+
+        grow();
+        insert(table, entry);
+        used += 1;
+        count += 1;
+    }
+
+    virtual void *get(const char *name) override
+    {
+        ASSERT(name);
+        HashTable *t = table.load(std::memory_order_acquire);
+        std::atomic<HashEntry*> *slot = find_slot(t, name, hash_fn(name));
+        if (!slot)
+        {
+            return 0;
+        }
+        HashEntry *entry = slot->load(std::memory_order_acquire);
+        // may have been removed since find_slot()
+        return (entry == & deleted) ? 0 : entry->obj;
+    }
+
+    virtual bool remove(const char *name) override
+    {
+        if (verbose) PO_DEBUG("name=%s", name);
+        ASSERT(name);
+        Lock lock(mutex);
+
+        std::atomic<HashEntry*> *slot = find_slot(table, name, hash_fn(name));
+        if (!slot)
+        {
+            return false;
+        }
+        retire(slot->exchange(& deleted, std::memory_order_acq_rel));
+        count -= 1;
+        return true;
+    }
+
+    virtual void _visit(visitor fn, void *arg) override
+    {
+        HashTable *t = table.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i <= t->mask; i++)
+        {
+            HashEntry *entry = t->slots[i];
+            if (entry && (entry != & deleted))
+            {
+                fn(entry->name, entry->obj, arg);
+            }
+        }
+    }
+};
+
+    /*
+     *
+     */
 
 void Objects::visit(Objects *objects, visitor fn, void *arg)
 {
     ASSERT(objects);
-    Objects_ *objs = (Objects_ *) objects;
     ASSERT(fn);
-
-    struct VisitArg va = { .fn = fn, .arg = arg, };
-    objs->objects.visit(obj_visitor, & va, 0);
+    objects->_visit(fn, arg);
 }
 
     /*
      *  Factory Method
      */
 
-Objects *Objects::create(bool verbose)
+Objects *Objects::create(bool verbose, Type type)
 {
-    return new Objects_(verbose);
+    switch (type)
+    {
+        case LIST : return new Objects_(verbose);
+        case HASH : return new HashObjects(verbose);
+        default : ASSERT(0);
+    }
+    return 0;
 }
 
 Objects *Objects::objects = 0;
@@ -6,6 +6,7 @@
 #pragma once 
 
 #include "panglos/drivers/uart.h"
+#include "panglos/pool.h"
 
 namespace panglos {
 
@@ -70,32 +71,63 @@ public:
         }   u64;
     }   payload;
 
-    // Wrap a standard Queue
+    // Queue with priority lanes, see set_priority()
     class Queue {
     public:
         virtual ~Queue() { }
     };
 
-    static Queue *create_queue(int num, Mutex *mutex);
+    // holds up to num events in all. The queue does its own locking : mutex is ignored
+    static Queue *create_queue(int num, Mutex *mutex=0);
     bool get(Queue *queue, int timeout);
     bool put(Queue *queue);
     int queued(Queue *queue);
     void stop(Queue *queue);
 
+    // In-place access to Events stored in the queue, see Queue::reserve() etc.
+    static Event *reserve(Queue *queue);
+    static void commit(Queue *queue, Event *event);
+    static Event *peek(Queue *queue, int timeout);
+    static void release(Queue *queue, Event *event);
+
+    // get() returns the highest priority event first, FIFO within a priority.
+    // If coalesce is set, put() replaces an event of the same type that is
+    // still queued, rather than adding another.
+    // Defaults : STOP, KEY, INIT are HIGH. DISPLAY, DATE_TIME, LOCATION are
+    // LOW and coalesce. Others are NORMAL.
+    enum Priority { HIGH, NORMAL, LOW, PRIORITIES };
+    static void set_priority(Queue *queue, enum Type type, enum Priority priority, bool coalesce=false);
+
+    struct Stats {
+        int queued[PRIORITIES];
+        int max_queued[PRIORITIES];
+        int coalesced;
+        // put() from an interrupt handler when full
+        int dropped;
+    };
+    static void get_stats(Queue *queue, Stats *stats);
+
     static const LUT type_lut[];
 };
 
     /*
-     *  Linked list of event handlers
+     *  Event handlers, indexed by Event::Type
+     *
+     *  Each type has its own array of handlers, so dispatch only visits the
+     *  handlers for that type. Registration copies the affected array and
+     *  swaps in a new table, so handle_event() takes no lock and can run
+     *  concurrently with add / del. Replaced tables and deleted handlers
+     *  are freed once no dispatch is in progress : by the writer, or by
+     *  the last handle_event() to finish if the mutex is free.
      */
 
-struct EventHandler
+struct EventHandler : public Pooled
 {
     enum Event::Type type;
     bool (*fn)(void *arg, Event *event, Event::Queue *q);
     void *arg;
+    // links deleted handlers until they can be freed
     struct EventHandler *next;
-    static struct EventHandler **get_next(struct EventHandler *d) { return & d->next; }
  
     static void add_handler(enum Event::Type type, bool (*fn)(void *arg, Event *event, Event::Queue *q), void *arg);
     static bool del_handler(struct EventHandler *eh);
@@ -1,7 +1,9 @@
-
 #pragma once
 
-#include "panglos/queue.h"
+#include <atomic>
+
+#include "panglos/time.h"
+#include "panglos/pool.h"
 
     /*
      *
@@ -10,15 +12,17 @@
 namespace panglos {
 
 class Thread;
+class ThreadPool;
+class Mutex;
 class Semaphore;
 
 class BatchTask
 {
-    panglos::Thread *thread;
 public:
     class Job
     {
     public:
+        virtual ~Job() { }
         virtual void run() = 0;
     };
 
@@ -32,20 +36,105 @@ public:
         void wait();
     };
 
-private:
-    panglos::Queue *queue;
+    // Jobs are taken HIGH first, FIFO within a priority.
+    enum Priority { HIGH, NORMAL, LOW, PRIORITIES };
+
+    enum State { QUEUED, RUNNING, DONE, CANCELLED };
+
+        /*
+         *  Completion handle, returned by submit().
+         *
+         *  The Job isn't used once run() returns, so it can delete itself,
+         *  or wake a waiter that frees it. The Handle holds the state,
+         *  and must be released by the caller.
+         */
+
+    class Handle : public Pooled
+    {
+        friend class BatchTask;
+
+        BatchTask *batch;
+        Job *job;
+        Handle *next;
+        Priority priority;
+        std::atomic<int> state;
+        std::atomic<int> refs;
+        // called on completion / cancel
+        void (*then_fn)(void *arg, State state);
+        void *then_arg;
+        Semaphore *semaphore;
+        int waiters;
+        Time::tick_t queued_at;
 
-    void run();
+        Handle(BatchTask *b, Job *j, Priority p);
+        ~Handle();
+
+    public:
+        State get_state() { return State(state.load()); }
+        // true if done or cancelled
+        bool poll();
+        void wait();
+        // fn is called from the worker when the job is done, or from
+        // cancel(). If it has already completed, it is called now.
+        void then(void (*fn)(void *arg, State state), void *arg);
+        // remove the job if it hasn't started. Returns true if cancelled.
+        bool cancel();
+        void release();
+    };
+
+    struct Stats {
+        int run;
+        int cancelled;
+        // in Time ticks
+        Time::tick_t wait_total;
+        Time::tick_t wait_max;
+        Time::tick_t run_total;
+        Time::tick_t run_max;
+    };
+
+private:
+    class Worker;
+
+    ThreadPool *pool;
+    Worker **workers;
+    int count;
+    // workers [0, reserved) only run HIGH priority jobs
+    int reserved;
+    std::atomic<int> started;
+    bool dead;
+    // added to Objects by start()
+    bool registered;
+
+    Mutex *mutex;
+    struct Lane {
+        Handle *head;
+        Handle *tail;
+    }   lanes[PRIORITIES];
+    Stats stats[PRIORITIES];
+
+    static void run_worker(void *arg);
+    void run(Worker *w);
+
+    Handle *_take(Worker *w);
+    void _wake(Priority priority);
+    bool _unlink(Handle *h);
+    void complete(Handle *h, State state);
 
 public:
-    BatchTask(panglos::Thread *t);
+    BatchTask(int workers=1, int reserved=0);
     ~BatchTask();
 
-    static void run(void *);
+    // fire and forget
+    void execute(Job *job, Priority priority=NORMAL);
+    // returns a Handle, which must be released
+    Handle *submit(Job *job, Priority priority=NORMAL);
 
-    void execute(Job *job);
+    void get_stats(Priority priority, Stats *s);
+    int get_workers() { return count; }
 
-    static BatchTask *start();
+    // 'reserved' of the workers only run HIGH priority jobs, so
+    // short urgent jobs are not held up by long ones.
+    static BatchTask *start(int workers=1, int reserved=0);
 };
 
     /*
@@ -3,6 +3,10 @@
 #define __BUFFER_H__
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
 
 #include "debug.h"
 #include "mutex.h"
@@ -10,45 +14,85 @@
 #include "event.h"
 #include "deque.h"
 #include "io.h"
+#include "pool.h"
 
 namespace panglos {
 
+    /*
+     *  Ring of T, with a Semaphore posted as data arrives.
+     *
+     *  The semaphore is only posted when the fill level crosses the high
+     *  watermark (default 1, ie. the buffer stops being empty), not on
+     *  every add(). An optional space semaphore is posted when get() takes
+     *  the level down to the low watermark, for producers waiting for room.
+     *
+     *  T is copied with memcpy().
+     */
+
 template <class T>
 class RingBuffer
 {
     Mutex *mutex;
     Mutex *delete_mutex;
     Semaphore *semaphore;
+    Semaphore *space;
+    int high;
+    int low;
 
     T *data;
     int in, out, size;
 
-    int _add(T c, Mutex *m)
+    int _count()
     {
-        Lock lock(m);
+        return (in >= out) ? (in - out) : (size - out + in);
+    }
 
-        int next = in + 1;
-        if (next >= size)
+    // copy up to n items in, in at most two segments
+    int _add(const T *s, int n)
+    {
+        const int room = size - 1 - _count();
+        if (n > room)
         {
-            next = 0;
+            n = room;
         }
 
-        if (next == out)
+        const int first = (n < (size - in)) ? n : (size - in);
+        memcpy(& data[in], s, sizeof(T) * size_t(first));
+        memcpy(data, & s[first], sizeof(T) * size_t(n - first));
+
+        in += n;
+        if (in >= size)
         {
-            // buffer full
-            return 0;
+            in -= size;
         }
+        return n;
+    }
 
-        data[in] = c;
-        in = next;
+    int _get(T *s, int n)
+    {
+        const int avail = _count();
+        if (n > avail)
+        {
+            n = avail;
+        }
 
-        return 1;
+        const int first = (n < (size - out)) ? n : (size - out);
+        memcpy(s, & data[out], sizeof(T) * size_t(first));
+        memcpy(& s[first], data, sizeof(T) * size_t(n - first));
+
+        out += n;
+        if (out >= size)
+        {
+            out -= size;
+        }
+        return n;
     }
 
 public:
 
     RingBuffer(int _size, Semaphore *s, Mutex *_mutex=0)
-    : mutex(_mutex), delete_mutex(0), semaphore(s), data(0), in(0), out(0), size(_size)
+    :   mutex(_mutex), delete_mutex(0), semaphore(s), space(0), high(1), low(0),
+        data(0), in(0), out(0), size(_size)
     {
         if (!mutex)
         {
@@ -64,6 +108,18 @@ public:
         delete delete_mutex;
     }
 
+    // post the semaphore when there are at least 'high' items to read,
+    // and 'space' when a get() leaves 'low' or fewer.
+    void set_watermarks(int _high, int _low=0, Semaphore *_space=0)
+    {
+        ASSERT((_high > 0) && (_high < size));
+        ASSERT((_low >= 0) && (_low < size));
+        Lock lock(mutex);
+        high = _high;
+        low = _low;
+        space = _space;
+    }
+
     int remain(T **start)
     {
         ASSERT(start);
@@ -88,37 +144,25 @@ public:
 
     int add(T c)
     {
-        const int n = _add(c, mutex);
-
-        if (semaphore)
-        {
-            semaphore->post();
-        }
-
-        return n;
+        return add(& c, 1);
     }
 
     int add(const T *s, int n)
     {
-        Lock lock(mutex);
-        int count = 0;
-
-        for (int i = 0; i < n; i++)
+        bool wake;
         {
-            if (!_add(*s++, 0))
-            {
-                return count;
-            }
-
-            count += 1;
+            Lock lock(mutex);
+            const int before = _count();
+            n = _add(s, n);
+            wake = (before < high) && ((before + n) >= high);
         }
 
-        if (semaphore)
+        if (wake && semaphore)
         {
             semaphore->post();
         }
 
-        return count;
+        return n;
     }
 
     bool empty()
@@ -140,26 +184,25 @@ public:
         return next == out;
     }
 
-    int get(T *s, int n=1)
+    int count()
     {
         Lock lock(mutex);
+        return _count();
+    }
 
-        for (int i = 0; i < n; i++)
+    int get(T *s, int n=1)
+    {
+        bool wake;
         {
-            if (in == out)
-            {
-                return i;
-            }
-
-            int next = out + 1;
-            if (next >= size)
-            {
-                next = 0;
-            }
-
-            *s++ = data[out];
-            out = next;
+            Lock lock(mutex);
+            const int before = _count();
+            n = _get(s, n);
+            wake = (before > low) && ((before - n) <= low);
+        }
 
+        if (wake && space)
+        {
+            space->post();
         }
 
         return n;
@@ -174,7 +217,7 @@ public:
 
     int wait(EventQueue *q, timer_t timeout)
     {
-        if (!empty())
+        if (count() >= high)
         {
             // no need to wait
             return true;
@@ -187,29 +230,99 @@ public:
         return !empty();
     }
 
+    // wait for the level to fall to the low watermark
+    int wait_space(EventQueue *q, timer_t timeout)
+    {
+        ASSERT(space);
+        if (count() <= low)
+        {
+            return true;
+        }
+
+        q->wait(space, d_timer_t(timeout));
+
+        return count() < (size - 1);
+    }
 };
 
     /*
      *
      */
 
-class Buffer {
+class BufferPool;
+
+    /*
+     *  A Buffer is a view (in / out indexes) on a reference counted block.
+     *
+     *  Blocks come from the heap, or from a BufferPool. share() makes a
+     *  second, read-only view of the unread data without copying it.
+     *  Use release() rather than delete for pooled or shared Buffers.
+     */
+
+class Buffer : public Pooled {
+    friend class BufferPool;
+
+    struct Block {
+        // free list link, when in a BufferPool
+        Block *next;
+        std::atomic<int> refs;
+
+        uint8_t *data() { return (uint8_t*) & this[1]; }
+    };
+
     Buffer *next;
     int size;
     int in;
     int out;
     uint8_t *data;
+    Block *block;
+    BufferPool *pool;
+
+    static Block *alloc_block(int size)
+    {
+        Block *b = (Block*) malloc(sizeof(Block) + size_t(size));
+        ASSERT(b);
+        b->next = 0;
+        new (& b->refs) std::atomic<int>(1);
+        return b;
+    }
+
+    void set_block(Block *b, int _size)
+    {
+        block = b;
+        data = b->data();
+        size = _size;
+        in = out = 0;
+        next = 0;
+    }
+
+    // drop the reference to the block. Returns true if it was the last one
+    bool unref()
+    {
+        Block *b = block;
+        block = 0;
+        return b && ((b->refs -= 1) == 0);
+    }
+
+    Buffer(BufferPool *_pool)
+    : next(0), size(0), in(0), out(0), data(0), block(0), pool(_pool)
+    {
+    }
 
 public:
     Buffer(int _size)
-    : next(0), size(_size), in(0), out(0)
+    : next(0), size(0), in(0), out(0), data(0), block(0), pool(0)
     {
-        data = (uint8_t*) malloc((size_t)size);
+        set_block(alloc_block(_size), _size);
     }
 
     ~Buffer()
     {
-        free(data);
+        Block *b = block;
+        if (unref())
+        {
+            free(b);
+        }
     }
 
     uint8_t *buffer()
@@ -235,33 +348,39 @@ public:
         return true;
     }
 
-    int write(const uint8_t *data, int len)
+    int write(const uint8_t *buff, int len)
     {
-        // TODO : use memcpy
-        for (int i = 0; i < len; i++)
+        if (len > (size - in))
         {
-            if (!add(*data++))
-            {
-                return i;
-            }
+            len = size - in;
         }
+        memcpy(& data[in], buff, size_t(len));
+        in += len;
         return len;
     }
 
     int read(uint8_t *buffer, int n)
     {
-        int count = 0;
-        for (int i = out; i < in; i++)
+        n = skip(n);
+        memcpy(buffer, & data[out - n], size_t(n));
+        return n;
+    }
+
+    // the unread data, without copying it
+    const uint8_t *peek()
+    {
+        return & data[out];
+    }
+
+    // mark up to n bytes as read
+    int skip(int n)
+    {
+        if (n > (in - out))
         {
-            *buffer++ = data[i];
-            out += 1;
-            count += 1;
-            if (count >= n)
-            {
-                break;
-            }
+            n = in - out;
         }
-        return count;
+        out += n;
+        return n;
     }
 
     bool full()
@@ -284,6 +403,12 @@ public:
         return in - out;
     }
 
+    // a new view of the unread data, sharing the block
+    inline Buffer *share();
+
+    // return a Buffer to its pool, or delete it
+    static inline void release(Buffer *b);
+
     static Buffer **next_fn(Buffer *b)
     {
         return & b->next;
@@ -291,17 +416,169 @@ public:
 };
 
     /*
+     *  Fixed size blocks, and the Buffers that view them, on free lists.
      *
+     *  Once the pool has grown to the working set there are no more heap
+     *  allocations.
+     */
+
+class BufferPool
+{
+    friend class Buffer;
+
+    int seg_size;
+    Mutex *mutex;
+    Buffer::Block *blocks;
+    Deque<Buffer*> views;
+
+    // heap allocations, for the benchmarks
+    std::atomic<int> allocs;
+
+    Buffer *get_view()
+    {
+        Buffer *b;
+        {
+            Lock lock(mutex);
+            b = views.pop_head(0);
+        }
+        if (!b)
+        {
+            b = new Buffer(this);
+            allocs += 1;
+        }
+        return b;
+    }
+
+    Buffer::Block *get_block()
+    {
+        Buffer::Block *b;
+        {
+            Lock lock(mutex);
+            b = blocks;
+            if (b)
+            {
+                blocks = b->next;
+            }
+        }
+        if (b)
+        {
+            b->refs = 1;
+            return b;
+        }
+        allocs += 1;
+        return Buffer::alloc_block(seg_size);
+    }
+
+    void put(Buffer *b)
+    {
+        Buffer::Block *block = b->block;
+        const bool last = b->unref();
+
+        Lock lock(mutex);
+        if (last)
+        {
+            block->next = blocks;
+            blocks = block;
+        }
+        b->next = 0;
+        views.push_tail(b, 0);
+    }
+
+public:
+    BufferPool(int _seg_size, int prealloc=0)
+    :   seg_size(_seg_size), mutex(0), blocks(0), views(Buffer::next_fn), allocs(0)
+    {
+        mutex = Mutex::create();
+        for (int i = 0; i < prealloc; i++)
+        {
+            Buffer *b = new Buffer(this);
+            b->set_block(Buffer::alloc_block(seg_size), seg_size);
+            allocs += 2;
+            put(b);
+        }
+    }
+
+    ~BufferPool()
+    {
+        // all the Buffers must have been released
+        while (!views.empty(0))
+        {
+            delete views.pop_head(0);
+        }
+        while (blocks)
+        {
+            Buffer::Block *b = blocks;
+            blocks = b->next;
+            free(b);
+        }
+        delete mutex;
+    }
+
+    // an empty Buffer of seg_size bytes
+    Buffer *get()
+    {
+        Buffer *b = get_view();
+        b->set_block(get_block(), seg_size);
+        return b;
+    }
+
+    int get_seg_size() { return seg_size; }
+    int get_allocs() { return allocs; }
+};
+
+inline Buffer *Buffer::share()
+{
+    Buffer *b = pool ? pool->get_view() : new Buffer(pool);
+    block->refs += 1;
+    b->block = block;
+    b->data = data;
+    b->out = out;
+    // read only : it is spent when the current data has been read
+    b->in = b->size = in;
+    b->next = 0;
+    return b;
+}
+
+inline void Buffer::release(Buffer *b)
+{
+    if (b->pool)
+    {
+        b->pool->put(b);
+    }
+    else
+    {
+        delete b;
+    }
+}
+
+    /*
+     *  A queue of Buffers.
+     *
+     *  With a BufferPool, add_buffer() takes segments from the pool.
+     *  get_iov() exports the unread data as an iovec style array, eg. for
+     *  writev() / sendmsg(), and consume() drops what was sent.
      */
 
 class Buffers
 {
     Deque<Buffer*> deque;
     Mutex *mutex;
+    BufferPool *pool;
+
+    Buffer *new_buffer(int size)
+    {
+        if (pool)
+        {
+            ASSERT(size <= pool->get_seg_size());
+            return pool->get();
+        }
+        return new Buffer(size);
+    }
+
 public:
 
-    Buffers()
-    : deque(Buffer::next_fn), mutex(0)
+    Buffers(BufferPool *_pool=0)
+    : deque(Buffer::next_fn), mutex(0), pool(_pool)
     {
         mutex = Mutex::create();
     }
@@ -317,13 +594,13 @@ public:
         while (!deque.empty(mutex))
         {
             Buffer *b = deque.pop_head(0);
-            delete b;
+            Buffer::release(b);
         }
     }
 
     void add_buffer(int size)
     {
-        Buffer *b = new Buffer(size);
+        Buffer *b = new_buffer(size);
         deque.push_tail(b, mutex);
     }
 
@@ -336,8 +613,10 @@ public:
         {
             if (force_add)
             {
-                add_buffer(force_add);
-                return add(c);
+                // already locked
+                b = new_buffer(force_add);
+                deque.push_tail(b, 0);
+                return b->add(c);
             }
             // no buffer allocated
             return false;
@@ -346,6 +625,32 @@ public:
         return b->add(c);
     }
 
+    // returns the number of bytes written.
+    // If force_add is set, new buffers of that size are added as needed.
+    int write(const uint8_t *data, int len, int force_add=0)
+    {
+        Lock lock(mutex);
+        int count = 0;
+
+        while (count < len)
+        {
+            Buffer *b = deque.tail;
+            if (!b || b->full())
+            {
+                if (!force_add)
+                {
+                    break;
+                }
+                deque.push_tail(new_buffer(force_add), 0);
+                continue;
+            }
+
+            count += b->write(& data[count], len - count);
+        }
+
+        return count;
+    }
+
     bool full()
     {
         Lock lock(mutex);
@@ -387,13 +692,95 @@ public:
             if (b->spent())
             {
                 deque.pop_head(0);
-                delete b;
+                Buffer::release(b);
             }
         }
 
         return count;
     }
 
+    // fill up to max iovec style {iov_base, iov_len} entries with the unread data.
+    // Returns the number of entries used.
+    template <class IOV>
+    int get_iov(IOV *iov, int max)
+    {
+        Lock lock(mutex);
+
+        int n = 0;
+        for (Buffer *b = deque.head; b && (n < max); b = *Buffer::next_fn(b))
+        {
+            if (!b->count())
+            {
+                continue;
+            }
+            iov[n].iov_base = (void*) b->peek();
+            iov[n].iov_len = size_t(b->count());
+            n += 1;
+        }
+        return n;
+    }
+
+    // drop n bytes of unread data, eg. after a writev()
+    int consume(int len)
+    {
+        int count = 0;
+
+        Lock lock(mutex);
+
+        while (count < len)
+        {
+            Buffer *b = deque.head;
+            if (!b)
+            {
+                break;
+            }
+
+            const int n = b->skip(len - count);
+            count += n;
+            if (b->spent())
+            {
+                deque.pop_head(0);
+                Buffer::release(b);
+                continue;
+            }
+            if (n == 0)
+            {
+                break;
+            }
+        }
+
+        return count;
+    }
+
+    // append the unread data to another Buffers, sharing the blocks
+    void share(Buffers *dst)
+    {
+        ASSERT(dst && (dst != this));
+        Lock lock(mutex);
+        Lock dst_lock(dst->mutex);
+
+        for (Buffer *b = deque.head; b; b = *Buffer::next_fn(b))
+        {
+            if (b->count())
+            {
+                dst->deque.push_tail(b->share(), 0);
+            }
+        }
+    }
+
+    // unread bytes
+    int count()
+    {
+        Lock lock(mutex);
+
+        int n = 0;
+        for (Buffer *b = deque.head; b; b = *Buffer::next_fn(b))
+        {
+            n += b->count();
+        }
+        return n;
+    }
+
     int get_size()
     {
         Lock lock(mutex);
@@ -416,12 +803,12 @@ class BufferOutput : public Out
     Buffers *buffers;
     int force_size;
 
-    virtual int _putc(char c)
+public:
+    virtual int tx(const char *data, int n) override
     {
-        return buffers->add((uint8_t)c, force_size);
+        return buffers->write((const uint8_t*) data, n, force_size);
     }
 
-public:
     BufferOutput(Buffers *b, int size=0) 
     :   buffers(b), force_size(size)
     { }
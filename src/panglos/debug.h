@@ -40,7 +40,9 @@ typedef struct {
 }   LUT;
 
 const char *lut(const LUT *codes, int err);
+// returns 0 if not found, which may also be a valid code : use lut_find() to tell them apart
 int rlut(const LUT *codes, const char *s);
+const LUT *lut_find(const LUT *codes, const char *s);
 
 void Error_Handler(void);
 uint32_t get_time(void);
@@ -57,12 +59,52 @@ extern const LUT Severity_lut[];
      *
      */
 
+#define _PO_STR(x)      #x
+#define _PO_XSTR(x)     _PO_STR(x)
+
+// severity names, as in Severity_lut[]
+#define _PO_NAME_S_CRITICAL "CRITICAL"
+#define _PO_NAME_S_ERROR    "ERROR"
+#define _PO_NAME_S_WARNING  "WARNING"
+#define _PO_NAME_S_NOTICE   "NOTICE"
+#define _PO_NAME_S_INFO     "INFO"
+#define _PO_NAME_S_DEBUG    "DEBUG"
+
+    /*
+     *  Filtering, done before any of the args are evaluated.
+     *
+     *  Call sites above PO_MIN_SEVERITY are removed by the compiler,
+     *  eg. -DPO_MIN_SEVERITY=S_INFO removes all the PO_DEBUG() calls.
+     *
+     *  Files that declare PO_MODULE() (see panglos/verbose.h) also check
+     *  the module's run-time severity.
+     */
+
+#if !defined(PO_MIN_SEVERITY)
+#define PO_MIN_SEVERITY S_DEBUG
+#endif
+
+static Severity *po_module_severity __attribute__((unused)) = 0;
+
+#define PO_ENABLED(level) \
+        (((level) <= PO_MIN_SEVERITY) && !(po_module_severity && ((level) > *po_module_severity)))
+
+    /*
+     *  The per call site part of the prefix (severity, file, line) is built
+     *  into the format string at compile time. Only the time, task and
+     *  function name are formatted at run time.
+     *
+     *  level must be one of the S_xxx names.
+     */
+
 #define _PO_PRINT(level, fmt, ...) \
-        po_log(level, "%d %s %s %s +%d %s() : " fmt "\r\n", \
-                (int) get_time(), get_task(), \
-                lut(Severity_lut, level), \
-                __FILE__, __LINE__, __FUNCTION__, \
-                ## __VA_ARGS__ );
+        do { \
+            if (PO_ENABLED(level)) \
+                po_log(level, "%d %s " _PO_NAME_ ## level " " __FILE__ " +" _PO_XSTR(__LINE__) " %s() : " fmt "\r\n", \
+                        (int) get_time(), get_task(), \
+                        __FUNCTION__, \
+                        ## __VA_ARGS__ ); \
+        } while (0)
 
 #define PO_DEBUG(fmt, ...)      _PO_PRINT(S_DEBUG, fmt, ## __VA_ARGS__ )
 #define PO_ERROR(fmt, ...)      _PO_PRINT(S_ERROR, fmt, ## __VA_ARGS__ )
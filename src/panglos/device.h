@@ -10,9 +10,6 @@ class Objects;
 
 class Device
 {
-    bool init_device(List<Device *> & done, List<Device *> & todo, bool verbose, int nest);
-    static int match_name(Device *dev, void *arg);
-
 public:
     const char *name;
     const char **needs;
@@ -34,8 +31,15 @@ public:
 
     // List utils
     static Device **get_next(Device *d) { return & d->next; }
+    static int match_name(Device *dev, void *arg);
 
+    // Initialise the todo devices, each after the devices it needs.
+    // Initialised devices are moved to the done list.
+    // 'loops' is no longer used : loops in the needs are reported before any init.
     static bool init_devices(List<Device *> & todo, bool verbose=false, List<Device *> *done=0, int loops=100);
+    // As init_devices(), but devices that don't depend on each other are
+    // initialised concurrently, on a pool of threads. init fns must be thread safe.
+    static bool init_devices_parallel(List<Device *> & todo, int threads, bool verbose=false, List<Device *> *done=0);
     void add(Objects* list, void *obj);
 };
 
@@ -44,15 +44,28 @@ public:
         virtual void execute() { }
     };
 
+    typedef enum {
+        // mutex and semaphore post for every put()
+        LOCKED,
+        // lock-free push, one semaphore post per burst of put()s
+        LOCK_FREE,
+    }   Mode;
+
 private:
 
+    Mode mode;
     Deque<Dispatch::Callback*> deque;
+    // LOCK_FREE : callbacks pushed by put(), most recent first
+    std::atomic<Callback*> inbox;
     Mutex *mutex;
     Semaphore *semaphore;
     std::atomic<bool> dead;
 
+    void execute(Callback *cb);
+    void drain();
+
 public:
-    Dispatch();
+    Dispatch(Mode m=LOCKED);
     ~Dispatch();
 
     /// called from within irq context
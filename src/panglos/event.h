@@ -6,6 +6,7 @@
 
 #include "timer.h"
 #include "list.h"
+#include "heap.h"
 
 namespace panglos {
 
@@ -16,6 +17,7 @@ class Event
 {
 public:
     Event *next;
+    HeapLink<Event*> link;
     Semaphore *semaphore;
     timer_t time;
 public:
@@ -25,6 +27,7 @@ public:
     }
 
     static Event **next_fn(Event *ev) { return & ev->next; }
+    static HeapLink<Event*> *link_fn(Event *ev) { return & ev->link; }
 };
 
     /*
@@ -42,15 +45,26 @@ public:
 
 class EventQueue
 {
+public:
+    typedef enum {
+        // O(n) add/remove, events.head is the next event
+        SORTED_LIST,
+        // O(log n) add/remove, heap.head is the next event
+        HEAP,
+    }   Backend;
+
 private:
     Mutex *mutex;
     Mutex *delete_mutex;
     Rescheduler *rescheduler;
+    Backend backend;
 public:
     List<Event*> events;
+    Heap<Event*> heap;
 
 private:
     Event* _remove(Event *ev, Mutex *mutex);
+    Event* next_event();
 
 public:
     bool add(Event *ev);
@@ -58,7 +72,7 @@ public:
     void reschedule(d_timer_t dt);
     bool waiting(Event *ev);
 public:
-    EventQueue(Rescheduler *r, Mutex *mutex=0);
+    EventQueue(Rescheduler *r, Mutex *mutex=0, Backend b=SORTED_LIST);
     ~EventQueue();
 
     void wait(Semaphore *s, d_timer_t time);
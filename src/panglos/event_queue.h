@@ -3,6 +3,7 @@
 #define __PANGLOS_EVENT_QUEUE__
 
 #include <panglos/list.h>
+#include <panglos/heap.h>
 #include <panglos/time.h>
 #include <panglos/mutex.h>
 
@@ -11,13 +12,24 @@ namespace panglos {
 template <class T>
 class _EvQueue
 {
+public:
+    typedef enum {
+        // O(n) add/del, events.head is the next event
+        SORTED_LIST,
+        // O(log n) add/del, heap.head is the next event
+        HEAP,
+    }   Backend;
+
+private:
     Mutex *mutex;
+    Backend backend;
 
 public:
 
     class Event {
     public:
         Event *next;
+        HeapLink<Event*> link;
         T when;
 
         Event(T t=0) : next(0), when(t) { }
@@ -26,6 +38,7 @@ public:
         virtual void run(_EvQueue *) = 0;
 
         static Event **next_fn(Event *ev) { return & ev->next; }
+        static HeapLink<Event*> *link_fn(Event *ev) { return & ev->link; }
         static int cmp_t(T t1, T t2);
         static int cmp(Event *ev1, Event* ev2)
         {
@@ -34,10 +47,13 @@ public:
     };
 
     List<Event*> events;
+    Heap<Event*> heap;
 
-    _EvQueue(panglos::Mutex *m=0)
+    _EvQueue(panglos::Mutex *m=0, Backend b=SORTED_LIST)
     :   mutex(0),
-        events(Event::next_fn)
+        backend(b),
+        events(Event::next_fn),
+        heap(Event::link_fn, Event::cmp)
     {
         mutex = m ? m : panglos::Mutex::create();
     }
@@ -49,11 +65,20 @@ public:
 
     void add(Event *ev)
     {
+        if (backend == HEAP)
+        {
+            heap.add(ev, mutex);
+            return;
+        }
         events.add_sorted(ev, Event::cmp, mutex);
     }
 
     bool del(Event *ev)
     {
+        if (backend == HEAP)
+        {
+            return heap.remove(ev, mutex);
+        }
         return events.remove(ev, mutex);
     }
 
@@ -67,7 +92,7 @@ public:
     Event *pop(T t)
     {
         panglos::Lock lock(mutex);
-        Event *ev = events.head;
+        Event *ev = (backend == HEAP) ? heap.head : events.head;
 
         if (!ev)
         {
@@ -81,7 +106,7 @@ public:
             return 0;
         }
 
-        return events.pop(0);
+        return (backend == HEAP) ? heap.pop(0) : events.pop(0);
     }
 
     bool run(T t)
@@ -0,0 +1,219 @@
+
+#if !defined(__PANGLOS_EXECUTOR__)
+#define __PANGLOS_EXECUTOR__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "panglos/debug.h"
+
+namespace panglos {
+
+class Mutex;
+class Semaphore;
+class ThreadPool;
+
+    /*
+     *  Chase-Lev work stealing deque.
+     *
+     *  The owner pushes and takes at the bottom (LIFO), any other thread
+     *  can steal from the top (FIFO). No locks are taken. Fixed capacity :
+     *  push() returns false when full.
+     *
+     *  "Correct and Efficient Work-Stealing for Weak Memory Models"
+     *  Lê, Pop, Cohen, Zappa Nardelli. PPoPP 2013
+     */
+
+template<typename T>
+class StealDeque
+{
+    typedef int64_t Idx;
+
+    std::atomic<T> *data;
+    const Idx mask;
+    std::atomic<Idx> top;
+    std::atomic<Idx> bottom;
+
+public:
+    StealDeque(int n)
+    :   data(0),
+        mask(n-1),
+        top(0),
+        bottom(0)
+    {
+        // ASSERT n is >0 and a power of 2
+        ASSERT(n && ((n & (n-1)) == 0));
+        data = new std::atomic<T>[n];
+    }
+
+    ~StealDeque()
+    {
+        delete[] data;
+    }
+
+    // owner only
+    bool push(T item)
+    {
+        const Idx b = bottom.load(std::memory_order_relaxed);
+        const Idx t = top.load(std::memory_order_acquire);
+        if ((b - t) > mask)
+        {
+            return false;
+        }
+        data[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner only. Returns 0 if empty
+    T take()
+    {
+        const Idx b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        Idx t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        T item = data[b & mask].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // last item : race any thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = 0;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread. Returns 0 if empty, or if it lost a race
+    T steal()
+    {
+        Idx t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const Idx b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+            return 0;
+        }
+
+        T item = data[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return 0;
+        }
+        return item;
+    }
+
+    // approximate if called while other threads are active
+    bool empty() const
+    {
+        return bottom.load(std::memory_order_acquire) <= top.load(std::memory_order_acquire);
+    }
+};
+
+    /*
+     *  Count of outstanding tasks. wait() blocks until it reaches zero.
+     *
+     *  done() decrements and posts with the mutex held, and the destructor
+     *  takes the mutex, so a WaitGroup on the waiter's stack can't be
+     *  destroyed while the last done() is still using it.
+     */
+
+class WaitGroup
+{
+    std::atomic<int> count;
+    Mutex *mutex;
+    Semaphore *semaphore;
+
+public:
+    WaitGroup();
+    ~WaitGroup();
+
+    void add(int n=1);
+    void done();
+    void wait();
+    // wait for up to 'ticks'. Returns true if the count is zero
+    bool wait(int ticks);
+
+    int pending() { return count; }
+};
+
+    /*
+     *  Work stealing task executor.
+     *
+     *  Each worker thread has its own StealDeque. Tasks submitted from a
+     *  worker (eg. subtasks) go on its own deque, tasks from any other
+     *  thread go on a shared queue. Idle workers take from their own deque,
+     *  then the shared queue, then steal from the other workers.
+     *
+     *  wait() runs tasks while it waits, so it can be called from a task.
+     */
+
+class Executor
+{
+public:
+    class Worker;
+    struct Task;
+
+private:
+    ThreadPool *pool;
+    Worker **workers;
+    int count;
+    std::atomic<int> started;
+
+    // tasks from non worker threads
+    Mutex *mutex;
+    Task *head;
+    Task *tail;
+    std::atomic<int> queued;
+
+    // idle workers wait here
+    Semaphore *idle;
+    std::atomic<int> sleepers;
+    std::atomic<bool> dead;
+
+    std::atomic<int> steals;
+
+    static void run_worker(void *arg);
+    void worker_loop(Worker *w);
+
+    void put(Task *task);
+    Task *get_shared();
+    Task *find(Worker *w);
+    void run(Task *task);
+    void wake();
+
+public:
+    Executor(const char *name, int workers, size_t stack=0);
+    ~Executor();
+
+    void submit(void (*fn)(void *arg), void *arg, WaitGroup *wg=0);
+
+    // call fn(arg, lo, hi) over [begin, end), in ranges of up to 'grain' indexes.
+    // Returns when all the ranges are done.
+    void parallel_for(int begin, int end, int grain, void (*fn)(void *arg, int lo, int hi), void *arg);
+
+    // run tasks until the WaitGroup is done
+    void wait(WaitGroup *wg);
+
+    int get_workers() { return count; }
+    int get_steals() { return steals; }
+};
+
+}   //  namespace panglos
+
+#endif  //  __PANGLOS_EXECUTOR__
+
+//  FIN
@@ -10,7 +10,9 @@ namespace panglos {
 
 class Queue;
     
-Queue *queue_wrap(QueueHandle_t queue);
+// size is the message size, needed by get_many(), put_many(), reserve() and peek().
+// If 0 it is read from the queue, which needs FreeRTOS 10.5 or later.
+Queue *queue_wrap(QueueHandle_t queue, int size=0);
 
 }   //  namespace panglos
 
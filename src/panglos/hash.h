@@ -0,0 +1,43 @@
+#if !defined(__PANGLOS_HASH__)
+#define __PANGLOS_HASH__
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace panglos {
+
+    /*
+     *  FNV-1a hash.
+     *
+     *  Fast and well spread for short keys, but not cryptographic.
+     *  To hash several fields, pass the result of one call as the seed of the next.
+     */
+
+static const uint32_t FNV1A_INIT = 2166136261u;
+
+inline uint32_t fnv1a(const void *data, size_t n, uint32_t h=FNV1A_INIT)
+{
+    const uint8_t *d = (const uint8_t*) data;
+    for (size_t i = 0; i < n; i++)
+    {
+        h = (h ^ d[i]) * 16777619u;
+    }
+    return h;
+}
+
+// hash a '\0' terminated string, not including the terminator
+inline uint32_t fnv1a(const char *s)
+{
+    uint32_t h = FNV1A_INIT;
+    for (; *s; s++)
+    {
+        h = (h ^ uint8_t(*s)) * 16777619u;
+    }
+    return h;
+}
+
+}   //  namespace panglos
+
+#endif  //  __PANGLOS_HASH__
+
+//  FIN
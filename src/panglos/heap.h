@@ -0,0 +1,218 @@
+#if !defined(__PANGLOS_HEAP__)
+#define __PANGLOS_HEAP__
+
+#include "panglos/mutex.h"
+
+namespace panglos {
+
+    /*
+     *  Intrusive pairing heap.
+     *
+     *  Each item embeds a HeapLink. The cmp function follows the List::add_sorted()
+     *  convention : cmp(a, b) > 0 if a should come out before b.
+     *
+     *  add() is O(1), pop() and remove() are O(log n) amortised, has() is O(1).
+     */
+
+template <class T>
+class HeapLink
+{
+public:
+    T child;
+    T sibling;
+    // parent if first child, otherwise left sibling. 0 if not in a heap
+    T prev;
+
+    HeapLink() : child(0), sibling(0), prev(0) { }
+};
+
+template <class T>
+class Heap
+{
+public:
+    typedef HeapLink<T>* (*link_fn)(T item);
+    typedef int (*cmp_fn)(T a, T b);
+
+    T head;
+    link_fn link;
+    cmp_fn cmp;
+    int count;
+
+private:
+    void clear(T w)
+    {
+        HeapLink<T> *l = link(w);
+        l->child = 0;
+        l->sibling = 0;
+        l->prev = 0;
+    }
+
+    // both must be roots (no prev or sibling)
+    T meld(T a, T b)
+    {
+        if (!a) return b;
+        if (!b) return a;
+
+        if (cmp(b, a) > 0)
+        {
+            T t = a;
+            a = b;
+            b = t;
+        }
+
+        // make b the first child of a
+        HeapLink<T> *la = link(a);
+        HeapLink<T> *lb = link(b);
+        lb->prev = a;
+        lb->sibling = la->child;
+        if (la->child)
+        {
+            link(la->child)->prev = b;
+        }
+        la->child = b;
+        return a;
+    }
+
+    // standard two pass merge of a sibling list
+    T merge_pairs(T first)
+    {
+        T pairs = 0;
+
+        // left to right : meld pairs, stacking the results
+        while (first)
+        {
+            T a = first;
+            T b = link(a)->sibling;
+            first = b ? link(b)->sibling : 0;
+
+            link(a)->sibling = 0;
+            link(a)->prev = 0;
+            if (b)
+            {
+                link(b)->sibling = 0;
+                link(b)->prev = 0;
+            }
+
+            T m = meld(a, b);
+            link(m)->sibling = pairs;
+            pairs = m;
+        }
+
+        // right to left : meld the stack into a single root
+        T root = 0;
+        while (pairs)
+        {
+            T next = link(pairs)->sibling;
+            link(pairs)->sibling = 0;
+            root = meld(root, pairs);
+            pairs = next;
+        }
+
+        return root;
+    }
+
+    T _pop()
+    {
+        T w = head;
+        if (!w)
+        {
+            return 0;
+        }
+
+        head = merge_pairs(link(w)->child);
+        if (head)
+        {
+            link(head)->prev = 0;
+        }
+        clear(w);
+        count -= 1;
+        return w;
+    }
+
+    bool _has(T w)
+    {
+        return (w == head) || link(w)->prev;
+    }
+
+public:
+    Heap(link_fn _link, cmp_fn _cmp)
+    :   head(0), link(_link), cmp(_cmp), count(0)
+    {
+    }
+
+    bool empty()
+    {
+        return !head;
+    }
+
+    int size(Mutex *mutex)
+    {
+        Lock lock(mutex);
+        return count;
+    }
+
+    void add(T w, Mutex *mutex)
+    {
+        Lock lock(mutex);
+        clear(w);
+        head = meld(head, w);
+        count += 1;
+    }
+
+    T pop(Mutex *mutex)
+    {
+        Lock lock(mutex);
+        return _pop();
+    }
+
+    bool has(T w, Mutex *mutex)
+    {
+        Lock lock(mutex);
+        return _has(w);
+    }
+
+    bool remove(T w, Mutex *mutex)
+    {
+        Lock lock(mutex);
+
+        if (!_has(w))
+        {
+            return false;
+        }
+
+        if (w == head)
+        {
+            _pop();
+            return true;
+        }
+
+        // unlink w (and its subtree) from its parent / sibling
+        HeapLink<T> *l = link(w);
+        HeapLink<T> *lp = link(l->prev);
+        if (lp->child == w)
+        {
+            lp->child = l->sibling;
+        }
+        else
+        {
+            lp->sibling = l->sibling;
+        }
+        if (l->sibling)
+        {
+            link(l->sibling)->prev = l->prev;
+        }
+
+        // merge its children back into the heap
+        T sub = merge_pairs(l->child);
+        clear(w);
+        head = meld(head, sub);
+        count -= 1;
+        return true;
+    }
+};
+
+}   //  namespace panglos
+
+#endif  //  __PANGLOS_HEAP__
+
+//  FIN
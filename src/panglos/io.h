@@ -44,20 +44,40 @@ class FmtOut
 {
     Out *out;
     Mutex *mutex;
+    // optional staging buffer, so the Out sees runs of chars, not single chars
+    char *buff;
+    int size;
+    int idx;
 public:
-    FmtOut(Out *_out, Mutex *m=0) : out(_out), mutex(m) { }
+    FmtOut(Out *_out, Mutex *m=0, char *_buff=0, int _size=0)
+    :   out(_out), mutex(m), buff(_buff), size(_buff ? _size : 0), idx(0) { }
 
     void set(Out *_out) { out = _out; }
+    void set_buffer(char *_buff, int _size);
     Mutex *get_mutex() { return mutex; }
 
     int printf(const char *fmt, va_list va);
     int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
     void tx(char c);
+    // send any staged chars to the Out
+    void tx_flush();
 
     static int xprintf(void *, const char *fmt, va_list va);
 };
 
+    /*
+     *  FmtOut with its own staging buffer
+     */
+
+template <int N>
+class BufferedFmtOut : public FmtOut
+{
+    char staging[N];
+public:
+    BufferedFmtOut(Out *_out, Mutex *m=0) : FmtOut(_out, m, staging, N) { }
+};
+
     /*
      *
      */
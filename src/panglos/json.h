@@ -100,6 +100,10 @@ public:
         CLOSE_BRACKET_EXPECTED,
         UNTERMINATED_STRING,
         USER_ERROR,
+        // StreamParser
+        VALUE_EXPECTED,
+        TOKEN_TOO_LONG,
+        NESTING_TOO_DEEP,
     };
 
 private:
@@ -130,6 +134,77 @@ public:
     enum Error get_error(Section *sec);
 };
 
+    /*
+     *  Push parser : accepts the document in arbitrary chunks.
+     *
+     *  Drives the same Handler callbacks as Parser. Tokens that lie within
+     *  a chunk are passed straight from the caller's data; only tokens that
+     *  span a chunk boundary are copied into the scratch buffer, which limits
+     *  the size of a token that can be split. The Section passed to a callback
+     *  is only valid for the duration of the call.
+     */
+
+class StreamParser
+{
+    enum State {
+        VALUE,      // top level, or after ':'
+        ARR_VALUE,  // value or ']'
+        OBJ_KEY,    // key or '}'
+        COLON,
+        NEXT,       // ',' or close
+        STRING,
+        NUMBER,
+        PRIMITIVE,
+        DONE,
+        FAILED,
+    };
+
+    Handler *handler;
+    bool verbose;
+
+    char *scratch;
+    size_t scratch_size;
+    size_t used;
+
+    char *stack;
+    int max_depth;
+    int depth;
+
+    enum State state;
+    bool key;
+    bool escape;
+
+    // bytes consumed by previous calls to parse()
+    size_t offset;
+    enum Parser::Error err;
+    size_t err_offset;
+
+    bool fail(enum Parser::Error e, size_t at);
+    bool user_error(enum Handler::Error e, size_t at);
+    bool save(const char *s, const char *e, size_t at);
+    bool token(const char *s, const char *e, Section *sec, size_t at);
+    bool value_done();
+    bool open(char c, size_t at);
+    bool close(char c, size_t at);
+    bool start_value(char c, size_t at);
+    bool primitive(Section *sec, size_t at);
+
+public:
+    StreamParser(Handler *handler, size_t scratch_size=256, int max_depth=32, bool verbose=true);
+    ~StreamParser();
+
+    // prepare for a new document
+    void reset();
+
+    // returns false on error. Data after the end of the document is ignored
+    bool parse(const char *data, size_t len);
+    // end of input : returns true if a complete document was parsed
+    bool finish();
+
+    bool done() { return state == DONE; }
+    enum Parser::Error get_error(size_t *offset);
+};
+
     /*
      *
      */
@@ -141,19 +216,29 @@ public:
     enum Type { STRING, NUMBER, PRIMITIVE };
     static LUT type_lut[];
 
+    /*
+     *  keys is a 0 terminated path. Each key is an object key,
+     *  an array index "[n]", or "*" which matches any key or index.
+     *  An Item also matches every value nested below its path.
+     */
+
     struct Item {
         const char **keys;
         void (*on_match)(void *arg, Section *sec, enum Type type, const char **keys);
         void *arg;
 
+        // no longer used : items are held in the trie
         struct Item *next;
         static struct Item **get_next(struct Item *d) { return & d->next; }
     };
 
 private:
     class Level;
+    class Node;
 
     void check(Section *sec, enum Type type);
+    void descend(Section *key);
+    void element();
 
     // Handler used to check match
     virtual enum Error on_object(bool push) override;
@@ -166,8 +251,8 @@ private:
     int max_nest;
     Level *levels;
 
-    typedef List<Item*> Items;
-    Items items;
+    // key paths of all the items
+    Node *root;
 
 public:
     void add_item(struct Item *item, Mutex *m=0);
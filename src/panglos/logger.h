@@ -3,8 +3,15 @@
 #define __PANGLOS_LOGGER__
 
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
 
+#include <atomic>
+#include <type_traits>
+
+#include "panglos/debug.h"
 #include "panglos/list.h"
+#include "panglos/pool.h"
 
     /*
      *
@@ -18,10 +25,32 @@ namespace panglos {
 
 class Out;
 class Mutex;
+class Semaphore;
 
 class Logging
 {
-    struct Logger {
+public:
+    // what to do when the async ring is full
+    typedef enum {
+        DROP,   // discard the new record
+        BLOCK,  // wait for space
+    }   Overflow;
+
+    // static description of a PO_TRACE() call site
+    typedef struct {
+        Severity severity;
+        const char *fmt;
+        const char *file;
+        int line;
+        const char *function;
+    }   Site;
+
+    enum { TRACE_ARGS = 8 };
+    // captured args of a PO_TRACE() call
+    struct Trace;
+
+private:
+    struct Logger : public Pooled {
         struct Logger *next;
         Out *out;
         Mutex *mutex;
@@ -31,11 +60,37 @@ class Logging
         static int match_out(struct Logger *logger, void *out);
     };
 
+    // messages up to this size are formatted once for all the sinks
+    enum { LINE_SIZE = 256 };
+
     Severity severity;
     List<struct Logger*> loggers;
     struct Logger *irq_logger;
     Mutex *mutex;
 
+    class Async;
+    std::atomic<Async*> async;
+    // callers using the ring : stop_async() waits for them
+    std::atomic<int> async_users;
+    // set by stop_async(), the last caller out posts idle
+    std::atomic<bool> stopping;
+    Semaphore *idle;
+
+    Async *acquire_async();
+    void release_async();
+
+    void write(Severity s, const char *data, int n);
+
+    void trace(const Site *site, const uint64_t *words, int nargs);
+
+    // raw argument words for PO_TRACE()
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint64_t>::type
+    word(T t) { return uint64_t(int64_t(t)); }
+    template <typename T>
+    static uint64_t word(T *t) { return uint64_t(uintptr_t(t)); }
+    static uint64_t word(double d) { uint64_t w; memcpy(& w, & d, sizeof(w)); return w; }
+
 public:
     Logging(Severity s, Mutex *mutex);
     ~Logging();
@@ -49,14 +104,69 @@ public:
     void log(Severity s, const char *fmt, va_list ap);
     int count();
 
+    // Async mode : callers format into a lock-free ring,
+    // a drain thread writes the records to the sinks.
+    // Records longer than record_size are truncated.
+    // A sink that logs is called on the drain thread : if the ring is full
+    // those records are dropped, even in BLOCK mode, as waiting would deadlock.
+    void start_async(int records=64, int record_size=128, Overflow overflow=DROP);
+    // waits for callers already in the ring, then drains it.
+    // Later records are written synchronously
+    void stop_async();
+    // wait until the ring is empty.
+    // Returns at once if called by a sink, on the drain thread
+    void flush();
+    int get_dropped();
+
     static void printf(Logging *logging, Severity s, const char *fmt, ...)
                 __attribute__((format(printf, 3, 4)));
+
+    // Deferred logging : store the call site and the raw args,
+    // format them later (on the drain thread in async mode).
+    template <typename... Args>
+    static void trace(Logging *logging, const Site *site, Args... args)
+    {
+        static_assert(sizeof...(Args) <= TRACE_ARGS, "too many args for PO_TRACE()");
+        if (!logging || (site->severity > logging->severity))
+        {
+            return;
+        }
+        const uint64_t words[] = { word(args)..., 0 };
+        logging->trace(site, words, int(sizeof...(Args)));
+    }
+
+    // never called : lets the compiler check PO_TRACE() formats
+    static void check(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 };
 
+inline void Logging::check(const char *, ...) { }
+
 extern Logging *logger;
 
 }   //  namespace panglos
 
+    /*
+     *  Binary logging, for tracing in hot paths.
+     *
+     *  Only the call site, time, task and the raw args are captured by the caller.
+     *  %s args are stored as pointers, so must stay valid until the record is
+     *  formatted : use string literals or other static strings.
+     *  '*' widths and %n are not supported.
+     */
+
+#define PO_TRACE(level, fmt, ...) \
+        do { \
+            static const panglos::Logging::Site _po_site = { \
+                level, fmt "\r\n", __FILE__, __LINE__, __FUNCTION__, \
+            }; \
+            if (0) panglos::Logging::check(fmt, ## __VA_ARGS__); \
+            if (PO_ENABLED(level)) \
+                panglos::Logging::trace(panglos::logger, & _po_site, ## __VA_ARGS__); \
+        } while (0)
+
+#define PO_TRACE_DEBUG(fmt, ...)    PO_TRACE(S_DEBUG, fmt, ## __VA_ARGS__)
+#define PO_TRACE_INFO(fmt, ...)     PO_TRACE(S_INFO, fmt, ## __VA_ARGS__)
+
 #endif  //  __PANGLOS_LOGGER__
 
 //  FIN
@@ -11,6 +11,8 @@ public:
 
     virtual void lock() = 0;
     virtual void unlock() = 0;
+    // take the lock if it is free, never waits
+    virtual bool try_lock() = 0;
 
     typedef enum {
         TASK_LOCK,          // suspends the scheduler
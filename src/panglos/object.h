@@ -13,11 +13,19 @@ public:
     virtual void *get(const char *name) = 0;
     virtual bool remove(const char *name) = 0;
 
-    static Objects *create(bool verbose=false);
+    typedef enum {
+        LIST,   // linked list, linear search
+        HASH,   // open addressing hash table, copies the names, lock-free get()
+    }   Type;
+
+    static Objects *create(bool verbose=false, Type type=LIST);
     static Objects* objects; // global store for app
 
     typedef void (*visitor)(const char *name, void *obj, void *arg);
     static void visit(Objects* objects, visitor fn, void *arg);
+
+protected:
+    virtual void _visit(visitor fn, void *arg) = 0;
 };
 
 }   //  namespace panglos
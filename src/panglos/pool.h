@@ -0,0 +1,106 @@
+
+#if !defined(__PANGLOS_POOL__)
+#define __PANGLOS_POOL__
+
+#include <stddef.h>
+
+namespace panglos {
+
+class Mutex;
+
+    /*
+     *  Fixed size block allocator.
+     *
+     *  Blocks come from static memory given to add_memory(), and/or from the
+     *  heap, a chunk of blocks at a time. They are never given back to the
+     *  heap until the pool is deleted, so alloc() / free() are O(1) pops and
+     *  pushes on a free list, with no fragmentation.
+     */
+
+class BlockPool
+{
+    struct Free {
+        Free *next;
+    };
+
+    size_t block_size;
+    // blocks per heap chunk, 0 for static memory only
+    int chunk;
+    Free *free_list;
+    // heap chunks, freed by the destructor
+    Free *chunks;
+    Mutex *mutex;
+
+    int blocks;
+    int used;
+
+    void add_blocks(void *mem, size_t len);
+
+public:
+    BlockPool(size_t size, int chunk=16);
+    ~BlockPool();
+
+    // carve static memory into blocks, eg. for MCU builds
+    void add_memory(void *mem, size_t len);
+    // blocks per heap chunk from now on, 0 to stop using the heap
+    void set_chunk(int chunk);
+
+    // returns 0 if there are no free blocks and no heap chunks allowed
+    void *alloc();
+    void free(void *block);
+
+    size_t get_block_size() { return block_size; }
+
+    struct Stats {
+        int blocks;
+        int used;
+    };
+    Stats get_stats();
+};
+
+    /*
+     *  Size class pools : 16, 32, 64, 128 and 256 byte blocks.
+     *  Larger sizes go to malloc().
+     *
+     *  By default the pools grow from the heap. For a fixed memory budget,
+     *  eg. on an MCU, give each class static memory with add_memory() and
+     *  call set_chunk(0) at startup : alloc() then ASSERTs when a class runs out.
+     */
+
+class PoolAllocator
+{
+public:
+    enum { MAX_SIZE = 256 };
+
+    static void *alloc(size_t size);
+    static void free(void *p, size_t size);
+
+    // add static memory to the pool for blocks of size
+    static void add_memory(size_t size, void *mem, size_t len);
+    // heap chunk size for all the class pools, 0 for static memory only
+    static void set_chunk(int chunk);
+
+    // the pool for a size, or 0 if it is too big
+    static BlockPool *get_pool(size_t size);
+
+private:
+    enum { NUM_POOLS = 5 };
+    static BlockPool **get_pools();
+};
+
+    /*
+     *  Derive from Pooled to new / delete a class through the size class pools.
+     */
+
+class Pooled
+{
+public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+};
+
+}   //  namespace panglos
+
+#endif  //  __PANGLOS_POOL__
+
+//  FIN
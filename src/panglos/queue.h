@@ -15,9 +15,27 @@ public:
 
     class Message;
 
+    // timeout in ticks. On Linux, 0 waits forever
     virtual bool get(Message *msg, int timeout) = 0;
     virtual bool put(const Message *msg) = 0;
 
+    // msgs is an array of n messages, each of the size passed to create()
+    // wait for up to timeout for the first message, then get up to n. Returns number read.
+    virtual int get_many(Message *msgs, int n, int timeout) = 0;
+    // put all n messages, blocking while the queue is full. Returns number written.
+    virtual int put_many(const Message *msgs, int n) = 0;
+
+    // In-place access to the queue storage, avoiding a copy of each message.
+    // reserve() blocks while the queue is full and returns a slot to fill in.
+    // commit() makes it available to readers, in the order it was reserved.
+    virtual Message *reserve() = 0;
+    virtual void commit(Message *msg) = 0;
+    // peek() waits for up to timeout and returns the next message, or 0.
+    // release() frees the slot once the message has been used.
+    // Not for use in an ISR. On FreeRTOS these copy through a staging buffer.
+    virtual Message *peek(int timeout) = 0;
+    virtual void release(Message *msg) = 0;
+
     virtual int queued() = 0;
 };
 
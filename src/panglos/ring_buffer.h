@@ -1,4 +1,13 @@
 
+#if !defined(__PANGLOS_RING_BUFFER__)
+#define __PANGLOS_RING_BUFFER__
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "panglos/debug.h"
+
     /*
      *  "I've been writing ring buffers wrong all these years"
      *  https://www.snellman.net/blog/archive/2016-12-13-ring-buffers
@@ -41,6 +50,212 @@ public:
     Idx size() { return wr - rd; }
 };
 
+    /*
+     *  Lock-free single producer, single consumer ring.
+     *
+     *  One thread (or ISR) writes, one thread reads. No locks are taken.
+     *  Each side owns its index, and keeps a cached copy of the other side's
+     *  index, so it only reads the shared one when the cache limits a span.
+     *  The two sides are padded onto separate cache lines.
+     *
+     *  The span calls give direct access to the contiguous free / filled
+     *  part of the buffer, for bulk copies (eg. DMA or memcpy) :
+     *
+     *      T *p;
+     *      Idx n = ring.write_span(& p);   // producer
+     *      ... fill p[0..n) ...
+     *      ring.commit(n);
+     *
+     *      Idx n = ring.read_span(& p);    // consumer
+     *      ... use p[0..n) ...
+     *      ring.consume(n);
+     *
+     *  Idx must be an unsigned type, and the size a power of 2.
+     */
+
+template<typename T, typename Idx=uint32_t>
+class SpscRing
+{
+    enum { CACHE_LINE = 64 };
+
+    // read only after construction
+    T *data;
+    const Idx _size;
+    const Idx _mask;
+    char pad0[CACHE_LINE];
+
+    // consumer side
+    std::atomic<Idx> rd;
+    Idx wr_cache;
+    char pad1[CACHE_LINE];
+
+    // producer side
+    std::atomic<Idx> wr;
+    Idx rd_cache;
+    char pad2[CACHE_LINE];
+
+    Idx mask(Idx idx) const { return idx & _mask; }
+
+public:
+    SpscRing(Idx n)
+    :   data(0),
+        _size(n),
+        _mask(Idx(n-1)),
+        rd(0),
+        wr_cache(0),
+        wr(0),
+        rd_cache(0)
+    {
+        // ASSERT n is >0 and a power of 2
+        ASSERT(n && ((n & (n-1)) == 0));
+        data = new T[_size];
+    }
+
+    ~SpscRing()
+    {
+        delete[] data;
+    }
+
+    Idx capacity() const { return _size; }
+
+    // approximate if called while the other side is active
+    Idx size() const { return Idx(wr.load(std::memory_order_acquire) - rd.load(std::memory_order_acquire)); }
+    bool empty() const { return size() == 0; }
+
+        /*
+         *  Producer
+         */
+
+    // contiguous free space, up to the end of the buffer
+    Idx write_span(T **p)
+    {
+        ASSERT(p);
+        const Idx w = wr.load(std::memory_order_relaxed);
+        const Idx to_end = Idx(_size - mask(w));
+        Idx space = Idx(_size - Idx(w - rd_cache));
+        if (space < to_end)
+        {
+            rd_cache = rd.load(std::memory_order_acquire);
+            space = Idx(_size - Idx(w - rd_cache));
+        }
+        *p = & data[mask(w)];
+        return (space < to_end) ? space : to_end;
+    }
+
+    // publish n items written into the write_span()
+    void commit(Idx n)
+    {
+        const Idx w = wr.load(std::memory_order_relaxed);
+        wr.store(Idx(w + n), std::memory_order_release);
+    }
+
+    bool push(const T & item)
+    {
+        T *p;
+        if (!write_span(& p))
+        {
+            return false;
+        }
+        *p = item;
+        commit(1);
+        return true;
+    }
+
+    // returns the number of items written
+    Idx write(const T *items, Idx n)
+    {
+        Idx done = 0;
+        while (done < n)
+        {
+            T *p;
+            Idx span = write_span(& p);
+            if (!span)
+            {
+                break;
+            }
+            if (span > Idx(n - done))
+            {
+                span = Idx(n - done);
+            }
+            for (Idx i = 0; i < span; i++)
+            {
+                p[i] = items[done + i];
+            }
+            commit(span);
+            done = Idx(done + span);
+        }
+        return done;
+    }
+
+        /*
+         *  Consumer
+         */
+
+    // contiguous filled space, up to the end of the buffer
+    Idx read_span(T **p)
+    {
+        ASSERT(p);
+        const Idx r = rd.load(std::memory_order_relaxed);
+        const Idx to_end = Idx(_size - mask(r));
+        Idx avail = Idx(wr_cache - r);
+        if (avail < to_end)
+        {
+            wr_cache = wr.load(std::memory_order_acquire);
+            avail = Idx(wr_cache - r);
+        }
+        *p = & data[mask(r)];
+        return (avail < to_end) ? avail : to_end;
+    }
+
+    // release n items read from the read_span()
+    void consume(Idx n)
+    {
+        const Idx r = rd.load(std::memory_order_relaxed);
+        rd.store(Idx(r + n), std::memory_order_release);
+    }
+
+    bool pop(T *item)
+    {
+        ASSERT(item);
+        T *p;
+        if (!read_span(& p))
+        {
+            return false;
+        }
+        *item = *p;
+        consume(1);
+        return true;
+    }
+
+    // returns the number of items read
+    Idx read(T *items, Idx n)
+    {
+        Idx done = 0;
+        while (done < n)
+        {
+            T *p;
+            Idx span = read_span(& p);
+            if (!span)
+            {
+                break;
+            }
+            if (span > Idx(n - done))
+            {
+                span = Idx(n - done);
+            }
+            for (Idx i = 0; i < span; i++)
+            {
+                items[done + i] = p[i];
+            }
+            consume(span);
+            done = Idx(done + span);
+        }
+        return done;
+    }
+};
+
 }   //  panglos
 
+#endif  //  __PANGLOS_RING_BUFFER__
+
 //  FIN
@@ -4,6 +4,8 @@
 
 #pragma once
 
+struct iovec;
+
 namespace panglos {
 
 class Socket
@@ -12,11 +14,18 @@ public:
     virtual ~Socket() { }
 
     virtual int send(const uint8_t *data, size_t len) = 0;
+    // gather write, eg. from Buffers::get_iov(). Returns the bytes sent
+    virtual int sendv(const struct iovec *iov, int n);
     virtual int recv(uint8_t *data, size_t len) = 0;
 
     virtual int bind   (const char * /*ip*/, const char * /*port*/) { return 0; };
     virtual int connect(const char * /*ip*/, const char * /*port*/) { return 0; };
     virtual int get_fd() { return -1; }
+    // stop any further traffic : a blocked or polled recv() sees the connection close
+    virtual int shutdown() { return 0; }
+    // send() may return 0 if a non-blocking socket is full : wait up to ticks
+    // for space. Returns false if the connection has closed
+    virtual bool wait_send(int /*ticks*/) { return true; }
 
     // TODO : called by network manager on wifi up/down events
     virtual void on_net_disconnect() { }
@@ -68,14 +77,27 @@ public:
     void start(Socket *s, Semaphore *sem);
     void stop();
     void kill();
+    // ask the server to close the connection, eg. from a writer thread.
+    // run() returns, or in REACTOR mode on_close() is called from the event loop.
+    void request_close();
 
     virtual void run() = 0;    
     void runner();
 
+    // REACTOR mode : called from the server's event loop instead of run() on a thread.
+    // The socket is non-blocking, send() is buffered and may be called from any thread.
+    // Once on_close() is called send() fails, so any thread using the socket
+    // must be stopped by on_close() : the client and its socket are then released.
+    void attach(Socket *s);
+    virtual void on_connect() { }
+    virtual void on_read(const uint8_t * /*data*/, int /*n*/) { }
+    virtual void on_close() { }
+
     static void runner(void *arg);
     static Client **get_next(Client *c);
 
     const char *get_name() { return name; }
+    Socket *get_socket() { return sock; }
     virtual size_t stack_size() { return 0; }
 
     class Factory
@@ -90,7 +112,14 @@ public:
      *
      */
 
-void run_socket_server(Socket *, Client::Factory *cf);
+typedef enum {
+    // each Client runs on its own Thread
+    THREAD_PER_CLIENT,
+    // a single event loop (epoll) calls the Client on_xxx() handlers : Linux only
+    REACTOR,
+}   ServerMode;
+
+void run_socket_server(Socket *, Client::Factory *cf, ServerMode mode=THREAD_PER_CLIENT);
 
 }   //  namespace panglos
 
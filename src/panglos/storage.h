@@ -63,7 +63,10 @@ public:
 
     //  Functions for unit tests
     static void clear_all();
+    // Linux : replace the store with the contents of the log file at path.
+    // Changes are then appended to the log by commit().
     static bool load(const char *path);
+    // Linux : write a compacted snapshot of the store to path
     static bool save(const char *path);
 
     // Validate params
@@ -1,6 +1,8 @@
 
 #pragma once 
 
+#include <stdint.h>
+
 #include "panglos/socket.h"
 
 namespace panglos {
@@ -8,9 +10,27 @@ namespace panglos {
 class TxFactory : public Client::Factory
 {
 public:
+    // what to do when a client's transmit queue is full
+    typedef enum {
+        // discard the oldest queued block
+        DROP_OLDEST,
+        // close the client's connection
+        DISCONNECT,
+    }   Policy;
+
+    struct Stats
+    {
+        uint64_t sent_bytes;
+        uint64_t dropped_bytes;
+        int dropped_blocks;
+        int disconnects;
+    };
+
     virtual Socket *get_socket() = 0;
+    virtual void get_stats(struct Stats *stats) = 0;
 
-    static TxFactory *create();
+    // each client can have up to depth blocks waiting to be sent
+    static TxFactory *create(int depth=16, Policy policy=DROP_OLDEST);
 };
 
 }   //  namespace panglos
@@ -2,6 +2,8 @@
 #if !defined(__VERBOSE__)
 #define __VERBOSE__
 
+#include "panglos/debug.h"
+
 namespace panglos {
 
 struct Verbose
@@ -9,12 +11,14 @@ struct Verbose
     const char *name;
     bool verbose;
     struct Verbose *next;
+    // log threshold for files that use PO_MODULE()
+    Severity severity;
 
     static struct Verbose* verboses;
 };
 
 #define VERBOSE(xname, label, state) \
-    Verbose xname = { .name = label, .verbose = state, .next = 0 }; \
+    Verbose xname = { .name = label, .verbose = state, .next = 0, .severity = S_DEBUG }; \
     __attribute__((constructor(101))) \
     static void init_##xname() \
     { \
@@ -22,6 +26,20 @@ struct Verbose
         Verbose::verboses = & xname; \
     }
 
+    /*
+     *  Filter this file's PO_xxx() logging with the Verbose's severity.
+     *  Use the CLI 'verbose <name> <SEVERITY>' to change it.
+     */
+
+#define PO_MODULE(xname) \
+    __attribute__((constructor(102))) \
+    static void po_module_##xname() \
+    { \
+        po_module_severity = & xname.severity; \
+    }
+
+// restore the verbose states from Storage "verbose" (int)
+// and the severities from Storage "severity" (eg. "WARNING"), keyed by name
 void verbose_init();
 
 }   //  namespace panglos
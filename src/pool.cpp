@@ -0,0 +1,217 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "panglos/debug.h"
+
+#include "panglos/mutex.h"
+
+#include "panglos/pool.h"
+
+namespace panglos {
+
+    // block / chunk alignment
+static const size_t ALIGN = 2 * sizeof(void*);
+
+static size_t align_up(size_t n)
+{
+    return (n + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+    /*
+     *
+     */
+
+BlockPool::BlockPool(size_t size, int _chunk)
+:   block_size(align_up(size < sizeof(Free) ? sizeof(Free) : size)),
+    chunk(_chunk),
+    free_list(0),
+    chunks(0),
+    mutex(0),
+    blocks(0),
+    used(0)
+{
+    mutex = Mutex::create();
+}
+
+BlockPool::~BlockPool()
+{
+    while (chunks)
+    {
+        Free *c = chunks;
+        chunks = c->next;
+        ::free(c);
+    }
+    delete mutex;
+}
+
+    // call with the mutex held
+
+void BlockPool::add_blocks(void *mem, size_t len)
+{
+    uint8_t *p = (uint8_t*) mem;
+    // align the start
+    const size_t skip = align_up(size_t(uintptr_t(p))) - size_t(uintptr_t(p));
+    if (skip >= len)
+    {
+        return;
+    }
+    p += skip;
+    len -= skip;
+
+    for (; len >= block_size; len -= block_size, p += block_size)
+    {
+        Free *f = (Free*) p;
+        f->next = free_list;
+        free_list = f;
+        blocks += 1;
+    }
+}
+
+void BlockPool::add_memory(void *mem, size_t len)
+{
+    ASSERT(mem);
+    Lock lock(mutex);
+    add_blocks(mem, len);
+}
+
+void BlockPool::set_chunk(int _chunk)
+{
+    ASSERT(_chunk >= 0);
+    Lock lock(mutex);
+    chunk = _chunk;
+}
+
+void *BlockPool::alloc()
+{
+    Lock lock(mutex);
+
+    if (!free_list)
+    {
+        if (!chunk)
+        {
+            return 0;
+        }
+
+        // the chunk header keeps the blocks aligned
+        const size_t header = align_up(sizeof(Free));
+        uint8_t *c = (uint8_t*) malloc(header + (block_size * size_t(chunk)));
+        ASSERT(c);
+        Free *f = (Free*) c;
+        f->next = chunks;
+        chunks = f;
+        add_blocks(& c[header], block_size * size_t(chunk));
+    }
+
+    Free *f = free_list;
+    free_list = f->next;
+    used += 1;
+    return f;
+}
+
+void BlockPool::free(void *block)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    Lock lock(mutex);
+    Free *f = (Free*) block;
+    f->next = free_list;
+    free_list = f;
+    used -= 1;
+}
+
+BlockPool::Stats BlockPool::get_stats()
+{
+    Lock lock(mutex);
+    Stats stats = { .blocks = blocks, .used = used, };
+    return stats;
+}
+
+    /*
+     *  Size classes
+     */
+
+BlockPool *PoolAllocator::get_pool(size_t size)
+{
+    BlockPool **pools = get_pools();
+
+    size_t limit = 16;
+    for (int i = 0; i < NUM_POOLS; i++)
+    {
+        if (size <= limit)
+        {
+            return pools[i];
+        }
+        limit *= 2;
+    }
+    return 0;
+}
+
+BlockPool **PoolAllocator::get_pools()
+{
+    // created on first use, so they work from static constructors.
+    // Never deleted, so objects can still be freed by static destructors.
+    static BlockPool *pools[] = {
+        new BlockPool(16), new BlockPool(32), new BlockPool(64), new BlockPool(128), new BlockPool(256),
+    };
+    static_assert((sizeof(pools) / sizeof(pools[0])) == NUM_POOLS, "pool count");
+    return pools;
+}
+
+void PoolAllocator::add_memory(size_t size, void *mem, size_t len)
+{
+    BlockPool *pool = get_pool(size);
+    ASSERT_ERROR(pool, "size=%d too big for a pool", int(size));
+    pool->add_memory(mem, len);
+}
+
+void PoolAllocator::set_chunk(int chunk)
+{
+    BlockPool **pools = get_pools();
+    for (int i = 0; i < NUM_POOLS; i++)
+    {
+        pools[i]->set_chunk(chunk);
+    }
+}
+
+void *PoolAllocator::alloc(size_t size)
+{
+    BlockPool *pool = get_pool(size);
+    void *p = pool ? pool->alloc() : malloc(size);
+    ASSERT(p);
+    return p;
+}
+
+void PoolAllocator::free(void *p, size_t size)
+{
+    BlockPool *pool = get_pool(size);
+    if (pool)
+    {
+        pool->free(p);
+    }
+    else
+    {
+        ::free(p);
+    }
+}
+
+    /*
+     *
+     */
+
+void *Pooled::operator new(size_t size)
+{
+    return PoolAllocator::alloc(size);
+}
+
+void Pooled::operator delete(void *p, size_t size)
+{
+    PoolAllocator::free(p, size);
+}
+
+}   //  namespace panglos
+
+//  FIN
@@ -10,9 +10,14 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #if defined(ARCH_LINUX)
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netdb.h>
+#include <fcntl.h>
 #else
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
@@ -130,7 +135,25 @@ public:
 
     virtual int send(const uint8_t *data, size_t len) override
     {
+#if defined(ARCH_LINUX)
+        // return an error, rather than raise SIGPIPE, if the peer has gone
+        return (int) ::send(sock, data, len, MSG_NOSIGNAL);
+#else
         return (int) ::send(sock, data, len, 0);
+#endif
+    }
+
+    virtual int sendv(const struct iovec *iov, int n) override
+    {
+#if defined(ARCH_LINUX)
+        struct msghdr msg;
+        memset(& msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec*) iov;
+        msg.msg_iovlen = size_t(n);
+        return (int) ::sendmsg(sock, & msg, MSG_NOSIGNAL);
+#else
+        return (int) ::writev(sock, iov, n);
+#endif
     }
 
     virtual int recv(uint8_t *data, size_t len) override
@@ -152,6 +175,11 @@ public:
     {
         return sock;
     }
+
+    virtual int shutdown() override
+    {
+        return ::shutdown(sock, SHUT_RDWR);
+    }
     
     _Socket(int s) : sock(s) { }
 
@@ -167,6 +195,29 @@ public:
     }
 };
 
+    /*
+     *  Gather write, one send() per segment
+     */
+
+int Socket::sendv(const struct iovec *iov, int n)
+{
+    int total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const int sent = send((const uint8_t*) iov[i].iov_base, iov[i].iov_len);
+        if (sent < 0)
+        {
+            return total ? total : sent;
+        }
+        total += sent;
+        if (size_t(sent) < iov[i].iov_len)
+        {
+            break;
+        }
+    }
+    return total;
+}
+
 Socket *Socket::open_udp(const char *ip, const char *port, Role role)
 {
     return _Socket::create(ip, port, role, true);
@@ -214,20 +265,39 @@ void Client::kill()
     thread->join();
 }
 
+static char *make_name(int *id)
+{
+    char buff[32];
+    snprintf(buff, sizeof(buff), "client_%d", (*id)++);
+    return strdup(buff);
+}
+
 void Client::start(Socket *s, Semaphore *_sem)
 {
     sock = s;
     sem = _sem;
-
-    char buff[32];
-    snprintf(buff, sizeof(buff), "client_%d", id++);
-    name = strdup(buff);
+    name = make_name(& id);
 
     PO_DEBUG("client=%s", get_name());
     thread = Thread::create(name, stack_size());
     thread->start(runner, this);
 }
 
+void Client::attach(Socket *s)
+{
+    sock = s;
+    name = make_name(& id);
+}
+
+void Client::request_close()
+{
+    PO_DEBUG("client=%s", get_name());
+    if (sock)
+    {
+        sock->shutdown();
+    }
+}
+
 void Client::stop()
 {
     PO_DEBUG("client=%s", get_name());
@@ -260,6 +330,261 @@ Client **Client::get_next(Client *c) { return & c->next; }
      *
      */
 
+#if defined(ARCH_LINUX)
+
+    /*
+     *  Non-blocking connection, owned by the REACTOR event loop.
+     *
+     *  Other threads may be in send() when the event loop closes the connection,
+     *  so the socket is reference counted : the event loop holds one reference
+     *  and each call holds one for its duration. close() makes any further calls fail,
+     *  the last release() deletes it.
+     */
+
+class ReactorSocket : public Socket
+{
+    int epfd;
+    Mutex *mutex;
+    std::atomic<int> refs;
+    bool closed;
+    // pending output, from wout to wlen
+    uint8_t *wbuff;
+    size_t wsize;
+    size_t wout;
+    size_t wlen;
+    bool polling_out;
+    // writers waiting in wait_send()
+    std::atomic<int> waiters;
+    Semaphore *space;
+
+    // holds a reference for the scope of a call
+    class Ref
+    {
+        ReactorSocket *rs;
+    public:
+        Ref(ReactorSocket *s) : rs(s) { rs->refs += 1; }
+        ~Ref() { rs->release(); }
+    };
+
+    void set_events(bool out)
+    {
+        struct epoll_event ev;
+        ev.events = out ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.ptr = this;
+        int err = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, & ev);
+        ASSERT_ERROR(err == 0, "err=%d %s", errno, strerror(errno));
+        polling_out = out;
+    }
+
+    void buffer(const uint8_t *data, size_t len)
+    {
+        if ((wlen + len) > wsize)
+        {
+            // compact, then grow if needed
+            memmove(wbuff, & wbuff[wout], wlen - wout);
+            wlen -= wout;
+            wout = 0;
+            if ((wlen + len) > wsize)
+            {
+                wsize = wlen + len;
+                wbuff = (uint8_t*) realloc(wbuff, wsize);
+                ASSERT(wbuff);
+            }
+        }
+        memcpy(& wbuff[wlen], data, len);
+        wlen += len;
+    }
+
+    void wake_writers()
+    {
+        if (waiters.load())
+        {
+            space->post();
+        }
+    }
+
+    ~ReactorSocket()
+    {
+        // the fd is only closed here, so its number can't be reused under a late caller
+        ::close(fd);
+        free(wbuff);
+        delete space;
+        delete mutex;
+    }
+
+public:
+    int fd;
+    Client *client;
+    // limit on buffered output per connection
+    static const size_t max_buffered = 64 * 1024;
+
+    ReactorSocket(int _fd, int _epfd)
+    :   epfd(_epfd),
+        mutex(0),
+        refs(1),
+        closed(false),
+        wbuff(0),
+        wsize(0),
+        wout(0),
+        wlen(0),
+        polling_out(false),
+        waiters(0),
+        space(0),
+        fd(_fd),
+        client(0)
+    {
+        mutex = Mutex::create();
+        space = Semaphore::create();
+    }
+
+    void release()
+    {
+        if (--refs == 0)
+        {
+            delete this;
+        }
+    }
+
+    // called by the event loop : remove from the epoll set and fail any further calls
+    void close()
+    {
+        Lock lock(mutex);
+        if (closed)
+        {
+            return;
+        }
+        closed = true;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0);
+        ::shutdown(fd, SHUT_RDWR);
+        wout = wlen = 0;
+        wake_writers();
+    }
+
+    virtual int send(const uint8_t *data, size_t len) override
+    {
+        Ref ref(this);
+        Lock lock(mutex);
+
+        if (closed)
+        {
+            return -1;
+        }
+
+        size_t done = 0;
+        if (wout == wlen)
+        {
+            // nothing pending, so try to send immediately
+            const ssize_t n = ::send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+                done = size_t(n);
+            }
+        }
+
+        size_t more = len - done;
+        const size_t pending = wlen - wout;
+        if ((pending + more) > max_buffered)
+        {
+            more = max_buffered - pending;
+        }
+
+        if (more)
+        {
+            buffer(& data[done], more);
+            if (!polling_out)
+            {
+                set_events(true);
+            }
+        }
+
+        return int(done + more);
+    }
+
+    virtual int recv(uint8_t *data, size_t len) override
+    {
+        Ref ref(this);
+        return (int) ::recv(fd, data, len, MSG_DONTWAIT);
+    }
+
+    virtual int get_fd() override
+    {
+        return fd;
+    }
+
+    // send() returns 0 once max_buffered is pending : wait for flush() to make space
+    virtual bool wait_send(int ticks) override
+    {
+        Ref ref(this);
+        {
+            Lock lock(mutex);
+            if (closed)
+            {
+                return false;
+            }
+            if ((wlen - wout) < max_buffered)
+            {
+                return true;
+            }
+            waiters += 1;
+        }
+
+        space->wait_timeout(ticks);
+        waiters -= 1;
+
+        Lock lock(mutex);
+        return !closed;
+    }
+
+    // ask the event loop to close the connection : it sees EPOLLHUP
+    virtual int shutdown() override
+    {
+        Ref ref(this);
+        Lock lock(mutex);
+        return closed ? 0 : ::shutdown(fd, SHUT_RDWR);
+    }
+
+    // called on EPOLLOUT. Returns false on error
+    bool flush()
+    {
+        Lock lock(mutex);
+
+        if (closed)
+        {
+            return false;
+        }
+
+        while (wout < wlen)
+        {
+            const ssize_t n = ::send(fd, & wbuff[wout], wlen - wout, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                const bool ok = (errno == EAGAIN) || (errno == EWOULDBLOCK);
+                wake_writers();
+                return ok;
+            }
+            wout += size_t(n);
+        }
+
+        wout = wlen = 0;
+        set_events(false);
+        wake_writers();
+        return true;
+    }
+};
+
+#endif  //  ARCH_LINUX
+
+    /*
+     *
+     */
+
 class _SocketServer : public SocketServer
 {
     int sock;
@@ -269,7 +594,7 @@ class _SocketServer : public SocketServer
     Clients clients;
     Clients ex_clients;
     Mutex *mutex;
-    bool dead;
+    std::atomic<bool> dead;
 
 public:
 
@@ -399,16 +724,171 @@ public:
         tidy_clients(clients);
         tidy_clients(ex_clients);
     }
+
+#if defined(ARCH_LINUX)
+
+        /*
+         *  REACTOR mode
+         */
+
+    void reactor_accept(int epfd)
+    {
+        while (!dead)
+        {
+            const int fd = accept4(sock, 0, 0, SOCK_NONBLOCK);
+            if (fd < 0)
+            {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+                {
+                    return;
+                }
+                if (errno == EBADF)
+                {
+                    PO_INFO("socket closed");
+                    dead = true;
+                    return;
+                }
+                PO_ERROR("err=%d '%s' sock=%d", errno, strerror(errno), sock);
+                return;
+            }
+
+            Client *client = cf->create_client(this);
+            ReactorSocket *rs = new ReactorSocket(fd, epfd);
+            rs->client = client;
+            client->attach(rs);
+            clients.push(client, mutex);
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = rs;
+            int err = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, & ev);
+            ASSERT_ERROR(err == 0, "err=%d %s", errno, strerror(errno));
+
+            client->on_connect();
+        }
+    }
+
+    // returns false if the connection has closed
+    static bool reactor_read(ReactorSocket *rs)
+    {
+        // Level triggered, so one read per event. The data is passed straight to the client.
+        uint8_t buff[1024];
+        const ssize_t n = ::recv(rs->fd, buff, sizeof(buff), MSG_DONTWAIT);
+        if (n > 0)
+        {
+            rs->client->on_read(buff, int(n));
+            return true;
+        }
+        if (n == 0)
+        {
+            return false;
+        }
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    void reactor_close(ReactorSocket *rs)
+    {
+        Client *client = rs->client;
+        PO_DEBUG("client=%s", client->get_name());
+        // any send() from now on fails, so the client's threads see the close
+        rs->close();
+        client->on_close();
+        clients.remove(client, mutex);
+        // on_close() may have called del_client()
+        ex_clients.remove(client, mutex);
+        delete client;
+        // deleted once any send() still in progress returns
+        rs->release();
+    }
+
+    void run_reactor()
+    {
+        PO_DEBUG("");
+        listen(sock, SOMAXCONN);
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+        const int epfd = epoll_create1(0);
+        ASSERT_ERROR(epfd >= 0, "err=%d %s", errno, strerror(errno));
+
+        // the listening socket has a null ptr
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = 0;
+        int err = epoll_ctl(epfd, EPOLL_CTL_ADD, sock, & ev);
+        ASSERT_ERROR(err == 0, "err=%d %s", errno, strerror(errno));
+
+        while (!dead)
+        {
+            struct epoll_event events[64];
+            // timeout, so that kill() is seen
+            const int n = epoll_wait(epfd, events, 64, 100);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                PO_ERROR("err=%d '%s'", errno, strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < n; i++)
+            {
+                ReactorSocket *rs = (ReactorSocket *) events[i].data.ptr;
+                if (!rs)
+                {
+                    reactor_accept(epfd);
+                    continue;
+                }
+
+                const uint32_t e = events[i].events;
+                bool ok = !(e & EPOLLERR);
+                if (ok && (e & EPOLLOUT))
+                {
+                    ok = rs->flush();
+                }
+                if (ok && (e & (EPOLLIN | EPOLLHUP)))
+                {
+                    ok = reactor_read(rs);
+                }
+                if (!ok)
+                {
+                    reactor_close(rs);
+                }
+            }
+        }
+
+        // close any remaining connections
+        while (Client *client = clients.head)
+        {
+            reactor_close((ReactorSocket *) client->get_socket());
+        }
+
+        close(epfd);
+    }
+
+#endif  //  ARCH_LINUX
 };
 
     /*
      *
      */
 
-void run_socket_server(Socket *sock, Client::Factory *cf)
+void run_socket_server(Socket *sock, Client::Factory *cf, ServerMode mode)
 {
     _Socket *s = (_Socket*) sock;
     _SocketServer ss(s->sock, cf);
+
+    if (mode == REACTOR)
+    {
+#if defined(ARCH_LINUX)
+        ss.run_reactor();
+        return;
+#else
+        PO_WARNING("REACTOR mode not supported, using THREAD_PER_CLIENT");
+#endif
+    }
+
     ss.run();
     ss.join();
 }
@@ -4,9 +4,15 @@
      */
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
 
 #include "panglos/debug.h"
 #include "panglos/mutex.h"
+#include "panglos/semaphore.h"
+#include "panglos/thread.h"
 #include "panglos/list.h"
 #include "panglos/socket.h"
 
@@ -14,41 +20,278 @@
 
 namespace panglos {
 
+    /*
+     *  Payload shared by every client it is queued on
+     */
+
+struct TxBlock
+{
+    std::atomic<int> refs;
+    size_t len;
+    uint8_t data[];
+
+    static TxBlock *create(const uint8_t *data, size_t len)
+    {
+        TxBlock *block = (TxBlock*) malloc(sizeof(TxBlock) + len);
+        ASSERT(block);
+        new (& block->refs) std::atomic<int>(1);
+        block->len = len;
+        memcpy(block->data, data, len);
+        return block;
+    }
+
+    void ref()
+    {
+        refs += 1;
+    }
+
+    void unref()
+    {
+        if (--refs == 0)
+        {
+            free(this);
+        }
+    }
+};
+
+    /*
+     *  Counters, shared by all the clients
+     */
+
+struct TxStats
+{
+    std::atomic<uint64_t> sent_bytes;
+    std::atomic<uint64_t> dropped_bytes;
+    std::atomic<int> dropped_blocks;
+    std::atomic<int> disconnects;
+
+    TxStats() : sent_bytes(0), dropped_bytes(0), dropped_blocks(0), disconnects(0) { }
+};
+
+    /*
+     *  Each client has a bounded ring of blocks and a writer thread,
+     *  so a slow client never blocks the data source or the other clients.
+     */
+
 class XClient : public Client
 {
+    TxBlock **ring;
+    int depth;
+    int in;
+    int out;
+    int count;
+    TxFactory::Policy policy;
+    TxStats *stats;
+    Mutex *mutex;
+    Semaphore *semaphore;
+    Thread *writer;
+    std::atomic<bool> dead;
+
+    TxBlock *pop()
+    {
+        Lock lock(mutex);
+        if (!count)
+        {
+            return 0;
+        }
+        TxBlock *block = ring[out];
+        out = (out + 1) % depth;
+        count -= 1;
+        return block;
+    }
+
+    void drop(TxBlock *block)
+    {
+        stats->dropped_bytes += block->len;
+        stats->dropped_blocks += 1;
+        block->unref();
+    }
+
+    void disconnect()
+    {
+        if (dead.exchange(true))
+        {
+            return;
+        }
+        PO_DEBUG("client=%s", get_name());
+        stats->disconnects += 1;
+        // unblock the reader and the writer
+        request_close();
+        semaphore->post();
+    }
+
+    void write()
+    {
+        while (!dead)
+        {
+            semaphore->wait();
+
+            while (TxBlock *block = pop())
+            {
+                if (send(block))
+                {
+                    stats->sent_bytes += block->len;
+                    block->unref();
+                    continue;
+                }
+                drop(block);
+                disconnect();
+            }
+        }
+    }
+
+    bool send(TxBlock *block)
+    {
+        size_t done = 0;
+        while (!dead && (done < block->len))
+        {
+            const int n = sock->send(& block->data[done], block->len - done);
+            if (n < 0)
+            {
+                return false;
+            }
+            if ((n == 0) && !sock->wait_send(100))
+            {
+                // REACTOR mode : the socket's output buffer was full, then it closed
+                return false;
+            }
+            done += size_t(n);
+        }
+        return done == block->len;
+    }
+
+    static void write(void *arg)
+    {
+        ASSERT(arg);
+        XClient *client = (XClient*) arg;
+        client->write();
+    }
+
+    void start_writer()
+    {
+        writer = Thread::create("tx_writer", stack_size());
+        writer->start(write, this);
+    }
+
+    void stop_writer()
+    {
+        if (!writer)
+        {
+            return;
+        }
+        dead = true;
+        semaphore->post();
+        writer->join();
+        delete writer;
+        writer = 0;
+
+        // discard anything still queued
+        while (TxBlock *block = pop())
+        {
+            drop(block);
+        }
+    }
+
     virtual void run() override
     {
         PO_DEBUG("");
         ASSERT(sock);
 
-        while (true)
+        start_writer();
+
+        while (!dead)
         {
             uint8_t buff[32];
             const int n = sock->recv(buff, sizeof(buff));
 
-            if (n == -1)
+            if (n <= 0)
             {
                 break;
             }
             // drop incoming data ...
         }
+
+        stop_writer();
+    }
+
+    // REACTOR mode
+    virtual void on_connect() override
+    {
+        ss->add_client(this);
+        start_writer();
+    }
+
+    virtual void on_close() override
+    {
+        ss->del_client(this);
+        stop_writer();
     }
 
 public:
-    XClient(SocketServer *ss)
-    :   Client(ss)
+    XClient(SocketServer *ss, int _depth, TxFactory::Policy p, TxStats *s)
+    :   Client(ss),
+        ring(0),
+        depth(_depth),
+        in(0),
+        out(0),
+        count(0),
+        policy(p),
+        stats(s),
+        mutex(0),
+        semaphore(0),
+        writer(0),
+        dead(false)
     {
         PO_DEBUG("");
+        ASSERT(depth > 0);
+        ring = new TxBlock*[depth];
+        mutex = Mutex::create();
+        semaphore = Semaphore::create();
     }
 
     ~XClient()
     {
         PO_DEBUG("");
+        stop_writer();
+        delete semaphore;
+        delete mutex;
+        delete[] ring;
     }
 
-    int send(const uint8_t *data, size_t len)
+    // never blocks
+    void queue(TxBlock *block)
     {
-        return sock->send(data, len);
+        {
+            Lock lock(mutex);
+
+            if (dead)
+            {
+                return;
+            }
+
+            if (count == depth)
+            {
+                if (policy == TxFactory::DISCONNECT)
+                {
+                    stats->dropped_bytes += block->len;
+                    stats->dropped_blocks += 1;
+                    disconnect();
+                    return;
+                }
+
+                // DROP_OLDEST
+                drop(ring[out]);
+                out = (out + 1) % depth;
+                count -= 1;
+            }
+
+            block->ref();
+            ring[in] = block;
+            in = (in + 1) % depth;
+            count += 1;
+        }
+
+        semaphore->post();
     }
 
     static XClient **get_next(XClient *c) { return (XClient **) Client::get_next(c); }
@@ -63,6 +306,9 @@ class XFactory : public TxFactory
     List<XClient*> clients;
     SocketServer *ss;
     Mutex *mutex;
+    int depth;
+    Policy policy;
+    TxStats stats;
 
     void add_client(Client *client)
     { 
@@ -96,25 +342,21 @@ class XFactory : public TxFactory
 
     ProxySocketServer proxy;
 
-    struct TX
-    {
-        const uint8_t *data;
-        size_t len;
-    };
-
     static int send_cb(XClient *client, void *arg)
     {
         ASSERT(client);
         ASSERT(arg);
-        struct TX *tx = (struct TX*) arg;
-        client->send(tx->data, tx->len);
+        TxBlock *block = (TxBlock*) arg;
+        client->queue(block);
         return 0;
     }
 
     int send(const uint8_t *data, size_t len)
     {
-        struct TX tx { .data = data, .len = len, };
-        clients.visit(send_cb, & tx, mutex);
+        // copy the data once, shared by all the clients
+        TxBlock *block = TxBlock::create(data, len);
+        clients.visit(send_cb, block, mutex);
+        block->unref();
         return (int) len;
     }
 
@@ -142,14 +384,16 @@ class XFactory : public TxFactory
     virtual Client *create_client(SocketServer *_ss) override
     {
         ss = _ss;
-        return new XClient(& proxy);
+        return new XClient(& proxy, depth, policy, & stats);
     }
 
 public:
-    XFactory()
+    XFactory(int _depth, Policy p)
     :   clients(XClient::get_next),
         ss(0),
         mutex(0),
+        depth(_depth),
+        policy(p),
         proxy(this),
         psock(this)
     {
@@ -165,11 +409,20 @@ public:
     {
         return & psock;
     }
+
+    virtual void get_stats(struct Stats *s) override
+    {
+        ASSERT(s);
+        s->sent_bytes = stats.sent_bytes;
+        s->dropped_bytes = stats.dropped_bytes;
+        s->dropped_blocks = stats.dropped_blocks;
+        s->disconnects = stats.disconnects;
+    }
 };
 
-TxFactory *TxFactory::create()
+TxFactory *TxFactory::create(int depth, Policy policy)
 {
-    return new XFactory;
+    return new XFactory(depth, policy);
 }
 
 }   //  namespace panglos
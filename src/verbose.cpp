@@ -13,6 +13,7 @@ struct Verbose *Verbose::verboses;
 void verbose_init()
 {
     Storage db("verbose");
+    Storage sdb("severity");
 
     for (struct Verbose *v = Verbose::verboses; v; v = v->next)
     {
@@ -22,6 +23,24 @@ void verbose_init()
             PO_DEBUG("setting %s %d", v->name, (int) value);
             v->verbose = value;
         }
+
+        // stored by name, eg. "WARNING"
+        char name[16];
+        size_t size = sizeof(name);
+        if (sdb.get(v->name, name, & size))
+        {
+            name[sizeof(name)-1] = '\0';
+            const LUT *sv = lut_find(Severity_lut, name);
+            if (sv)
+            {
+                PO_DEBUG("setting %s %s", v->name, name);
+                v->severity = (Severity) sv->code;
+            }
+            else
+            {
+                PO_ERROR("%s : bad severity '%s'", v->name, name);
+            }
+        }
     }
 }
 
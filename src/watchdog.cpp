@@ -6,6 +6,7 @@
 
 #include "panglos/mutex.h"
 #include "panglos/list.h"
+#include "panglos/pool.h"
 #include "panglos/thread.h"
 #include "panglos/watchdog.h"
 
@@ -15,7 +16,7 @@ namespace panglos {
      *
      */
 
-class Watched : public Watchdog::Task
+class Watched : public Watchdog::Task, public Pooled
 {
 public:
     Watched *next;
@@ -4,9 +4,13 @@
 #include "panglos/debug.h"
 #include "panglos/object.h"
 #include "panglos/thread.h"
+#include "panglos/semaphore.h"
+#include "panglos/time.h"
 
 #include "panglos/batch.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
 TEST(Batch, LifeCycle)
@@ -92,4 +96,248 @@ TEST(Batch, Wait)
     delete Objects::objects;
 }
 
+    /*
+     *  Priorities, handles and cancellation
+     */
+
+class GateJob : public BatchTask::Job
+{
+public:
+    Semaphore *running;
+    Semaphore *semaphore;
+
+    virtual void run() override
+    {
+        running->post();
+        semaphore->wait();
+    }
+
+    GateJob()
+    :   running(0),
+        semaphore(0)
+    {
+        running = Semaphore::create();
+        semaphore = Semaphore::create();
+    }
+
+    ~GateJob()
+    {
+        delete semaphore;
+        delete running;
+    }
+};
+
+class OrderJob : public BatchTask::Job
+{
+public:
+    int id;
+    int *log;
+    int *n;
+
+    virtual void run() override
+    {
+        log[(*n)++] = id;
+    }
+};
+
+TEST(Batch, Priority)
+{
+    BatchTask task(1);
+    EXPECT_EQ(1, task.get_workers());
+
+    // hold the worker while jobs are queued
+    GateJob gate;
+    BatchTask::Handle *gh = task.submit(& gate);
+    gate.running->wait();
+
+    const BatchTask::Priority prio[] = {
+        BatchTask::LOW, BatchTask::NORMAL, BatchTask::HIGH, BatchTask::LOW, BatchTask::HIGH, BatchTask::NORMAL,
+    };
+    int log[6];
+    int n = 0;
+    OrderJob jobs[6];
+    for (int i = 0; i < 6; i++)
+    {
+        jobs[i].id = i;
+        jobs[i].log = log;
+        jobs[i].n = & n;
+        task.execute(& jobs[i], prio[i]);
+    }
+
+    gate.semaphore->post();
+    gh->wait();
+    EXPECT_EQ(BatchTask::DONE, gh->get_state());
+    gh->release();
+
+    // the stats are updated before the handle completes
+    BatchTask::WaitJob waiter;
+    BatchTask::Handle *h = task.submit(& waiter, BatchTask::LOW);
+    h->wait();
+    h->release();
+
+    const int expect[] = { 2, 4, 1, 5, 0, 3 };
+    EXPECT_EQ(6, n);
+    for (int i = 0; i < 6; i++)
+    {
+        EXPECT_EQ(expect[i], log[i]);
+    }
+
+    BatchTask::Stats stats;
+    task.get_stats(BatchTask::HIGH, & stats);
+    EXPECT_EQ(2, stats.run);
+    task.get_stats(BatchTask::NORMAL, & stats);
+    EXPECT_EQ(3, stats.run);
+    task.get_stats(BatchTask::LOW, & stats);
+    EXPECT_EQ(3, stats.run);
+}
+
+static void on_done(void *arg, BatchTask::State state)
+{
+    ASSERT(arg);
+    BatchTask::State *s = (BatchTask::State*) arg;
+    *s = state;
+}
+
+TEST(Batch, Handle)
+{
+    BatchTask task(1);
+
+    GateJob gate;
+    BatchTask::Handle *gh = task.submit(& gate);
+    gate.running->wait();
+
+    int log[2];
+    int n = 0;
+    OrderJob a, b;
+    a.id = 1;
+    b.id = 2;
+    a.log = b.log = log;
+    a.n = b.n = & n;
+
+    BatchTask::State sa = BatchTask::QUEUED;
+    BatchTask::State sb = BatchTask::QUEUED;
+    BatchTask::Handle *ha = task.submit(& a);
+    BatchTask::Handle *hb = task.submit(& b);
+    ha->then(on_done, & sa);
+    hb->then(on_done, & sb);
+
+    EXPECT_FALSE(ha->poll());
+    EXPECT_EQ(BatchTask::QUEUED, hb->get_state());
+
+    // cancel b while it is queued
+    EXPECT_TRUE(hb->cancel());
+    EXPECT_EQ(BatchTask::CANCELLED, sb);
+    EXPECT_TRUE(hb->poll());
+    EXPECT_FALSE(hb->cancel());
+    // the gate job is running : too late to cancel
+    EXPECT_FALSE(gh->cancel());
+
+    gate.semaphore->post();
+    ha->wait();
+    EXPECT_TRUE(ha->poll());
+    EXPECT_EQ(BatchTask::DONE, sa);
+    EXPECT_EQ(1, n);
+    EXPECT_EQ(1, log[0]);
+
+    // already done : then() is called at once
+    sa = BatchTask::QUEUED;
+    ha->then(on_done, & sa);
+    EXPECT_EQ(BatchTask::DONE, sa);
+
+    BatchTask::Stats stats;
+    task.get_stats(BatchTask::NORMAL, & stats);
+    EXPECT_EQ(1, stats.cancelled);
+
+    gh->release();
+    ha->release();
+    hb->release();
+}
+
+    /*
+     *  Several workers : a short HIGH job isn't held up by long LOW jobs
+     */
+
+class SleepJob : public BatchTask::Job
+{
+public:
+    int ms;
+
+    virtual void run() override
+    {
+        Time::msleep(ms);
+    }
+};
+
+static double short_latency(int workers, int reserved)
+{
+    // the jobs must outlive the task, which drains them
+    SleepJob slow[8];
+    SleepJob quick;
+    BatchTask task(workers, reserved);
+
+    for (int i = 0; i < 8; i++)
+    {
+        slow[i].ms = 20;
+        task.execute(& slow[i], BatchTask::LOW);
+    }
+
+    // let the workers start on the slow jobs
+    Time::msleep(5);
+
+    quick.ms = 0;
+    Stopwatch sw;
+    BatchTask::Handle *h = task.submit(& quick, BatchTask::HIGH);
+    h->wait();
+    const double t = sw.elapsed();
+    h->release();
+
+    // drains the slow jobs
+    return t;
+}
+
+TEST(Batch, Workers)
+{
+    const double serial = short_latency(1, 0);
+    const double shared = short_latency(2, 0);
+    const double reserved = short_latency(2, 1);
+
+    PO_INFO("HIGH job latency : 1 worker=%.1f ms, 2 workers=%.1f ms, 2 with 1 reserved=%.1f ms",
+            serial * 1e3, shared * 1e3, reserved * 1e3);
+
+    // waits for a slow job to finish
+    EXPECT_GT(serial, 0.005);
+    // a worker is kept free for it
+    EXPECT_LT(reserved, 0.005);
+}
+
+TEST(Batch, Threads)
+{
+    BatchTask task(4);
+
+    const int num = 20;
+    BatchTest tests[num];
+    BatchTask::Handle *handles[num];
+    for (int i = 0; i < num; i++)
+    {
+        handles[i] = task.submit(& tests[i], BatchTask::Priority(i % BatchTask::PRIORITIES));
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        handles[i]->wait();
+        EXPECT_EQ(BatchTask::DONE, handles[i]->get_state());
+        handles[i]->release();
+        EXPECT_TRUE(tests[i].thread);
+    }
+
+    int run = 0;
+    for (int p = 0; p < BatchTask::PRIORITIES; p++)
+    {
+        BatchTask::Stats stats;
+        task.get_stats(BatchTask::Priority(p), & stats);
+        run += stats.run;
+    }
+    EXPECT_EQ(num, run);
+}
+
 //  FIN
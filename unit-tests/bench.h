@@ -0,0 +1,38 @@
+
+    /*
+     *  Wall-clock timing for benchmark tests.
+     *
+     *  Time::get() is driven by the tests, so it can't be used to time anything.
+     */
+
+#pragma once
+
+#include <time.h>
+
+class Stopwatch
+{
+    struct timespec start;
+
+    static double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, & ts);
+        return double(ts.tv_sec) + (double(ts.tv_nsec) / 1e9);
+    }
+
+public:
+    Stopwatch() { reset(); }
+
+    void reset()
+    {
+        clock_gettime(CLOCK_MONOTONIC, & start);
+    }
+
+    // seconds since reset()
+    double elapsed()
+    {
+        return now() - (double(start.tv_sec) + (double(start.tv_nsec) / 1e9));
+    }
+};
+
+//  FIN
@@ -2,14 +2,19 @@
 #include <atomic>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
 #include <panglos/debug.h>
 #include <panglos/thread.h>
 #include <panglos/buffer.h>
+#include <panglos/socket.h>
 
 #include "mock.h"
+#include "bench.h"
 
 using namespace panglos;
 
@@ -563,4 +568,365 @@ TEST(Buffers, Spent)
     EXPECT_EQ('c', buff[2]);
 }
 
+    /*
+     *  Bulk copies that wrap the end of the ring
+     */
+
+TEST(RingBuffer, Wrap)
+{
+    RingBuffer<uint8_t> buffer(16, 0, 0);
+
+    uint8_t in[32];
+    for (int i = 0; i < int(sizeof(in)); i++)
+    {
+        in[i] = uint8_t(i);
+    }
+    uint8_t out[32];
+
+    // move the indices along, so the next copies wrap
+    for (int offset = 0; offset < 16; offset++)
+    {
+        EXPECT_EQ(offset, buffer.add(in, offset));
+        EXPECT_EQ(offset, buffer.get(out, offset));
+        EXPECT_TRUE(buffer.empty());
+
+        // can only hold size-1
+        EXPECT_EQ(15, buffer.add(in, 20));
+        EXPECT_TRUE(buffer.full());
+        EXPECT_EQ(15, buffer.count());
+        memset(out, 0, sizeof(out));
+        EXPECT_EQ(10, buffer.get(out, 10));
+        EXPECT_EQ(5, buffer.get(& out[10], 10));
+        EXPECT_EQ(0, memcmp(in, out, 15));
+        EXPECT_TRUE(buffer.empty());
+    }
+}
+
+    /*
+     *  Only post when a waiter could make progress
+     */
+
+class CountSemaphore : public Semaphore
+{
+public:
+    int posts;
+
+    CountSemaphore() : posts(0) { }
+
+    virtual void post() override { posts += 1; }
+    virtual void wait() override { }
+    virtual void wait_timeout(int) override { }
+};
+
+TEST(RingBuffer, Watermark)
+{
+    CountSemaphore data;
+    CountSemaphore space;
+    RingBuffer<uint8_t> buffer(64, & data, 0);
+    uint8_t buff[64] = { 0 };
+
+    // default : post when the buffer stops being empty
+    buffer.add(buff, 4);
+    buffer.add(buff, 4);
+    buffer.add('x');
+    EXPECT_EQ(1, data.posts);
+    buffer.get(buff, 9);
+    buffer.add('x');
+    EXPECT_EQ(2, data.posts);
+    buffer.get(buff, 1);
+
+    buffer.set_watermarks(16, 4, & space);
+    data.posts = 0;
+
+    buffer.add(buff, 10);
+    EXPECT_EQ(0, data.posts);
+    buffer.add(buff, 10);
+    EXPECT_EQ(1, data.posts);
+    buffer.add(buff, 10);
+    EXPECT_EQ(1, data.posts);
+
+    // 30 in the buffer
+    buffer.get(buff, 20);
+    EXPECT_EQ(0, space.posts);
+    buffer.get(buff, 6);
+    EXPECT_EQ(1, space.posts);
+    buffer.get(buff, 4);
+    EXPECT_EQ(1, space.posts);
+    EXPECT_TRUE(buffer.empty());
+
+    // crossing the high watermark again
+    buffer.add(buff, 20);
+    EXPECT_EQ(2, data.posts);
+}
+
+    /*
+     *
+     */
+
+TEST(Buffers, Write)
+{
+    Buffers b;
+    uint8_t buff[64];
+
+    // no buffers
+    EXPECT_EQ(0, b.write((const uint8_t*) "abcdef", 6));
+
+    b.add_buffer(4);
+    EXPECT_EQ(4, b.write((const uint8_t*) "abcdef", 6));
+
+    // add buffers as needed
+    EXPECT_EQ(10, b.write((const uint8_t*) "efghijklmn", 10, 3));
+    EXPECT_EQ(4 + 12, b.get_size());
+
+    const int n = b.read(buff, sizeof(buff));
+    EXPECT_EQ(14, n);
+    EXPECT_EQ(0, memcmp("abcdefghijklmn", buff, 14));
+}
+
+TEST(Buffers, Output)
+{
+    Buffers b;
+    BufferOutput out(& b, 8);
+    FmtOut fmt(& out);
+
+    fmt.printf("hello %s %d", "world", 1234);
+
+    char buff[64];
+    const int n = b.read((uint8_t*) buff, sizeof(buff) - 1);
+    buff[n] = '\0';
+    EXPECT_STREQ("hello world 1234", buff);
+}
+
+    /*
+     *  Throughput, small and large transfers
+     */
+
+TEST(RingBuffer, Bench)
+{
+    const int total = 4 * 1024 * 1024;
+    const int sizes[] = { 16, 4096, 0 };
+    uint8_t *block = (uint8_t*) malloc(4096);
+    memset(block, 0x55, 4096);
+
+    for (const int *size = sizes; *size; size++)
+    {
+        RingBuffer<uint8_t> buffer(8192, 0, 0);
+
+        // one element at a time (the old add / get loops)
+        Stopwatch sw;
+        for (int done = 0; done < total; done += *size)
+        {
+            for (int i = 0; i < *size; i++)
+            {
+                buffer.add(block[i]);
+            }
+            for (int i = 0; i < *size; i++)
+            {
+                buffer.get(& block[i], 1);
+            }
+        }
+        const double t_item = sw.elapsed();
+
+        sw.reset();
+        for (int done = 0; done < total; done += *size)
+        {
+            buffer.add(block, *size);
+            buffer.get(block, *size);
+        }
+        const double t_bulk = sw.elapsed();
+
+        sw.reset();
+        for (int done = 0; done < total; done += *size)
+        {
+            Buffer b(*size);
+            b.write(block, *size);
+            b.read(block, *size);
+        }
+        const double t_buffer = sw.elapsed();
+
+        PO_INFO("%d byte transfers : RingBuffer per-item=%.1f MB/s bulk=%.1f MB/s Buffer=%.1f MB/s", *size,
+                total / (t_item * 1e6), total / (t_bulk * 1e6), total / (t_buffer * 1e6));
+    }
+
+    free(block);
+}
+
+    /*
+     *  Pooled segments
+     */
+
+TEST(BufferPool, Reuse)
+{
+    BufferPool pool(16, 2);
+    // a block and a view each
+    EXPECT_EQ(4, pool.get_allocs());
+
+    {
+        Buffers b(& pool);
+        for (int loop = 0; loop < 100; loop++)
+        {
+            EXPECT_EQ(40, b.write((const uint8_t*) "0123456789012345678901234567890123456789", 40, 16));
+            uint8_t buff[64];
+            EXPECT_EQ(40, b.read(buff, sizeof(buff)));
+            EXPECT_EQ(0, memcmp("0123456789012345678901234567890123456789", buff, 40));
+        }
+    }
+
+    // 3 segments in use at most
+    EXPECT_EQ(6, pool.get_allocs());
+}
+
+TEST(BufferPool, Share)
+{
+    BufferPool pool(8);
+    Buffers a(& pool);
+    Buffers b(& pool);
+
+    a.write((const uint8_t*) "hello world", 11, 8);
+    const int allocs = pool.get_allocs();
+
+    // b sees the same bytes, only the views are new
+    a.share(& b);
+    EXPECT_EQ(11, b.count());
+    EXPECT_EQ(allocs + 2, pool.get_allocs());
+
+    char buff[32];
+    int n = a.read((uint8_t*) buff, sizeof(buff));
+    buff[n] = '\0';
+    EXPECT_STREQ("hello world", buff);
+
+    // released by a, still held by b
+    n = b.read((uint8_t*) buff, sizeof(buff));
+    buff[n] = '\0';
+    EXPECT_STREQ("hello world", buff);
+
+    // the first block is back in the pool,
+    // a still holds the second one, as it isn't full yet
+    Buffers c(& pool);
+    c.write((const uint8_t*) "0123456789abcdef", 16, 8);
+    EXPECT_EQ(allocs + 3, pool.get_allocs());
+}
+
+    /*
+     *  Export to writev() without copying
+     */
+
+TEST(Buffers, Iov)
+{
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    BufferPool pool(8);
+    Buffers b(& pool);
+    const char *text = "the quick brown fox jumps over the lazy dog";
+    const int len = int(strlen(text));
+    b.write((const uint8_t*) text, len, 8);
+
+    struct iovec iov[4];
+    int sent = 0;
+    while (b.count())
+    {
+        // at most 4 segments at a time
+        const int n = b.get_iov(iov, 4);
+        EXPECT_TRUE(n <= 4);
+        const ssize_t w = writev(fds[0], iov, n);
+        ASSERT_TRUE(w > 0);
+        EXPECT_EQ(int(w), b.consume(int(w)));
+        sent += int(w);
+    }
+    EXPECT_EQ(len, sent);
+
+    char buff[64];
+    int got = 0;
+    while (got < len)
+    {
+        const ssize_t r = ::read(fds[1], & buff[got], sizeof(buff) - 1 - size_t(got));
+        ASSERT_TRUE(r > 0);
+        got += int(r);
+    }
+    buff[got] = '\0';
+    EXPECT_STREQ(text, buff);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+class StringSocket : public Socket
+{
+public:
+    std::string text;
+    int calls;
+
+    StringSocket() : calls(0) { }
+
+    virtual int send(const uint8_t *data, size_t len) override
+    {
+        calls += 1;
+        text.append((const char*) data, len);
+        return int(len);
+    }
+    virtual int recv(uint8_t *, size_t) override { return 0; }
+};
+
+TEST(Buffers, SendV)
+{
+    Buffers b;
+    b.write((const uint8_t*) "abcdefghij", 10, 4);
+
+    struct iovec iov[8];
+    const int n = b.get_iov(iov, 8);
+    EXPECT_EQ(3, n);
+
+    // the default sendv() calls send() per segment
+    StringSocket sock;
+    EXPECT_EQ(10, sock.sendv(iov, n));
+    EXPECT_EQ(3, sock.calls);
+    EXPECT_STREQ("abcdefghij", sock.text.c_str());
+    EXPECT_EQ(10, b.consume(100));
+    EXPECT_EQ(0, b.count());
+}
+
+    /*
+     *  Heap allocations, pooled vs not
+     */
+
+static int write_read(Buffers *b, uint8_t *block, int total, int seg)
+{
+    int allocs = 0;
+    for (int done = 0; done < total; done += 4096)
+    {
+        // count the segments this write adds
+        const int before = b->get_size();
+        b->write(block, 4096, seg);
+        allocs += (b->get_size() - before) / seg;
+        b->read(block, 4096);
+    }
+    return allocs;
+}
+
+TEST(BufferPool, Bench)
+{
+    const int total = 16 * 1024 * 1024;
+    const int seg = 512;
+    uint8_t *block = (uint8_t*) malloc(4096);
+    memset(block, 0x55, 4096);
+
+    Buffers heap;
+    Stopwatch sw;
+    // a Buffer object and its data each
+    const int heap_allocs = 2 * write_read(& heap, block, total, seg);
+    const double t_heap = sw.elapsed();
+
+    BufferPool pool(seg);
+    Buffers pooled(& pool);
+    sw.reset();
+    write_read(& pooled, block, total, seg);
+    const double t_pool = sw.elapsed();
+
+    PO_INFO("%d MB in %d byte segments : heap allocs=%d %.1f MB/s, pool allocs=%d %.1f MB/s",
+            total >> 20, seg, heap_allocs, total / (t_heap * 1e6), pool.get_allocs(), total / (t_pool * 1e6));
+
+    free(block);
+}
+
 //  FIN
@@ -6,11 +6,14 @@
 
 #include "panglos/debug.h"
 
+#include "panglos/time.h"
 #include "panglos/object.h"
 #include "panglos/list.h"
 
 #include "panglos/device.h"
 
+#include "bench.h"
+
     /*
      *
      */
@@ -363,4 +366,210 @@ TEST(Device, Repeated)
     delete objects;
 }
 
+    /*
+     *  Parallel init
+     */
+
+TEST(Device, Parallel)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        List<Device*> devices(Device::get_next);
+
+        Objects *objects = Objects::create();
+
+        struct DevInit di = {
+            .objects = objects,
+            .verbose = false,
+        };
+
+        // add_devices() uses statics, bound to the first DevInit
+        static const char *needs_i2c[] = { "sda0", "scl0", 0 };
+        static const char *needs_mcp23s17[] = { "i2c0", 0 };
+        static const char *needs_keyboard[] = { "mcp23s17", "key_reset", "key_irq", 0 };
+
+        Device sda("sda0", 0, init_gpio, & di);
+        Device scl("scl0", 0, init_gpio, & di);
+        Device i2c("i2c0", needs_i2c, init_i2c, & di);
+        Device mcp23s17("mcp23s17", needs_mcp23s17, init_mcp23s17, & di);
+        Device keyboard("keyboard", needs_keyboard, init_keyboard, & di);
+        Device reset("key_reset", 0, init_gpio, & di);
+        Device irq("key_irq", 0, init_gpio, & di);
+
+        devices.push(& sda, 0);
+        devices.push(& keyboard, 0);
+        devices.push(& scl, 0);
+        devices.push(& mcp23s17, 0);
+        devices.push(& i2c, 0);
+        devices.push(& reset, 0);
+        devices.push(& irq, 0);
+
+        list_shuffle(devices);
+
+        List<Device*> done(Device::get_next);
+        bool ok = Device::init_devices_parallel(devices, 4, false, & done);
+        EXPECT_TRUE(ok);
+        EXPECT_TRUE(devices.empty());
+        EXPECT_EQ(7, done.size(0));
+
+        // the init fns check their needs were initialised first
+        EXPECT_TRUE(objects->get("scl0"));
+        EXPECT_TRUE(objects->get("sda0"));
+        EXPECT_TRUE(objects->get("i2c0"));
+        EXPECT_TRUE(objects->get("keyboard"));
+        EXPECT_TRUE(objects->get("mcp23s17"));
+
+        delete objects;
+    }
+}
+
+TEST(Device, ParallelFail)
+{
+    List<Device*> devices(Device::get_next);
+
+    Objects *objects = Objects::create();
+
+    struct DevInit di = {
+        .objects = objects,
+        .verbose = false,
+    };
+
+    static const char *needs_fail[] = { "bus", 0 };
+    static const char *needs_sensor[] = { "fail", 0 };
+    static const char *needs_soft[] = { "bus", 0 };
+    static const char *needs_user[] = { "soft", 0 };
+
+    Device bus("bus", 0, init_gpio, & di);
+    Device soft("soft", needs_soft, init_fail, 0, Device::F_CAN_FAIL);
+    Device user("user", needs_user, init_gpio, & di);
+    Device fail("fail", needs_fail, init_fail, 0);
+    Device sensor("sensor", needs_sensor, init_gpio, & di);
+
+    devices.push(& bus, 0);
+    devices.push(& soft, 0);
+    devices.push(& user, 0);
+
+    // F_CAN_FAIL devices don't stop their users
+    bool ok = Device::init_devices_parallel(devices, 2);
+    EXPECT_TRUE(ok);
+    EXPECT_TRUE(objects->get("user"));
+
+    devices.push(& bus, 0);
+    devices.push(& fail, 0);
+    devices.push(& sensor, 0);
+
+    ok = Device::init_devices_parallel(devices, 2);
+    EXPECT_FALSE(ok);
+    EXPECT_FALSE(objects->get("sensor"));
+    // the failed device and its users are left on the todo list
+    EXPECT_TRUE(devices.find(Device::match_name, (void*) "fail", 0));
+    EXPECT_TRUE(devices.find(Device::match_name, (void*) "sensor", 0));
+    EXPECT_FALSE(devices.find(Device::match_name, (void*) "bus", 0));
+
+    delete objects;
+}
+
+TEST(Device, ParallelLoop)
+{
+    List<Device*> devices(Device::get_next);
+
+    static const char *needs_a[] = { "c", 0 };
+    static const char *needs_b[] = { "a", 0 };
+    static const char *needs_c[] = { "b", 0 };
+    static const char *needs_d[] = { "a", 0 };
+
+    // nothing is initialised if there is a loop
+    static Device a("a", needs_a, init_fail, 0);
+    static Device b("b", needs_b, init_fail, 0);
+    static Device c("c", needs_c, init_fail, 0);
+    static Device d("d", needs_d, init_fail, 0);
+    static Device e("e", 0, init_fail, 0);
+
+    devices.push(& a, 0);
+    devices.push(& b, 0);
+    devices.push(& c, 0);
+    devices.push(& d, 0);
+    devices.push(& e, 0);
+
+    bool ok = Device::init_devices_parallel(devices, 2);
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(5, devices.size(0));
+}
+
+    /*
+     *  Boot time : sensors on several buses, each with a slow probe
+     */
+
+static bool init_probe(Device *dev, void *arg)
+{
+    IGNORE(dev);
+    ASSERT(arg);
+    Time::msleep(*(int*) arg);
+    return true;
+}
+
+TEST(Device, BootTime)
+{
+    const int buses = 4;
+    const int sensors = 6;
+    int bus_ms = 5;
+    int probe_ms = 10;
+
+    static const char *needs_gpio[] = { "gpio", 0 };
+    char bus_names[buses][8];
+    const char *bus_needs[buses][2];
+    char sensor_names[buses * sensors][12];
+
+    Device gpio("gpio", 0, init_probe, & bus_ms);
+    Device bus[buses];
+    Device sensor[buses * sensors];
+
+    for (int b = 0; b < buses; b++)
+    {
+        snprintf(bus_names[b], sizeof(bus_names[b]), "i2c%d", b);
+        bus_needs[b][0] = bus_names[b];
+        bus_needs[b][1] = 0;
+        bus[b] = Device(bus_names[b], needs_gpio, init_probe, & bus_ms);
+
+        for (int i = 0; i < sensors; i++)
+        {
+            const int n = (b * sensors) + i;
+            snprintf(sensor_names[n], sizeof(sensor_names[n]), "sensor%d", n);
+            sensor[n] = Device(sensor_names[n], bus_needs[b], init_probe, & probe_ms,
+                    (i == 0) ? Device::F_CAN_FAIL : Device::F_NONE);
+        }
+    }
+
+    double serial = 0;
+    for (int threads = 0; threads <= 8; threads += 4)
+    {
+        List<Device*> devices(Device::get_next);
+        devices.push(& gpio, 0);
+        for (int b = 0; b < buses; b++)
+        {
+            devices.push(& bus[b], 0);
+        }
+        for (int i = 0; i < (buses * sensors); i++)
+        {
+            devices.push(& sensor[i], 0);
+        }
+
+        Stopwatch sw;
+        bool ok = threads ? Device::init_devices_parallel(devices, threads) : Device::init_devices(devices);
+        const double t = sw.elapsed();
+        EXPECT_TRUE(ok);
+        EXPECT_TRUE(devices.empty());
+        PO_INFO("threads=%d boot=%.1f ms", threads, t * 1e3);
+
+        if (!threads)
+        {
+            serial = t;
+        }
+        else
+        {
+            EXPECT_LT(t * 2, serial);
+        }
+    }
+}
+
 //  FIN
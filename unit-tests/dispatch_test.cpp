@@ -1,4 +1,6 @@
 
+#include <atomic>
+
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
@@ -6,6 +8,8 @@
 #include "panglos/semaphore.h"
 #include "panglos/dispatch.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
 static void irq_task(void *arg)
@@ -67,4 +71,161 @@ TEST(Dispatch, Test)
     delete thread;
 }
 
+TEST(Dispatch, LockFree)
+{
+    Dispatch task(Dispatch::LOCK_FREE);
+
+    Thread *thread = Thread::create("xx");
+    thread->start(irq_task, & task);
+
+    Callback cb1("hello");
+    Callback cb2("world");
+
+    task.put(& cb1);
+    task.put(& cb2);
+
+    cb1.wait();
+    cb2.wait();
+    EXPECT_STREQ("hello", cb1.text);
+    EXPECT_STREQ("world", cb2.text);
+
+    // callbacks can be reused once run
+    cb1.text = 0;
+    task.put(& cb1);
+    cb1.wait();
+    EXPECT_STREQ("hello", cb1.text);
+
+    task.kill();
+
+    thread->join();
+    delete thread;
+}
+
+    /*
+     *  Many producers : stress test and throughput
+     */
+
+class Counter : public Dispatch::Callback
+{
+public:
+    std::atomic<int> *count;
+    int total;
+    int producer;
+    int seq;
+    int *last;
+    Semaphore *done;
+
+    Counter() : count(0), total(0), producer(0), seq(0), last(0), done(0) { }
+
+    virtual void execute() override
+    {
+        // callbacks from any one producer must run in order
+        EXPECT_EQ(last[producer] + 1, seq);
+        last[producer] = seq;
+
+        if (++(*count) == total)
+        {
+            done->post();
+        }
+    }
+};
+
+struct Producer
+{
+    Dispatch *dispatch;
+    Counter *cbs;
+    int n;
+};
+
+static void producer(void *arg)
+{
+    ASSERT(arg);
+    struct Producer *p = (struct Producer *) arg;
+
+    for (int i = 0; i < p->n; i++)
+    {
+        p->dispatch->put(& p->cbs[i]);
+    }
+}
+
+static double dispatch_run(Dispatch::Mode mode, int threads, int n)
+{
+    Dispatch task(mode);
+    Thread *thread = Thread::create("dispatch");
+    thread->start(irq_task, & task);
+
+    std::atomic<int> count(0);
+    Semaphore *done = Semaphore::create();
+    int *last = new int[threads];
+    struct Producer *ps = new struct Producer[threads];
+
+    for (int t = 0; t < threads; t++)
+    {
+        last[t] = -1;
+        ps[t].dispatch = & task;
+        ps[t].cbs = new Counter[n];
+        ps[t].n = n;
+        for (int i = 0; i < n; i++)
+        {
+            Counter *c = & ps[t].cbs[i];
+            c->count = & count;
+            c->total = threads * n;
+            c->producer = t;
+            c->seq = i;
+            c->last = last;
+            c->done = done;
+        }
+    }
+
+    Thread **producers = new Thread*[threads];
+    for (int t = 0; t < threads; t++)
+    {
+        producers[t] = Thread::create("producer");
+    }
+
+    Stopwatch sw;
+    for (int t = 0; t < threads; t++)
+    {
+        producers[t]->start(producer, & ps[t]);
+    }
+    done->wait();
+    const double secs = sw.elapsed();
+
+    for (int t = 0; t < threads; t++)
+    {
+        producers[t]->join();
+        delete producers[t];
+    }
+    delete[] producers;
+
+    EXPECT_EQ(threads * n, count);
+
+    task.kill();
+    thread->join();
+    delete thread;
+
+    for (int t = 0; t < threads; t++)
+    {
+        delete[] ps[t].cbs;
+    }
+    delete[] ps;
+    delete[] last;
+    delete done;
+    return secs;
+}
+
+TEST(Dispatch, Bench)
+{
+    const int threads = 8;
+    const int n = 20000;
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        const Dispatch::Mode m = mode ? Dispatch::LOCK_FREE : Dispatch::LOCKED;
+        const double secs = dispatch_run(m, threads, n);
+        PO_INFO("%-9s producers=%d callbacks=%d %.2f M/s", mode ? "lock-free" : "locked",
+                threads, threads * n, ((threads * n) / secs) / 1e6);
+    }
+}
+
 //  FIN
@@ -1,11 +1,19 @@
 
+#include <sched.h>
+
+#include <atomic>
+
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
 #include "panglos/mutex.h"
+#include "panglos/pool.h"
+#include "panglos/thread.h"
 
 #include "panglos/app/event.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
 TEST(Event, Unlink)
@@ -50,4 +58,502 @@ TEST(Event, Handle)
     EventHandler::unlink_handlers(Event::KEY);
 }
 
+    /*
+     *  Handlers are called most recent first, until one returns true
+     */
+
+static bool _record(void *arg, Event *event, Event::Queue *q)
+{
+    IGNORE(q);
+    ASSERT(arg);
+    int *calls = (int*) arg;
+    *calls += 1;
+    return event->payload.u32.d == 1;
+}
+
+TEST(Event, Order)
+{
+    int a = 0, b = 0, c = 0;
+
+    EventHandler::add_handler(Event::KEY, _record, & a);
+    EventHandler::add_handler(Event::KEY, _record, & b);
+    EventHandler::add_handler(Event::KEY, _record, & c);
+
+    Event event = { .type = Event::KEY };
+    event.payload.u32.d = 1;
+    EventHandler *eh = EventHandler::handle_event(0, & event);
+    ASSERT_TRUE(eh);
+    EXPECT_EQ(& c, eh->arg);
+    EXPECT_EQ(0, a);
+    EXPECT_EQ(0, b);
+    EXPECT_EQ(1, c);
+
+    // remove the first, the next in line handles it
+    EXPECT_TRUE(EventHandler::del_handler(eh));
+    eh = EventHandler::handle_event(0, & event);
+    ASSERT_TRUE(eh);
+    EXPECT_EQ(& b, eh->arg);
+
+    // nobody accepts it : all are called
+    event.payload.u32.d = 0;
+    EXPECT_FALSE(EventHandler::handle_event(0, & event));
+    EXPECT_EQ(1, a);
+    EXPECT_EQ(2, b);
+
+    EventHandler::unlink_handlers(Event::KEY);
+    EXPECT_FALSE(EventHandler::handle_event(0, & event));
+    EXPECT_EQ(1, a);
+}
+
+    /*
+     *  Handlers deleted during dispatch are freed when it ends
+     */
+
+static bool _unlink(void *arg, Event *event, Event::Queue *q)
+{
+    IGNORE(arg);
+    IGNORE(event);
+    IGNORE(q);
+    EventHandler::unlink_handlers(Event::MQTT);
+    return true;
+}
+
+TEST(Event, ReclaimInDispatch)
+{
+    BlockPool *pool = PoolAllocator::get_pool(sizeof(EventHandler));
+    ASSERT_TRUE(pool);
+    const int used = pool->get_stats().used;
+
+    EventHandler::add_handler(Event::MQTT, 0, 0);
+    EventHandler::add_handler(Event::MQTT, 0, 0);
+    EventHandler::add_handler(Event::KEY, _unlink, 0);
+    EXPECT_EQ(used + 3, pool->get_stats().used);
+
+    // the MQTT handlers are retired while a dispatch is running
+    Event event = { .type = Event::KEY };
+    EXPECT_TRUE(EventHandler::handle_event(0, & event));
+    // and freed as it ends, not at the next registration
+    EXPECT_EQ(used + 1, pool->get_stats().used);
+
+    EventHandler::unlink_handlers(Event::KEY);
+    EXPECT_EQ(used, pool->get_stats().used);
+}
+
+TEST(Event, UserCodes)
+{
+    Event::Type codes[40];
+    int calls[40] = { 0 };
+
+    // grows the table
+    for (int i = 0; i < 40; i++)
+    {
+        codes[i] = EventHandler::get_user_code();
+        EXPECT_GT(codes[i], Event::USER);
+        EventHandler::add_handler(codes[i], _record, & calls[i]);
+    }
+
+    for (int i = 0; i < 40; i++)
+    {
+        Event event = { .type = codes[i] };
+        event.payload.u32.d = 1;
+        EXPECT_TRUE(EventHandler::handle_event(0, & event));
+    }
+
+    for (int i = 0; i < 40; i++)
+    {
+        EXPECT_EQ(1, calls[i]);
+        EventHandler::unlink_handlers(codes[i]);
+    }
+
+    // an unregistered code beyond the table
+    Event event = { .type = Event::Type(codes[39] + 100) };
+    EXPECT_FALSE(EventHandler::handle_event(0, & event));
+}
+
+    /*
+     *  Dispatch while other threads register / remove handlers
+     */
+
+static bool _count(void *arg, Event *event, Event::Queue *q)
+{
+    IGNORE(event);
+    IGNORE(q);
+    ASSERT(arg);
+    std::atomic<int> *n = (std::atomic<int>*) arg;
+    *n += 1;
+    return false;
+}
+
+struct ChurnArg
+{
+    std::atomic<bool> dead;
+    std::atomic<int> calls;
+};
+
+static void churn(void *arg)
+{
+    ASSERT(arg);
+    ChurnArg *ca = (ChurnArg*) arg;
+
+    while (!ca->dead)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            EventHandler::add_handler(Event::MQTT, _count, & ca->calls);
+        }
+        EventHandler::unlink_handlers(Event::MQTT);
+        sched_yield();
+    }
+}
+
+TEST(Event, Concurrent)
+{
+    std::atomic<int> key_calls(0);
+    EventHandler::add_handler(Event::KEY, _count, & key_calls);
+
+    ChurnArg ca;
+    ca.dead = false;
+    ca.calls = 0;
+    Thread *thread = Thread::create("churn");
+    thread->start(churn, & ca);
+
+    Event key = { .type = Event::KEY };
+    Event mqtt = { .type = Event::MQTT };
+    for (int i = 0; i < 20000; i++)
+    {
+        EXPECT_FALSE(EventHandler::handle_event(0, & key));
+        EXPECT_FALSE(EventHandler::handle_event(0, & mqtt));
+        if ((i % 100) == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    ca.dead = true;
+    thread->join();
+    delete thread;
+
+    // the KEY handler is unaffected by the MQTT churn
+    EXPECT_EQ(20000, key_calls);
+    EventHandler::unlink_handlers(Event::KEY);
+}
+
+    /*
+     *  Dispatch cost with many modules registered
+     */
+
+TEST(Event, Bench)
+{
+    std::atomic<int> calls(0);
+
+    // 4 handlers for each of the built-in types, and 32 user codes
+    for (int type = Event::IDLE; type <= Event::USER; type++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            EventHandler::add_handler(Event::Type(type), _count, & calls);
+        }
+    }
+    Event::Type codes[32];
+    for (int i = 0; i < 32; i++)
+    {
+        codes[i] = EventHandler::get_user_code();
+        EventHandler::add_handler(codes[i], _count, & calls);
+    }
+
+    const int loops = 200000;
+    Event event = { .type = Event::KEY };
+
+    Stopwatch sw;
+    for (int i = 0; i < loops; i++)
+    {
+        EventHandler::handle_event(0, & event);
+    }
+    const double t = sw.elapsed();
+
+    EXPECT_EQ(loops * 4, calls);
+    PO_INFO("dispatch : %.0f ns per event", (t * 1e9) / loops);
+
+    for (int type = Event::IDLE; type <= Event::USER; type++)
+    {
+        EventHandler::unlink_handlers(Event::Type(type));
+    }
+    for (int i = 0; i < 32; i++)
+    {
+        EventHandler::unlink_handlers(codes[i]);
+    }
+}
+
+    /*
+     *  Priority lanes and coalescing
+     */
+
+TEST(Event, Priority)
+{
+    Event::Queue *queue = Event::create_queue(16, 0);
+
+    const Event::Type types[] = {
+        Event::MQTT, Event::DISPLAY, Event::UART, Event::KEY, Event::MQTT, Event::STOP,
+    };
+    for (int i = 0; i < 6; i++)
+    {
+        Event event = { .type = types[i] };
+        event.payload.u32.d = uint32_t(i);
+        EXPECT_TRUE(event.put(queue));
+    }
+    Event probe;
+    EXPECT_EQ(6, probe.queued(queue));
+
+    // HIGH, then NORMAL, then LOW. FIFO within each.
+    const int expect[] = { 3, 5, 0, 2, 4, 1 };
+    for (int i = 0; i < 6; i++)
+    {
+        Event event;
+        EXPECT_TRUE(event.get(queue, 1));
+        EXPECT_EQ(types[expect[i]], event.type);
+        EXPECT_EQ(uint32_t(expect[i]), event.payload.u32.d);
+    }
+
+    Event event;
+    EXPECT_FALSE(event.get(queue, 1));
+    delete queue;
+}
+
+    /*
+     *  The lanes share one pool of slots : they are reused across lanes
+     */
+
+TEST(Event, SharedSlots)
+{
+    const int num = 4;
+    Event::Queue *queue = Event::create_queue(num, 0);
+    Event probe;
+
+    for (int cycle = 0; cycle < 10; cycle++)
+    {
+        // a whole queue of HIGH, then of NORMAL, then LOW
+        const Event::Type types[] = { Event::KEY, Event::MQTT, Event::DISPLAY };
+        for (int t = 0; t < 3; t++)
+        {
+            for (int i = 0; i < ((types[t] == Event::DISPLAY) ? 1 : num); i++)
+            {
+                Event event = { .type = types[t] };
+                event.payload.u32.d = uint32_t(i);
+                EXPECT_TRUE(event.put(queue));
+            }
+            // DISPLAY coalesces into whichever slot it was given
+            Event event = { .type = types[t] };
+            event.payload.u32.d = 100;
+            if (types[t] == Event::DISPLAY)
+            {
+                EXPECT_TRUE(event.put(queue));
+            }
+
+            const int n = (types[t] == Event::DISPLAY) ? 1 : num;
+            EXPECT_EQ(n, probe.queued(queue));
+            for (int i = 0; i < n; i++)
+            {
+                EXPECT_TRUE(event.get(queue, 1));
+                EXPECT_EQ(types[t], event.type);
+                EXPECT_EQ((types[t] == Event::DISPLAY) ? 100u : uint32_t(i), event.payload.u32.d);
+            }
+        }
+
+        // mixed : a pending DISPLAY is still replaced after its slot has moved
+        Event event = { .type = Event::MQTT };
+        EXPECT_TRUE(event.put(queue));
+        event.type = Event::DISPLAY;
+        event.payload.u32.d = 1;
+        EXPECT_TRUE(event.put(queue));
+        EXPECT_TRUE(event.get(queue, 1));
+        EXPECT_EQ(Event::MQTT, event.type);
+        event.type = Event::DISPLAY;
+        event.payload.u32.d = 2;
+        EXPECT_TRUE(event.put(queue));
+        EXPECT_EQ(1, probe.queued(queue));
+        EXPECT_TRUE(event.get(queue, 1));
+        EXPECT_EQ(Event::DISPLAY, event.type);
+        EXPECT_EQ(2u, event.payload.u32.d);
+    }
+
+    EXPECT_FALSE(probe.get(queue, 1));
+    delete queue;
+}
+
+TEST(Event, Coalesce)
+{
+    Event::Queue *queue = Event::create_queue(4, 0);
+    const Event::Type user = EventHandler::get_user_code();
+    Event::set_priority(queue, user, Event::HIGH, true);
+
+    // more than the queue can hold, but each replaces the last
+    for (int i = 0; i < 100; i++)
+    {
+        Event event = { .type = Event::LOCATION };
+        event.payload.location.lat = float(i);
+        EXPECT_TRUE(event.put(queue));
+        event.type = user;
+        event.payload.u32.d = uint32_t(i);
+        EXPECT_TRUE(event.put(queue));
+    }
+    Event probe;
+    EXPECT_EQ(2, probe.queued(queue));
+
+    Event::Stats stats;
+    Event::get_stats(queue, & stats);
+    EXPECT_EQ(198, stats.coalesced);
+    EXPECT_EQ(0, stats.dropped);
+    EXPECT_EQ(1, stats.queued[Event::HIGH]);
+    EXPECT_EQ(0, stats.queued[Event::NORMAL]);
+    EXPECT_EQ(1, stats.max_queued[Event::LOW]);
+
+    Event event;
+    EXPECT_TRUE(event.get(queue, 1));
+    EXPECT_EQ(user, event.type);
+    EXPECT_EQ(99u, event.payload.u32.d);
+    EXPECT_TRUE(event.get(queue, 1));
+    EXPECT_EQ(Event::LOCATION, event.type);
+    EXPECT_EQ(99.0f, event.payload.location.lat);
+
+    // once taken, the next one is queued again
+    event.put(queue);
+    event.put(queue);
+    EXPECT_EQ(1, probe.queued(queue));
+    EXPECT_TRUE(event.get(queue, 1));
+
+    // not coalesced : blocks when full, so don't fill it
+    Event::set_priority(queue, Event::LOCATION, Event::LOW, false);
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(event.put(queue));
+    }
+    EXPECT_EQ(4, probe.queued(queue));
+    Event::get_stats(queue, & stats);
+    EXPECT_EQ(4, stats.max_queued[Event::LOW]);
+
+    delete queue;
+}
+
+    /*
+     *  A KEY event should overtake a backlog of MQTT events
+     */
+
+struct Consumer
+{
+    Event::Queue *queue;
+    Stopwatch sw;
+    double key_latency;
+    double drained;
+};
+
+static void consume(void *arg)
+{
+    ASSERT(arg);
+    Consumer *c = (Consumer*) arg;
+
+    while (true)
+    {
+        Event event;
+        if (!event.get(c->queue, 0))
+        {
+            continue;
+        }
+
+        if (event.type == Event::STOP)
+        {
+            c->drained = c->sw.elapsed();
+            break;
+        }
+
+        if (event.type == Event::KEY)
+        {
+            c->key_latency = c->sw.elapsed();
+            continue;
+        }
+
+        // some work for each event
+        Stopwatch busy;
+        while (busy.elapsed() < 2e-6)
+        {
+        }
+    }
+}
+
+static double backlog_latency(Event::Priority priority, double *drained)
+{
+    const int backlog = 10000;
+    Event::Queue *queue = Event::create_queue(backlog + 2, 0);
+    Event::set_priority(queue, Event::KEY, priority);
+    // STOP marks the end of the backlog
+    Event::set_priority(queue, Event::STOP, Event::LOW);
+
+    for (int i = 0; i < backlog; i++)
+    {
+        Event event = { .type = Event::MQTT };
+        event.put(queue);
+    }
+
+    Consumer c;
+    c.queue = queue;
+    c.key_latency = 0;
+    c.drained = 0;
+
+    Thread *thread = Thread::create("consume");
+    c.sw.reset();
+    thread->start(consume, & c);
+
+    Event key = { .type = Event::KEY };
+    key.put(queue);
+    key.stop(queue);
+
+    thread->join();
+    delete thread;
+
+    Event::Stats stats;
+    Event::get_stats(queue, & stats);
+    EXPECT_LE(backlog, stats.max_queued[Event::NORMAL]);
+    delete queue;
+
+    *drained = c.drained;
+    return c.key_latency;
+}
+
+TEST(Event, Latency)
+{
+    double drained;
+    const double fifo = backlog_latency(Event::NORMAL, & drained);
+    PO_INFO("FIFO : key latency=%.3f ms, backlog %.3f ms", fifo * 1e3, drained * 1e3);
+
+    const double high = backlog_latency(Event::HIGH, & drained);
+    PO_INFO("HIGH : key latency=%.3f ms, backlog %.3f ms", high * 1e3, drained * 1e3);
+
+    EXPECT_LT(high * 10, fifo);
+}
+
+    /*
+     *
+     */
+
+TEST(Event, InPlace)
+{
+    Event::Queue *queue = Event::create_queue(4, 0);
+
+    Event *event = Event::reserve(queue);
+    EXPECT_TRUE(event);
+    event->type = Event::DISPLAY;
+    strcpy(event->payload.display.text, "hello");
+    Event::commit(queue, event);
+    EXPECT_EQ(1, event->queued(queue));
+
+    Event *e = Event::peek(queue, 1);
+    EXPECT_EQ(event, e);
+    EXPECT_EQ(Event::DISPLAY, e->type);
+    EXPECT_STREQ("hello", e->payload.display.text);
+    Event::release(queue, e);
+
+    EXPECT_FALSE(Event::peek(queue, 1));
+
+    delete queue;
+}
+
 //  FIN
@@ -1,4 +1,6 @@
 
+#include <stdlib.h>
+
 #include <gtest/gtest.h>
 
 #include <panglos/debug.h>
@@ -7,6 +9,8 @@
 
 #include <panglos/event_queue.h>
 
+#include "bench.h"
+
 using namespace panglos;
 
     /*
@@ -357,4 +361,191 @@ TEST(EventQueue, Wrap)
     }
 }
 
+    /*
+     *  Heap backend
+     */
+
+static void pop_order(EvQueue & queue, panglos::Time::tick_t t, panglos::Time::tick_t *ticks, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        EvQueue::Event *ev = queue.pop(t);
+        EXPECT_TRUE(ev);
+        if (!ev) return;
+        EXPECT_EQ(ticks[i], ev->when);
+    }
+    EXPECT_FALSE(queue.pop(t));
+}
+
+TEST(EventQueue, HeapAddDel)
+{
+    EvQueue queue(0, EvQueue::HEAP);
+
+    TestEvent ev1(100);
+    TestEvent ev2(200);
+    TestEvent ev3(50);
+    TestEvent ev4(150);
+
+    queue.add(& ev1);
+    EXPECT_EQ(& ev1, queue.heap.head);
+    queue.add(& ev2);
+    EXPECT_EQ(& ev1, queue.heap.head);
+    queue.add(& ev3);
+    EXPECT_EQ(& ev3, queue.heap.head);
+    queue.add(& ev4);
+    EXPECT_EQ(4, queue.heap.size(0));
+    // list is not used
+    EXPECT_TRUE(queue.events.empty());
+
+    // delete a non-head event
+    EXPECT_TRUE(queue.del(& ev1));
+    EXPECT_FALSE(queue.del(& ev1));
+    EXPECT_EQ(& ev3, queue.heap.head);
+    EXPECT_EQ(3, queue.heap.size(0));
+
+    queue.reschedule(& ev3, 175);
+    EXPECT_EQ(& ev4, queue.heap.head);
+
+    panglos::Time::tick_t ticks[] = { 150, 175, 200 };
+    pop_order(queue, 1000, ticks, 3);
+    EXPECT_TRUE(queue.heap.empty());
+    EXPECT_EQ(0, queue.heap.size(0));
+}
+
+TEST(EventQueue, HeapWrap)
+{
+    EvQueue queue(0, EvQueue::HEAP);
+
+    TestEvent ev1(100);
+    TestEvent ev2(0xfffffff1);
+    TestEvent ev3(200);
+    TestEvent ev4(0xfffffff9);
+    TestEvent ev5(0);
+
+    queue.add(& ev1);
+    queue.add(& ev2);
+    queue.add(& ev3);
+    queue.add(& ev4);
+    queue.add(& ev5);
+
+    EXPECT_FALSE(queue.run(0xfffffff0));
+
+    panglos::Time::tick_t t1[] = { 0xfffffff1, 0xfffffff9, 0 };
+    pop_order(queue, 0, t1, 3);
+
+    EXPECT_FALSE(queue.run(99));
+    panglos::Time::tick_t t2[] = { 100, 200 };
+    pop_order(queue, 1000, t2, 2);
+}
+
+TEST(EventQueue, HeapRandom)
+{
+    // Compare the heap against the sorted list
+    EvQueue list;
+    EvQueue heap(0, EvQueue::HEAP);
+
+    const int num = 1000;
+    TestEvent *le = new TestEvent[num];
+    TestEvent *he = new TestEvent[num];
+
+    srand(1234);
+    for (int i = 0; i < num; i++)
+    {
+        const panglos::Time::tick_t t = panglos::Time::tick_t(rand() % 10000);
+        le[i].when = he[i].when = t;
+        list.add(& le[i]);
+        heap.add(& he[i]);
+    }
+
+    // remove some at random
+    for (int i = 0; i < num; i += 3)
+    {
+        EXPECT_TRUE(list.del(& le[i]));
+        EXPECT_TRUE(heap.del(& he[i]));
+    }
+
+    for (panglos::Time::tick_t t = 0; t <= 10000; t += 100)
+    {
+        while (true)
+        {
+            EvQueue::Event *l = list.pop(t);
+            EvQueue::Event *h = heap.pop(t);
+            EXPECT_EQ(!l, !h);
+            if (!(l && h)) break;
+            EXPECT_EQ(l->when, h->when);
+        }
+    }
+
+    EXPECT_TRUE(list.events.empty());
+    EXPECT_TRUE(heap.heap.empty());
+
+    delete[] le;
+    delete[] he;
+}
+
+    /*
+     *  Benchmark : cost of insert / cancel / expire with n events pending
+     */
+
+static void bench_queue(EvQueue::Backend backend, int pending)
+{
+    EvQueue queue(0, backend);
+    TestEvent *events = new TestEvent[pending];
+    const int ops = 1000;
+    TestEvent *extra = new TestEvent[ops];
+
+    // Fill the queue. Times are added in descending order, which is O(1) for the list
+    const panglos::Time::tick_t base = 1000000;
+    for (int i = 0; i < pending; i++)
+    {
+        events[i].when = base + panglos::Time::tick_t(pending - i);
+        queue.add(& events[i]);
+    }
+
+    srand(5678);
+    Stopwatch sw;
+    for (int i = 0; i < ops; i++)
+    {
+        extra[i].when = base + panglos::Time::tick_t(rand() % (pending + 1));
+        queue.add(& extra[i]);
+    }
+    const double t_add = sw.elapsed();
+
+    sw.reset();
+    for (int i = 0; i < ops; i++)
+    {
+        queue.del(& extra[i]);
+    }
+    const double t_del = sw.elapsed();
+
+    sw.reset();
+    for (int i = 0; i < ops; i++)
+    {
+        EvQueue::Event *ev = queue.pop(base + 0x10000000);
+        EXPECT_TRUE(ev);
+        // re-arm, as a periodic timer would
+        ev->when += panglos::Time::tick_t(pending);
+        queue.add(ev);
+    }
+    const double t_exp = sw.elapsed();
+
+    PO_INFO("%-11s pending=%-6d insert=%8.1fns cancel=%8.1fns expire=%8.1fns",
+            (backend == EvQueue::HEAP) ? "heap" : "sorted_list", pending,
+            (t_add * 1e9) / ops, (t_del * 1e9) / ops, (t_exp * 1e9) / ops);
+
+    delete[] extra;
+    delete[] events;
+}
+
+TEST(EventQueue, Bench)
+{
+    const int sizes[] = { 10, 1000, 100000, 0 };
+
+    for (int i = 0; sizes[i]; i++)
+    {
+        bench_queue(EvQueue::SORTED_LIST, sizes[i]);
+        bench_queue(EvQueue::HEAP, sizes[i]);
+    }
+}
+
 //  FIN
@@ -280,6 +280,61 @@ TEST(Event, OutOfDate)
      *
      */
 
+TEST(Event, HeapCheck)
+{
+    mock_setup(false);
+
+    EventQueue eq(0, 0, EventQueue::HEAP);
+
+    MockSemaphore *ms1 = new MockSemaphore();
+    Event *ev1 = new Event(ms1, 10000);
+    MockSemaphore *ms2 = new MockSemaphore();
+    Event *ev2 = new Event(ms2, 0xFFFFFF00);
+    MockSemaphore *ms3 = new MockSemaphore();
+    Event *ev3 = new Event(ms3, 1000);
+
+    EXPECT_TRUE(eq.add(ev1));
+    EXPECT_TRUE(eq.add(ev2));
+    EXPECT_FALSE(eq.add(ev3));
+    EXPECT_TRUE(eq.waiting(ev1));
+    EXPECT_TRUE(eq.waiting(ev2));
+    EXPECT_TRUE(eq.waiting(ev3));
+    EXPECT_TRUE(eq.events.empty());
+
+    // the wrapped event is due first
+    mock_timer_set((panglos::timer_t)0xFFFFFF00);
+    d_timer_t dt = eq.check();
+    EXPECT_EQ(0x100 + 1000, dt);
+    EXPECT_EQ(false, ms1->set);
+    EXPECT_EQ(true, ms2->set);
+    EXPECT_EQ(false, ms3->set);
+    EXPECT_FALSE(eq.waiting(ev2));
+
+    // cancel a pending event
+    EXPECT_EQ(ev1, eq.remove(ev1));
+    EXPECT_FALSE(eq.waiting(ev1));
+
+    mock_timer_set((panglos::timer_t)20000);
+    dt = eq.check();
+    EXPECT_EQ(0, dt);
+    EXPECT_EQ(false, ms1->set);
+    EXPECT_EQ(true, ms3->set);
+    EXPECT_TRUE(eq.heap.empty());
+
+    delete ev1->semaphore;
+    delete ev1;
+    delete ev2->semaphore;
+    delete ev2;
+    delete ev3->semaphore;
+    delete ev3;
+
+    mock_teardown();
+}
+
+    /*
+     *
+     */
+
 class TestRescheduler : public Rescheduler
 {
 public:
@@ -0,0 +1,358 @@
+
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+
+#include "panglos/debug.h"
+#include "panglos/thread.h"
+
+#include "panglos/executor.h"
+
+#include "bench.h"
+
+using namespace panglos;
+
+    /*
+     *  StealDeque
+     */
+
+TEST(StealDeque, Basic)
+{
+    StealDeque<int*> deque(4);
+    int items[5];
+
+    EXPECT_TRUE(deque.empty());
+    EXPECT_EQ(0, deque.take());
+    EXPECT_EQ(0, deque.steal());
+
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(deque.push(& items[i]));
+    }
+    // full
+    EXPECT_FALSE(deque.push(& items[4]));
+
+    // owner is LIFO, thieves are FIFO
+    EXPECT_EQ(& items[3], deque.take());
+    EXPECT_EQ(& items[0], deque.steal());
+    EXPECT_EQ(& items[1], deque.steal());
+    EXPECT_EQ(& items[2], deque.take());
+    EXPECT_TRUE(deque.empty());
+    EXPECT_EQ(0, deque.take());
+
+    // wraps
+    for (int loop = 0; loop < 10; loop++)
+    {
+        EXPECT_TRUE(deque.push(& items[0]));
+        EXPECT_TRUE(deque.push(& items[1]));
+        EXPECT_EQ(& items[0], deque.steal());
+        EXPECT_EQ(& items[1], deque.take());
+    }
+}
+
+struct StealArg
+{
+    StealDeque<int*> *deque;
+    std::atomic<bool> dead;
+    // number of times each item was taken
+    std::atomic<int> *taken;
+    int *base;
+};
+
+static void thief(void *arg)
+{
+    ASSERT(arg);
+    StealArg *sa = (StealArg*) arg;
+
+    while (!sa->dead)
+    {
+        int *p = sa->deque->steal();
+        if (p)
+        {
+            sa->taken[p - sa->base] += 1;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
+
+TEST(StealDeque, Threads)
+{
+    const int num = 100000;
+    int *items = new int[num];
+    std::atomic<int> *taken = new std::atomic<int>[num];
+    for (int i = 0; i < num; i++)
+    {
+        taken[i] = 0;
+    }
+
+    StealDeque<int*> deque(64);
+    StealArg sa;
+    sa.deque = & deque;
+    sa.dead = false;
+    sa.taken = taken;
+    sa.base = items;
+
+    ThreadPool thieves("thief", 3);
+    thieves.start(thief, & sa);
+
+    // the owner pushes everything, and takes some back
+    for (int i = 0; i < num; i++)
+    {
+        while (!deque.push(& items[i]))
+        {
+            sched_yield();
+        }
+        if (i & 1)
+        {
+            int *p = deque.take();
+            if (p)
+            {
+                taken[p - items] += 1;
+            }
+        }
+    }
+
+    while (!deque.empty())
+    {
+        sched_yield();
+    }
+    sa.dead = true;
+    thieves.join();
+
+    // every item taken once
+    int bad = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (taken[i] != 1)
+        {
+            bad += 1;
+        }
+    }
+    EXPECT_EQ(0, bad);
+
+    delete[] taken;
+    delete[] items;
+}
+
+    /*
+     *  Executor
+     */
+
+static void incr(void *arg)
+{
+    ASSERT(arg);
+    std::atomic<int> *n = (std::atomic<int>*) arg;
+    *n += 1;
+}
+
+TEST(Executor, Submit)
+{
+    Executor ex("ex_%d", 4);
+    EXPECT_EQ(4, ex.get_workers());
+
+    std::atomic<int> n(0);
+    WaitGroup wg;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        ex.submit(incr, & n, & wg);
+    }
+
+    wg.wait();
+    EXPECT_EQ(1000, n);
+    EXPECT_EQ(0, wg.pending());
+}
+
+    /*
+     *  Tasks that submit subtasks, and wait for them
+     */
+
+struct Tree
+{
+    Executor *ex;
+    int depth;
+    std::atomic<int> *leaves;
+};
+
+static void tree(void *arg)
+{
+    ASSERT(arg);
+    Tree *t = (Tree*) arg;
+
+    if (!t->depth)
+    {
+        *t->leaves += 1;
+        return;
+    }
+
+    Tree left = { t->ex, t->depth - 1, t->leaves };
+    Tree right = { t->ex, t->depth - 1, t->leaves };
+    WaitGroup wg;
+    t->ex->submit(tree, & left, & wg);
+    t->ex->submit(tree, & right, & wg);
+    // runs tasks while waiting, so won't deadlock the workers
+    t->ex->wait(& wg);
+}
+
+TEST(Executor, Nested)
+{
+    Executor ex("ex_%d", 2);
+
+    std::atomic<int> leaves(0);
+    Tree root = { & ex, 12, & leaves };
+
+    WaitGroup wg;
+    ex.submit(tree, & root, & wg);
+    ex.wait(& wg);
+
+    EXPECT_EQ(1 << 12, leaves);
+}
+
+    /*
+     *  parallel_for
+     */
+
+struct Marks
+{
+    std::atomic<int> *marks;
+    std::atomic<int> calls;
+    int grain;
+    bool ok;
+};
+
+static void mark(void *arg, int lo, int hi)
+{
+    ASSERT(arg);
+    Marks *m = (Marks*) arg;
+    m->calls += 1;
+    if ((lo >= hi) || ((hi - lo) > m->grain))
+    {
+        m->ok = false;
+    }
+    for (int i = lo; i < hi; i++)
+    {
+        m->marks[i] += 1;
+    }
+}
+
+TEST(Executor, ParallelFor)
+{
+    Executor ex("ex_%d", 4);
+    const int num = 10007;
+
+    Marks m;
+    m.marks = new std::atomic<int>[num];
+    for (int i = 0; i < num; i++)
+    {
+        m.marks[i] = 0;
+    }
+    m.calls = 0;
+    m.grain = 100;
+    m.ok = true;
+
+    ex.parallel_for(0, num, m.grain, mark, & m);
+
+    EXPECT_TRUE(m.ok);
+    EXPECT_GE(m.calls, num / m.grain);
+    int bad = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (m.marks[i] != 1)
+        {
+            bad += 1;
+        }
+    }
+    EXPECT_EQ(0, bad);
+
+    // empty range
+    m.calls = 0;
+    ex.parallel_for(10, 10, 1, mark, & m);
+    EXPECT_EQ(0, m.calls);
+
+    delete[] m.marks;
+}
+
+    /*
+     *  Many short parallel_for() calls : the WaitGroup on the caller's
+     *  stack must not be used by a worker after parallel_for() returns.
+     */
+
+static void count_range(void *arg, int lo, int hi)
+{
+    ASSERT(arg);
+    std::atomic<int> *n = (std::atomic<int>*) arg;
+    *n += hi - lo;
+}
+
+TEST(Executor, ShortFor)
+{
+    Executor ex("ex_%d", 4);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        std::atomic<int> n(0);
+        ex.parallel_for(0, 8, 1, count_range, & n);
+        ASSERT_EQ(8, n);
+    }
+}
+
+    /*
+     *  Scaling : the same work on 1 .. N workers
+     */
+
+struct Work
+{
+    float *data;
+};
+
+static void work(void *arg, int lo, int hi)
+{
+    ASSERT(arg);
+    Work *w = (Work*) arg;
+    for (int i = lo; i < hi; i++)
+    {
+        float x = float(i);
+        for (int j = 0; j < 200; j++)
+        {
+            x = (x * 0.999f) + 1.0f;
+        }
+        w->data[i] = x;
+    }
+}
+
+TEST(Executor, Bench)
+{
+    const int num = 50000;
+    Work w;
+    w.data = new float[num];
+
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+
+    for (int workers = 1; workers <= 8; workers *= 2)
+    {
+        Executor ex("ex_%d", workers);
+
+        Stopwatch sw;
+        ex.parallel_for(0, num, 500, work, & w);
+        const double t = sw.elapsed();
+
+        if (workers == 1)
+        {
+            base = t;
+        }
+        PO_INFO("cpus=%ld workers=%d time=%.2f ms speedup=%.2f steals=%d",
+                cpus, workers, t * 1e3, base / t, ex.get_steals());
+    }
+
+    delete[] w.data;
+}
+
+//  FIN
@@ -1,10 +1,16 @@
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
+#include "panglos/thread.h"
 
 #include "panglos/io.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
 TEST(IO, CharOut)
@@ -99,6 +105,158 @@ TEST(IO, LineOut)
      *
      */
 
+class CountOut : public Out
+{
+public:
+    Out *out;
+    int calls;
+    int bytes;
+
+    CountOut(Out *_out) : out(_out), calls(0), bytes(0) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        calls += 1;
+        bytes += n;
+        return out ? out->tx(data, n) : n;
+    }
+};
+
+TEST(IO, Buffered)
+{
+    char buff[128] = { 0 };
+    CharOut co(buff, sizeof(buff));
+    CountOut count(& co);
+
+    {
+        char staging[8];
+        FmtOut fmt(& count, 0, staging, sizeof(staging));
+
+        // each printf is sent in buffer sized blocks
+        fmt.printf("hello world!");
+        EXPECT_STREQ(buff, "hello world!");
+        EXPECT_EQ(count.calls, 2);
+        EXPECT_EQ(count.bytes, 12);
+
+        fmt.printf("%d", 1234);
+        EXPECT_STREQ(buff, "hello world!1234");
+        EXPECT_EQ(count.calls, 3);
+
+        // tx() is staged until flushed
+        co.reset();
+        fmt.tx('a');
+        fmt.tx('b');
+        EXPECT_STREQ(buff, "");
+        fmt.tx_flush();
+        EXPECT_STREQ(buff, "ab");
+        EXPECT_EQ(count.calls, 4);
+
+        // remove the buffer
+        fmt.set_buffer(0, 0);
+        fmt.printf("xyz");
+        EXPECT_STREQ(buff, "abxyz");
+        EXPECT_EQ(count.calls, 7);
+    }
+
+    {
+        // LineOut downstream still sees whole lines
+        co.reset();
+        LineOut lo(200, & co, true);
+        BufferedFmtOut<4> fmt(& lo);
+
+        fmt.printf("hello ");
+        EXPECT_STREQ(buff, "");
+        fmt.printf("world!\r\nmore");
+        EXPECT_STREQ(buff, "hello world!");
+    }
+}
+
+    /*
+     *  Benchmark : tx() calls and throughput, unbuffered vs buffered
+     */
+
+class SockOut : public Out
+{
+    int fd;
+public:
+    SockOut(int _fd) : fd(_fd) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        return int(::send(fd, data, size_t(n), 0));
+    }
+};
+
+static void sock_drain(void *arg)
+{
+    int fd = *(int*) arg;
+    char buff[1024];
+    while (::recv(fd, buff, sizeof(buff), 0) > 0)
+        ;
+}
+
+static void bench_fmt(const char *label, Out *out, char *staging, int size)
+{
+    CountOut count(out);
+    FmtOut fmt(& count, 0, staging, size);
+    const int loops = 2000;
+
+    Stopwatch sw;
+    for (int i = 0; i < loops; i++)
+    {
+        fmt.printf("%d %s %s +%d : value=%d\r\n", i, "main", "src/io.cpp", 123, i * 7);
+    }
+    const double t = sw.elapsed();
+
+    PO_INFO("%-8s %-10s tx=%-7d bytes=%-7d %.1f MB/s", label, staging ? "buffered" : "unbuffered",
+            count.calls, count.bytes, (count.bytes / t) / 1e6);
+    if (staging)
+    {
+        EXPECT_EQ(count.calls, loops);
+    }
+    else
+    {
+        EXPECT_EQ(count.calls, count.bytes);
+    }
+}
+
+TEST(IO, BufferedBench)
+{
+    char staging[128];
+    char buff[64];
+
+    for (int buffered = 0; buffered < 2; buffered++)
+    {
+        char *s = buffered ? staging : 0;
+
+        CharOut co(buff, sizeof(buff));
+        bench_fmt("CharOut", & co, s, sizeof(staging));
+
+        CharOut sink(buff, sizeof(buff));
+        LineOut lo(128, & sink, false);
+        bench_fmt("LineOut", & lo, s, sizeof(staging));
+
+        int fds[2];
+        int err = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        ASSERT_EQ(err, 0);
+        Thread *thread = Thread::create("drain");
+        thread->start(sock_drain, & fds[1]);
+
+        SockOut so(fds[0]);
+        bench_fmt("socket", & so, s, sizeof(staging));
+
+        shutdown(fds[0], SHUT_WR);
+        thread->join();
+        delete thread;
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+    /*
+     *
+     */
+
 TEST(IO, CharIn)
 {
     {
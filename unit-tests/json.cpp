@@ -4,6 +4,8 @@
 
 #include "panglos/debug.h"
 
+#include "bench.h"
+
     /*
      *
      */
@@ -618,4 +620,518 @@ TEST(Json, Match)
     }
 }
 
+    /*
+     *  StreamParser
+     */
+
+class Recorder : public Handler
+{
+public:
+    std::string events;
+
+    void add(const char *type, Section *sec=0)
+    {
+        events += type;
+        if (sec)
+        {
+            events.append(sec->s, size_t(1 + sec->e - sec->s));
+        }
+        events += "|";
+    }
+
+    virtual enum Error on_object(bool push) override
+    {
+        add(push ? "{" : "}");
+        return OKAY;
+    }
+
+    virtual enum Error on_array(bool push) override
+    {
+        add(push ? "[" : "]");
+        return OKAY;
+    }
+
+    virtual enum Error on_number(Section *sec) override
+    {
+        add("n:", sec);
+        return OKAY;
+    }
+
+    virtual enum Error on_string(Section *sec, bool key) override
+    {
+        add(key ? "k:" : "s:", sec);
+        return OKAY;
+    }
+
+    virtual enum Error on_primitive(Section *sec) override
+    {
+        add("p:", sec);
+        return OKAY;
+    }
+};
+
+static bool stream(StreamParser *p, const char *json, size_t chunk)
+{
+    const size_t len = strlen(json);
+    for (size_t i = 0; i < len; i += chunk)
+    {
+        const size_t n = ((i + chunk) > len) ? (len - i) : chunk;
+        if (!p->parse(& json[i], n))
+        {
+            return false;
+        }
+    }
+    return p->finish();
+}
+
+static const char *stream_tests[] = {
+    "1234",
+    "12.34e-7",
+    "\"text string\\\\this\"",
+    "\"quote \\\" in string\"",
+    "\"\"",
+    "{\"label\": 1234, \"other\": 3456, \"thing\" : true, \"abcd\": 12.34 }",
+    "{\"test\": [ 123, 12.34, \"hello\", 456, \"world\" ], \"z\": \"local\"}",
+    "{\"a\": {\"b\": [ null, false, {\"\": -1}, [] ], \"c\": true}}",
+    "{   }",
+    "{}",
+    "[ 123, 12.34, \"hello\", 456, \"world\" ]",
+    "[  ] ",
+    " \"hello\\uabcd world\" ",
+    " -0 ",
+    " true",
+    "null ",
+    0,
+};
+
+TEST(Json, Stream)
+{
+    for (int i = 0; stream_tests[i]; i++)
+    {
+        const char *json = stream_tests[i];
+
+        // reference : parse the whole document
+        Recorder ref;
+        Section sec(json);
+        Parser parser(& ref);
+        EXPECT_TRUE(parser.parse(& sec));
+
+        for (size_t chunk = 1; chunk <= (strlen(json) + 1); chunk++)
+        {
+            Recorder rec;
+            StreamParser p(& rec);
+            bool ok = stream(& p, json, chunk);
+            EXPECT_TRUE(ok);
+            EXPECT_TRUE(p.done());
+            EXPECT_EQ(ref.events, rec.events) << json << " chunk=" << chunk;
+        }
+    }
+}
+
+TEST(Json, StreamError)
+{
+    struct Test {
+        const char *json;
+        enum Parser::Error err;
+        size_t offset;
+    };
+
+    const struct Test tests[] = {
+        { "{\"a\" 1}", Parser::COLON_EXPECTED, 5 },
+        { "{1: 2}", Parser::KEY_EXPECTED, 1 },
+        { "{\"a\": 1 ]", Parser::CLOSE_BRACE_EXPECTED, 8 },
+        { "[1, 2 }", Parser::CLOSE_BRACKET_EXPECTED, 6 },
+        { "{\"a\": 1", Parser::CLOSE_BRACE_EXPECTED, 7 },
+        { "[1, 2", Parser::CLOSE_BRACKET_EXPECTED, 5 },
+        { "\"abc", Parser::UNTERMINATED_STRING, 4 },
+        { "[1, ?]", Parser::VALUE_EXPECTED, 4 },
+        { "[truex]", Parser::VALUE_EXPECTED, 6 },
+        { "[[[[[1]]]]]", Parser::NESTING_TOO_DEEP, 4 },
+        { "\"0123456789abcdef\"", Parser::TOKEN_TOO_LONG, 9 },
+        { "", Parser::VALUE_EXPECTED, 0 },
+        { 0 },
+    };
+
+    for (const struct Test *test = tests; test->json; test++)
+    {
+        // split all tokens : small scratch buffer
+        P handler;
+        StreamParser p(& handler, 8, 4, false);
+        bool ok = stream(& p, test->json, 1);
+        EXPECT_FALSE(ok);
+        size_t offset = 0;
+        EXPECT_EQ(test->err, p.get_error(& offset)) << test->json;
+        EXPECT_EQ(test->offset, offset) << test->json;
+
+        // can be reused
+        p.reset();
+        ok = stream(& p, "[1]", 1);
+        EXPECT_TRUE(ok);
+    }
+}
+
+TEST(Json, StreamMatch)
+{
+    const char *json = "{\"sun\": {\"alt\": 0.9233672, \"az\": 3.902},"
+            " \"moon\": {\"alt\": 0.1942122578, \"az\": 2.1646382808685303, \"phase\": 0.4673593289770038},"
+            " \"jupiter\": {\"alt\": -0.0059446850791573524, \"az\": 5.141014099121094},"
+            " \"time\": \"2023/07/25 14:07:57\", \"z\": \"local\"}";
+
+    for (size_t chunk = 1; chunk < 20; chunk++)
+    {
+        json::Match tm;
+
+        const char *m0[] = { "moon", "phase", 0 };
+        struct Matcher mm0 = { "0.4673593289770038", Match::NUMBER };
+        json::Match::Item item0 = { m0, on_match, (void*) & mm0 };
+        tm.add_item(& item0);
+
+        const char *m1[] = { "jupiter", "az", 0 };
+        struct Matcher mm1 = { "5.141014099121094", Match::NUMBER };
+        json::Match::Item item1 = { m1, on_match, (void*) & mm1 };
+        tm.add_item(& item1);
+
+        StreamParser p(& tm);
+        EXPECT_TRUE(stream(& p, json, chunk));
+        EXPECT_EQ(1, mm0.checked);
+        EXPECT_EQ(true, mm0.same);
+        EXPECT_EQ(1, mm1.checked);
+        EXPECT_EQ(true, mm1.same);
+    }
+}
+
+    /*
+     *  Multi-megabyte document, fed in random sized chunks
+     */
+
+static char *make_doc(size_t *size, int records)
+{
+    std::string doc = "[";
+    char buff[256];
+    for (int i = 0; i < records; i++)
+    {
+        snprintf(buff, sizeof(buff),
+            "%s{\"id\": %d, \"name\": \"sensor_%d\", \"enabled\": %s, \"gain\": %d.%03d,"
+            " \"tags\": [\"a\", \"b\\\"c\", null], \"pos\": {\"x\": -%d, \"y\": %de-3}}\n",
+            i ? ", " : "", i, i, (i & 1) ? "true" : "false", i % 100, i % 1000, i, i);
+        doc += buff;
+    }
+    doc += "]";
+    *size = doc.size();
+    return strdup(doc.c_str());
+}
+
+TEST(Json, StreamBench)
+{
+    size_t size = 0;
+    char *doc = make_doc(& size, 40000);
+
+    Stopwatch sw;
+    P handler;
+    Section sec(doc);
+    Parser parser(& handler);
+    EXPECT_TRUE(parser.parse(& sec));
+    const double whole = sw.elapsed();
+
+    // random chunk sizes, 1 .. 4096
+    srand(1234);
+    StreamParser p(& handler, 64);
+    sw.reset();
+    for (size_t i = 0; i < size; )
+    {
+        size_t n = 1 + size_t(rand() % 4096);
+        if ((i + n) > size) n = size - i;
+        EXPECT_TRUE(p.parse(& doc[i], n));
+        i += n;
+    }
+    EXPECT_TRUE(p.finish());
+    const double chunked = sw.elapsed();
+
+    PO_INFO("size=%d parse=%.1f MB/s stream=%.1f MB/s", (int) size,
+            (double(size) / whole) / 1e6, (double(size) / chunked) / 1e6);
+
+    free(doc);
+}
+
+    /*
+     *  Parse throughput on representative documents
+     */
+
+static char *make_pretty(size_t *size, int records)
+{
+    std::string doc = "{\n    \"devices\" : [\n";
+    char buff[512];
+    for (int i = 0; i < records; i++)
+    {
+        snprintf(buff, sizeof(buff),
+            "%s        {\n"
+            "            \"name\"     : \"i2c_sensor_%d\",\n"
+            "            \"type\"     : \"BME280\",\n"
+            "            \"address\"  : %d,\n"
+            "            \"enabled\"  : true,\n"
+            "            \"scale\"    : [ 1.0, 0.5, -0.25 ]\n"
+            "        }",
+            i ? ",\n" : "", i, i & 0x7f);
+        doc += buff;
+    }
+    doc += "\n    ]\n}\n";
+    *size = doc.size();
+    return strdup(doc.c_str());
+}
+
+static char *make_strings(size_t *size, int records)
+{
+    std::string doc = "[";
+    for (int i = 0; i < records; i++)
+    {
+        if (i) doc += ",";
+        doc += "{\"topic\":\"home/sensors/outside/temperature\",\"payload\":\"";
+        for (int j = 0; j < 8; j++)
+        {
+            doc += "the quick brown fox jumps over the lazy dog ";
+        }
+        doc += "\\\"quoted\\\"\"}";
+    }
+    doc += "]";
+    *size = doc.size();
+    return strdup(doc.c_str());
+}
+
+TEST(Json, Bench)
+{
+    struct Doc {
+        const char *name;
+        char *(*make)(size_t *size, int records);
+        int records;
+    };
+    const struct Doc docs[] = {
+        { "compact", make_doc, 20000 },
+        { "pretty", make_pretty, 20000 },
+        { "strings", make_strings, 10000 },
+        { 0 },
+    };
+
+    for (const struct Doc *d = docs; d->name; d++)
+    {
+        size_t size = 0;
+        char *doc = d->make(& size, d->records);
+
+        const int loops = 5;
+        P handler;
+
+        Stopwatch sw;
+        for (int i = 0; i < loops; i++)
+        {
+            Section sec(doc);
+            Parser parser(& handler);
+            EXPECT_TRUE(parser.parse(& sec));
+        }
+        const double whole = sw.elapsed();
+
+        sw.reset();
+        for (int i = 0; i < loops; i++)
+        {
+            StreamParser p(& handler, 1024);
+            for (size_t j = 0; j < size; j += 1024)
+            {
+                const size_t n = ((j + 1024) > size) ? (size - j) : 1024;
+                EXPECT_TRUE(p.parse(& doc[j], n));
+            }
+            EXPECT_TRUE(p.finish());
+        }
+        const double chunked = sw.elapsed();
+
+        const double mb = double(size * loops) / 1e6;
+        PO_INFO("%-8s size=%d parse=%.1f MB/s stream=%.1f MB/s", d->name, (int) size,
+                mb / whole, mb / chunked);
+
+        free(doc);
+    }
+}
+
+    /*
+     *  Match : array index and wildcard segments
+     */
+
+struct Collect {
+    std::string values;
+};
+
+static void on_collect(void *arg, Section *sec, enum Match::Type type, const char **keys)
+{
+    IGNORE(type);
+    IGNORE(keys);
+    ASSERT(arg);
+    struct Collect *c = (struct Collect *) arg;
+    c->values.append(sec->s, size_t(1 + sec->e - sec->s));
+    c->values += ",";
+}
+
+TEST(Json, MatchPath)
+{
+    const char *json = "{\"devs\": [ {\"name\": \"a\", \"v\": 1}, {\"name\": \"b\", \"v\": 2},"
+                       " {\"name\": \"c\", \"v\": [3, 4]} ],"
+                       " \"x\": {\"p\": 5, \"q\": 6}, \"y\": {\"p\": 7}, \"z\": [8, [9, 10]], \"[1x]\": 11}";
+
+    struct Test {
+        const char *keys[5];
+        const char *expect;
+    };
+
+    const struct Test tests[] = {
+        { { "devs", "[1]", "name", 0 }, "b," },
+        { { "devs", "*", "name", 0 }, "a,b,c," },
+        { { "devs", "*", "v", 0 }, "1,2,3,4," },
+        { { "devs", "[2]", "v", 0 }, "3,4," },
+        { { "devs", "[2]", "v", "[1]" }, "4," },
+        { { "*", "p", 0 }, "5,7," },
+        { { "x", 0 }, "5,6," },
+        { { "z", "[1]", "[0]", 0 }, "9," },
+        { { "z", "[0]", 0 }, "8," },
+        { { "nothing", 0 }, "" },
+        // not an index : only matches a key
+        { { "z", "[1x]", 0 }, "" },
+        { { "z", "[abc]", 0 }, "" },
+        { { "z", "[-1]", 0 }, "" },
+        { { "z", "[]", 0 }, "" },
+        { { "[1x]", 0 }, "11," },
+        { { 0 }, 0 },
+    };
+
+    for (const struct Test *test = tests; test->keys[0]; test++)
+    {
+        for (size_t chunk = 1; chunk < 4; chunk++)
+        {
+            struct Collect c;
+            json::Match tm;
+            json::Match::Item item = { (const char**) test->keys, on_collect, (void*) & c };
+            tm.add_item(& item);
+
+            // add some other paths
+            const char *other[] = { "devs", "*", "other", 0 };
+            json::Match::Item item2 = { other, on_collect, 0 };
+            tm.add_item(& item2);
+
+            StreamParser p(& tm);
+            EXPECT_TRUE(stream(& p, json, chunk));
+            EXPECT_EQ(test->expect, c.values) << test->keys[0];
+        }
+    }
+}
+
+    /*
+     *  Match with many registered paths
+     */
+
+static void on_count(void *arg, Section *sec, enum Match::Type type, const char **keys)
+{
+    IGNORE(sec);
+    IGNORE(type);
+    IGNORE(keys);
+    ASSERT(arg);
+    int *count = (int *) arg;
+    *count += 1;
+}
+
+    /*
+     *  Many overlapping paths active at the same depth
+     */
+
+TEST(Json, MatchOverlap)
+{
+    const char *json = "{\"a\": {\"b\": {\"c\": {\"d\": 1}}}}";
+    const char *keys[] = { "a", "b", "c", "d" };
+
+    // every path of 1 to 4 keys, each key literal or "*" : 16 distinct
+    // trie nodes are active at the deepest level, and 14 are held.
+    const char *paths[30][5];
+    int n = 0;
+    for (int depth = 1; depth <= 4; depth++)
+    {
+        for (int bits = 0; bits < (1 << depth); bits++)
+        {
+            for (int k = 0; k < depth; k++)
+            {
+                paths[n][k] = (bits & (1 << k)) ? "*" : keys[k];
+            }
+            paths[n][depth] = 0;
+            n += 1;
+        }
+    }
+    ASSERT_EQ(30, n);
+
+    for (size_t chunk = 1; chunk < 4; chunk++)
+    {
+        int count = 0;
+        json::Match::Item items[30];
+        json::Match tm;
+
+        for (int i = 0; i < n; i++)
+        {
+            items[i] = { paths[i], on_count, & count };
+            tm.add_item(& items[i]);
+        }
+
+        StreamParser parser(& tm);
+        EXPECT_TRUE(stream(& parser, json, chunk));
+
+        // every item sees the one value
+        EXPECT_EQ(n, count);
+    }
+}
+
+TEST(Json, MatchBench)
+{
+    const int devices = 1000;
+    const int paths = 500;
+
+    std::string doc = "{";
+    char buff[256];
+    for (int i = 0; i < devices; i++)
+    {
+        snprintf(buff, sizeof(buff),
+            "%s\"dev_%d\": {\"temp\": %d.5, \"hum\": %d, \"vals\": [1, 2, 3], \"name\": \"device %d\"}",
+            i ? ", " : "", i, i, i, i);
+        doc += buff;
+    }
+    doc += "}";
+
+    // 500 paths : 'dev_N' / 'temp' or 'hum'
+    const char *(*keys)[3] = new const char *[paths][3];
+    char (*names)[16] = new char[paths][16];
+    json::Match::Item *items = new json::Match::Item[paths];
+    int count = 0;
+
+    json::Match tm;
+    for (int i = 0; i < paths; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "dev_%d", i / 2);
+        keys[i][0] = names[i];
+        keys[i][1] = (i & 1) ? "hum" : "temp";
+        keys[i][2] = 0;
+        items[i].keys = keys[i];
+        items[i].on_match = on_count;
+        items[i].arg = & count;
+        items[i].next = 0;
+        tm.add_item(& items[i]);
+    }
+
+    const int loops = 10;
+    Stopwatch sw;
+    for (int i = 0; i < loops; i++)
+    {
+        Section sec(doc.c_str());
+        Parser p(& tm);
+        EXPECT_TRUE(p.parse(& sec));
+    }
+    const double t = sw.elapsed();
+
+    EXPECT_EQ(paths * loops, count);
+    PO_INFO("paths=%d size=%d %.1f MB/s", paths, (int) doc.size(), (double(doc.size()) * loops / t) / 1e6);
+
+    delete[] items;
+    delete[] names;
+    delete[] keys;
+}
+
 //  FIN
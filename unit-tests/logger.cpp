@@ -1,15 +1,20 @@
 
 #include <string>
+#include <atomic>
+#include <time.h>
 
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
 #include "panglos/io.h"
 #include "panglos/thread.h"
+#include "panglos/time.h"
 #include "panglos/linux/arch.h"
 
 #include "panglos/logger.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
     /*
@@ -205,4 +210,634 @@ TEST(Logger, ThreadAdd)
     delete global;
 }
 
+    /*
+     *  Each sink should see the message in a single tx()
+     */
+
+class TxCountOut : public StringOut
+{
+public:
+    int calls;
+
+    TxCountOut() : calls(0) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        calls += 1;
+        return StringOut::tx(data, n);
+    }
+};
+
+TEST(Logger, FanOut)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+
+    TxCountOut out[3];
+    for (int i = 0; i < 3; i++)
+    {
+        logging->add(& out[i], (i == 2) ? S_ERROR : S_INFO, 0);
+    }
+
+    Logging::printf(logging, S_INFO, "%s %d %s() : %s\n", "file.cpp", 123, "fn", "hello");
+
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECT_EQ(1, out[i].calls);
+        EXPECT_STREQ("file.cpp 123 fn() : hello\n", out[i].get());
+    }
+    EXPECT_EQ(0, out[2].calls);
+
+    delete logging;
+}
+
+TEST(Logger, Long)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+
+    StringOut out[3];
+    for (int i = 0; i < 3; i++)
+    {
+        logging->add(& out[i], S_INFO, 0);
+    }
+
+    // longer than the line buffer, so it is streamed to each sink
+    const std::string a(300, 'a');
+    const std::string b(300, 'b');
+    Logging::printf(logging, S_INFO, "%s %d %s %d\n", a.c_str(), 1234, b.c_str(), 5678);
+
+    const std::string s = a + " 1234 " + b + " 5678\n";
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_STREQ(s.c_str(), out[i].get());
+    }
+
+    delete logging;
+}
+
+    /*
+     *  Cost of a log call vs the number of sinks
+     */
+
+class NullOut : public Out
+{
+public:
+    virtual int tx(const char*, int n) override
+    {
+        return n;
+    }
+};
+
+// the old behaviour : format the message again for each sink
+static void per_sink(Out **outs, int nsinks, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    for (int i = 0; i < nsinks; i++)
+    {
+        va_list copy;
+        va_copy(copy, ap);
+        FmtOut formatter(outs[i], 0);
+        formatter.printf(fmt, copy);
+        va_end(copy);
+    }
+    va_end(ap);
+}
+
+TEST(Logger, SinkBench)
+{
+    const int loops = 20000;
+    const char *fmt = "%d %s %s +%d %s() : value=%d\r\n";
+
+    for (int nsinks = 1; nsinks <= 8; nsinks *= 2)
+    {
+        Logging *logging = new Logging(S_DEBUG, 0);
+        NullOut out[8];
+        Out *outs[8];
+        for (int i = 0; i < nsinks; i++)
+        {
+            logging->add(& out[i], S_INFO, 0);
+            outs[i] = & out[i];
+        }
+
+        Stopwatch sw;
+        for (int i = 0; i < loops; i++)
+        {
+            per_sink(outs, nsinks, fmt, 1234, "main", __FILE__, __LINE__, __FUNCTION__, i);
+        }
+        const double t_per_sink = sw.elapsed();
+
+        sw.reset();
+        for (int i = 0; i < loops; i++)
+        {
+            Logging::printf(logging, S_INFO, fmt, 1234, "main", __FILE__, __LINE__, __FUNCTION__, i);
+        }
+        const double t_once = sw.elapsed();
+
+        PO_INFO("sinks=%d per-sink=%.0f ns once=%.0f ns", nsinks,
+                (t_per_sink * 1e9) / loops, (t_once * 1e9) / loops);
+
+        delete logging;
+    }
+}
+
+    /*
+     *  Async mode
+     */
+
+TEST(Logger, Async)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+    logging->start_async(32, 64);
+
+    StringOut out;
+    logging->add(& out, S_INFO, 0);
+
+    std::string s;
+    for (int i = 0; i < 10; i++)
+    {
+        Logging::printf(logging, S_INFO, "info %d\n", i);
+        Logging::printf(logging, S_DEBUG, "debug %d\n", i);
+        s += "info " + std::to_string(i) + "\n";
+    }
+
+    logging->flush();
+    EXPECT_STREQ(s.c_str(), out.get());
+    EXPECT_EQ(0, logging->get_dropped());
+
+    // truncated to the record size
+    out.reset();
+    Logging::printf(logging, S_INFO, "%s", std::string(100, 'x').c_str());
+    logging->flush();
+    EXPECT_EQ(64, int(out.text.size()));
+
+    delete logging;
+}
+
+    /*
+     *  A slow sink, eg. a UART
+     */
+
+class SlowOut : public StringOut
+{
+public:
+    int delay;
+    std::atomic<int> lines;
+
+    SlowOut(int d) : delay(d), lines(0) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        Time::msleep(delay);
+        lines += 1;
+        return StringOut::tx(data, n);
+    }
+};
+
+static void async_overflow(Logging::Overflow overflow)
+{
+    Mutex *global = Mutex::create();
+    Logging *logging = new Logging(S_DEBUG, global);
+    logging->start_async(4, 64, overflow);
+
+    SlowOut out(5);
+    logging->add(& out, S_INFO, 0);
+
+    const int n = 8;
+    ThreadPool pool("x", n);
+
+    struct ThreadInfo info = {
+        .logging = logging,
+        .s = "hello world\n",
+    };
+
+    pool.start(thread_test, & info);
+    pool.join();
+    logging->flush();
+
+    const int dropped = logging->get_dropped();
+    EXPECT_EQ(n, out.lines + dropped);
+    if (overflow == Logging::DROP)
+    {
+        EXPECT_TRUE(dropped > 0);
+    }
+    else
+    {
+        EXPECT_EQ(0, dropped);
+    }
+
+    delete logging;
+    delete global;
+}
+
+TEST(Logger, AsyncDrop)
+{
+    async_overflow(Logging::DROP);
+}
+
+TEST(Logger, AsyncBlock)
+{
+    async_overflow(Logging::BLOCK);
+}
+
+    /*
+     *  stop_async() while other threads are logging
+     */
+
+struct StopInfo {
+    Logging *logging;
+    std::atomic<bool> dead;
+};
+
+static void stop_logger(void *arg)
+{
+    ASSERT(arg);
+    struct StopInfo *info = (struct StopInfo*) arg;
+    static const Logging::Site site = { S_INFO, "trace %d\r\n", __FILE__, __LINE__, __FUNCTION__ };
+
+    for (int i = 0; !info->dead; i++)
+    {
+        Logging::printf(info->logging, S_INFO, "hello %d\n", i);
+        Logging::trace(info->logging, & site, i);
+    }
+}
+
+TEST(Logger, AsyncStop)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+    NullOut out;
+    logging->add(& out, S_INFO, 0);
+
+    struct StopInfo info;
+    info.logging = logging;
+    info.dead = false;
+
+    const int n = 4;
+    ThreadPool pool("x", n);
+    pool.start(stop_logger, & info);
+
+    for (int i = 0; i < 100; i++)
+    {
+        logging->start_async(4, 64, (i & 1) ? Logging::BLOCK : Logging::DROP);
+        Time::msleep(1);
+        logging->stop_async();
+    }
+
+    info.dead = true;
+    pool.join();
+    delete logging;
+}
+
+    /*
+     *  A sink that logs is called on the drain thread : BLOCK mode must not deadlock
+     */
+
+class EchoOut : public SlowOut
+{
+public:
+    Logging *logging;
+
+    EchoOut(Logging *l) : SlowOut(1), logging(l) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        if (strncmp(data, "echo", 4))
+        {
+            Logging::printf(logging, S_INFO, "echo %.*s", n, data);
+        }
+        return SlowOut::tx(data, n);
+    }
+};
+
+TEST(Logger, AsyncSelfLog)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+    logging->start_async(4, 64, Logging::BLOCK);
+
+    EchoOut out(logging);
+    logging->add(& out, S_INFO, 0);
+
+    const int n = 20;
+    for (int i = 0; i < n; i++)
+    {
+        Logging::printf(logging, S_INFO, "line %d\n", i);
+    }
+    logging->flush();
+
+    // every line is written, their echoes may be dropped
+    EXPECT_EQ(2 * n, out.lines + logging->get_dropped());
+    EXPECT_TRUE(out.lines >= n);
+
+    delete logging;
+}
+
+    /*
+     *  flush() from several threads, and from a sink on the drain thread
+     */
+
+class FlushOut : public SlowOut
+{
+public:
+    Logging *logging;
+
+    FlushOut(Logging *l) : SlowOut(0), logging(l) { }
+
+    virtual int tx(const char* data, int n) override
+    {
+        logging->flush();
+        return SlowOut::tx(data, n);
+    }
+};
+
+struct FlushInfo {
+    Logging *logging;
+    FlushOut *out;
+    int loops;
+    std::atomic<int> errors;
+};
+
+static void thread_flush(void *arg)
+{
+    ASSERT(arg);
+    struct FlushInfo *info = (struct FlushInfo*) arg;
+
+    for (int i = 0; i < info->loops; i++)
+    {
+        const int was = info->out->lines;
+        Logging::printf(info->logging, S_INFO, "hello %d\n", i);
+        info->logging->flush();
+        // at least our own line is written
+        if (info->out->lines <= was)
+        {
+            info->errors += 1;
+        }
+    }
+}
+
+TEST(Logger, AsyncFlush)
+{
+    Logging *logging = new Logging(S_DEBUG, 0);
+    logging->start_async(8, 64, Logging::BLOCK);
+
+    FlushOut out(logging);
+    logging->add(& out, S_INFO, 0);
+
+    struct FlushInfo info;
+    info.logging = logging;
+    info.out = & out;
+    info.loops = 100;
+    info.errors = 0;
+
+    const int n = 4;
+    ThreadPool pool("x", n);
+    pool.start(thread_flush, & info);
+    pool.join();
+
+    EXPECT_EQ(0, info.errors);
+    EXPECT_EQ(n * info.loops, out.lines);
+    EXPECT_EQ(0, logging->get_dropped());
+
+    delete logging;
+}
+
+    /*
+     *  Latency of a log call, from 16 threads, with a slow sink
+     */
+
+struct BenchInfo {
+    Logging *logging;
+    int loops;
+    std::atomic<double> *total;
+    std::atomic<double> *worst;
+};
+
+static void thread_bench(void *arg)
+{
+    ASSERT(arg);
+    struct BenchInfo *info = (struct BenchInfo*) arg;
+
+    double total = 0;
+    double worst = 0;
+    for (int i = 0; i < info->loops; i++)
+    {
+        Stopwatch sw;
+        Logging::printf(info->logging, S_INFO, "%s %d %s() : value=%d\n", __FILE__, __LINE__, __FUNCTION__, i);
+        const double t = sw.elapsed();
+        total += t;
+        if (t > worst) worst = t;
+    }
+
+    // update the shared results
+    double was = info->total->load();
+    while (!info->total->compare_exchange_weak(was, was + total)) { }
+    was = info->worst->load();
+    while ((worst > was) && !info->worst->compare_exchange_weak(was, worst)) { }
+}
+
+TEST(Logger, Bench)
+{
+    const int threads = 16;
+    const int loops = 200;
+
+    for (int async = 0; async < 2; async++)
+    {
+        Mutex *global = Mutex::create();
+        Logging *logging = new Logging(S_DEBUG, global);
+        if (async)
+        {
+            logging->start_async(1024, 128, Logging::DROP);
+        }
+
+        // ~10us per write
+        class SinkOut : public StringOut
+        {
+            virtual int tx(const char*, int n) override
+            {
+                Stopwatch sw;
+                while (sw.elapsed() < 10e-6) { }
+                return n;
+            }
+        } out;
+        Mutex *mutex = Mutex::create();
+        logging->add(& out, S_INFO, mutex);
+
+        std::atomic<double> total(0);
+        std::atomic<double> worst(0);
+        struct BenchInfo info = {
+            .logging = logging,
+            .loops = loops,
+            .total = & total,
+            .worst = & worst,
+        };
+
+        ThreadPool pool("x", threads);
+        pool.start(thread_bench, & info);
+        pool.join();
+        logging->flush();
+
+        PO_INFO("%s threads=%d mean=%.2f us max=%.1f us dropped=%d", async ? "async" : "sync",
+                threads, (total * 1e6) / (threads * loops), worst * 1e6, logging->get_dropped());
+
+        delete logging;
+        delete mutex;
+        delete global;
+    }
+}
+
+    /*
+     *  Binary logging
+     */
+
+static void trace_all()
+{
+    const char *s = "static";
+    PO_TRACE_INFO("no args");
+    PO_TRACE_INFO("int=%d neg=%d u=%u x=%#x", 1234, -5, 4000000000u, 0xbeef);
+    PO_TRACE_INFO("short=%hd long=%ld ll=%lld ull=%llu", short(-2), -70000L, -5000000000LL, 18000000000ULL);
+    PO_TRACE_INFO("x=%x lx=%lx min=%d llmin=%lld zero=%u", 0xbeefu, 0x123456789aUL, INT32_MIN, (long long) INT64_MIN, 0u);
+    PO_TRACE_INFO("size=%zu w=[%-6d] [%06x] 100%%", sizeof(uint64_t), 42, 255u);
+    PO_TRACE_INFO("c=%c s=%s [%8s] [%.3s]", 'z', s, "abc", "abcdef");
+    PO_TRACE_DEBUG("debug %d", 1);
+    PO_TRACE_INFO("f=%.2f g=%g e=%.1e", 3.14159, 0.5f, 12345.0);
+    PO_TRACE(S_ERROR, "a=%d b=%d c=%d d=%d e=%d f=%d g=%d h=%d", 1, 2, 3, 4, 5, 6, 7, 8);
+}
+
+static const char *trace_expect[] = {
+    "no args",
+    "int=1234 neg=-5 u=4000000000 x=0xbeef",
+    "short=-2 long=-70000 ll=-5000000000 ull=18000000000",
+    "x=beef lx=123456789a min=-2147483648 llmin=-9223372036854775808 zero=0",
+    "size=8 w=[42    ] [0000ff] 100%",
+    "c=z s=static [     abc] [abc]",
+    "f=3.14 g=0.5 e=1.2e+04",
+    "a=1 b=2 c=3 d=4 e=5 f=6 g=7 h=8",
+    0,
+};
+
+static void trace_check(const std::string & text)
+{
+    // each line is "time task SEVERITY file +line fn() : message\r\n"
+    size_t start = 0;
+    for (const char **expect = trace_expect; *expect; expect++)
+    {
+        const size_t end = text.find("\r\n", start);
+        ASSERT_NE(end, std::string::npos);
+        const std::string line = text.substr(start, end - start);
+        EXPECT_EQ(0u, line.find("4660 main "));
+        EXPECT_NE(std::string::npos, line.find(" unit-tests/logger.cpp +"));
+        EXPECT_NE(std::string::npos, line.find(" trace_all() : "));
+        const std::string msg = line.substr(line.find(" : ") + 3);
+        EXPECT_STREQ(*expect, msg.c_str());
+        start = end + 2;
+    }
+    EXPECT_EQ(start, text.size());
+}
+
+TEST(Logger, Trace)
+{
+    Logging *was = logger;
+
+    for (int async = 0; async < 2; async++)
+    {
+        logger = new Logging(S_DEBUG, 0);
+        if (async)
+        {
+            logger->start_async(16, 128);
+        }
+
+        StringOut out;
+        logger->add(& out, S_INFO, 0);
+
+        trace_all();
+        logger->flush();
+        trace_check(out.text);
+
+        delete logger;
+    }
+
+    logger = was;
+}
+
+TEST(Logger, TraceTruncate)
+{
+    Logging *was = logger;
+    logger = new Logging(S_DEBUG, 0);
+    // room for 3 args
+    logger->start_async(16, 48);
+
+    StringOut out;
+    logger->add(& out, S_INFO, 0);
+
+    PO_TRACE_INFO("a=%d", 1);
+    // too big for a record : formatted as text, and truncated
+    PO_TRACE_INFO("a=%d b=%d c=%d d=%d", 1, 2, 3, 4);
+    PO_TRACE_INFO("c=%d", 3);
+    logger->flush();
+
+    // the middle record is still in order, cut to the record size
+    const std::string & text = out.text;
+    const size_t first = text.find("a=1\r\n");
+    const size_t last = text.rfind("4660 main INFO");
+    ASSERT_NE(std::string::npos, first);
+    EXPECT_EQ(48u, last - (first + 5));
+    EXPECT_EQ(0u, text.find("4660 main INFO", first) - (first + 5));
+    EXPECT_EQ(text.size() - 5, text.find("c=3\r\n"));
+
+    delete logger;
+    logger = was;
+}
+
+// cpu time used by the calling thread, in seconds
+static double thread_cpu()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, & ts);
+    return double(ts.tv_sec) + (double(ts.tv_nsec) * 1e-9);
+}
+
+TEST(Logger, TraceBench)
+{
+    Logging *was = logger;
+    const int loops = 100000;
+
+    for (int async = 0; async < 2; async++)
+    {
+        logger = new Logging(S_DEBUG, 0);
+        if (async)
+        {
+            logger->start_async(loops * 2, 128, Logging::DROP);
+        }
+
+        NullOut out;
+        logger->add(& out, S_INFO, 0);
+
+        Stopwatch sw;
+        for (int i = 0; i < loops; i++)
+        {
+            Logging::printf(logger, S_INFO, "%d %s %s %s +%d %s() : value=%d x=%#x\r\n",
+                    int(get_time()), get_task(), "INFO", __FILE__, __LINE__, __FUNCTION__, i, i);
+        }
+        const double t_printf = sw.elapsed();
+        logger->flush();
+
+        const double c_trace = thread_cpu();
+        sw.reset();
+        for (int i = 0; i < loops; i++)
+        {
+            PO_TRACE_INFO("value=%d x=%#x", i, i);
+        }
+        const double t_trace = sw.elapsed();
+        const double t_caller = thread_cpu() - c_trace;
+        logger->flush();
+
+        // on a single core the wall time also has the drain thread in it
+        PO_INFO("%s printf=%.0f ns trace=%.0f ns (caller cpu=%.0f ns) dropped=%d", async ? "async" : "sync",
+                (t_printf * 1e9) / loops, (t_trace * 1e9) / loops, (t_caller * 1e9) / loops,
+                logger->get_dropped());
+
+        delete logger;
+    }
+
+    logger = was;
+}
+
 //  FIN
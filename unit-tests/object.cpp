@@ -6,70 +6,82 @@
 #include <panglos/object.h>
 
 #include "mock.h"
+#include "bench.h"
 
 using namespace panglos;
 
+static const Objects::Type types[] = { Objects::LIST, Objects::HASH, };
+
 TEST(Objects, Add)
 {
-    Objects *g = Objects::create();
-    ASSERT(g);
+    for (auto type : types)
+    {
+        Objects *g = Objects::create(false, type);
+        ASSERT(g);
 
-    g->add("hello", (void*) "hello");
-    g->add("world", (void*) "world");
+        g->add("hello", (void*) "hello");
+        g->add("world", (void*) "world");
 
-    void *v;
+        void *v;
 
-    v = g->get("hello");
-    EXPECT_STREQ("hello", (const char*) v);
-    v = g->get("world");
-    EXPECT_STREQ("world", (const char*) v);
-    v = g->get("nothing");
-    EXPECT_FALSE(v);
+        v = g->get("hello");
+        EXPECT_STREQ("hello", (const char*) v);
+        v = g->get("world");
+        EXPECT_STREQ("world", (const char*) v);
+        v = g->get("nothing");
+        EXPECT_FALSE(v);
 
-    delete g;
+        delete g;
+    }
 }
 
 TEST(Objects, Remove)
 {
-    Objects *g = Objects::create();
-    ASSERT(g);
+    for (auto type : types)
+    {
+        Objects *g = Objects::create(false, type);
+        ASSERT(g);
 
-    g->add("hello", (void*) "xhello");
-    g->add("mid", (void*) "xmid");
-    g->add("world", (void*) "xworld");
+        g->add("hello", (void*) "xhello");
+        g->add("mid", (void*) "xmid");
+        g->add("world", (void*) "xworld");
 
-    void *v;
+        void *v;
 
-    v = g->get("mid");
-    EXPECT_STREQ("xmid", (const char*) v);
+        v = g->get("mid");
+        EXPECT_STREQ("xmid", (const char*) v);
     
-    bool ok;
+        bool ok;
     
-    ok = g->remove("mid");
-    EXPECT_TRUE(ok);
+        ok = g->remove("mid");
+        EXPECT_TRUE(ok);
 
-    v = g->get("mid");
-    EXPECT_FALSE(v);
+        v = g->get("mid");
+        EXPECT_FALSE(v);
 
-    v = g->get("hello");
-    EXPECT_STREQ("xhello", (const char*) v);
-    v = g->get("world");
-    EXPECT_STREQ("xworld", (const char*) v);
-    v = g->get("nothing");
-    EXPECT_FALSE(v);
+        v = g->get("hello");
+        EXPECT_STREQ("xhello", (const char*) v);
+        v = g->get("world");
+        EXPECT_STREQ("xworld", (const char*) v);
+        v = g->get("nothing");
+        EXPECT_FALSE(v);
 
-    delete g;
+        delete g;
+    }
 }
 
 TEST(Objects, Leak)
 {
-    Objects *g = Objects::create();
-    ASSERT(g);
+    for (auto type : types)
+    {
+        Objects *g = Objects::create(false, type);
+        ASSERT(g);
 
-    g->add("hello", (void*) "hello");
-    g->add("world", (void*) "world");
+        g->add("hello", (void*) "hello");
+        g->add("world", (void*) "world");
 
-    delete g;
+        delete g;
+    }
 }
 
     /*
@@ -86,7 +98,7 @@ static void test_visit(const char *name, void *obj, void *arg)
     int n = sscanf(name, "obj_%d", & num);
     EXPECT_EQ(1, n);
     const char *s = (const char *) obj;
-    EXPECT_EQ(s, name);
+    EXPECT_STREQ(s, name);
 
     bool *found = (bool*) arg;
     found[num] = true;
@@ -94,28 +106,141 @@ static void test_visit(const char *name, void *obj, void *arg)
 
 TEST(Objects, Visit)
 {
-    Objects *g = Objects::create();
+    for (auto type : types)
+    {
+        Objects *g = Objects::create(false, type);
+        ASSERT(g);
+
+        const int num = 10;
+        char name[num][16];
+        bool found[num];
+
+        for (int i = 0; i < num; i++)
+        {
+            found[i] = false;
+            snprintf(name[i], sizeof(name[i]), "obj_%d", i);
+            g->add(name[i], (void*) name[i]);
+        }
+
+        Objects::visit(g, test_visit, found);
+
+        for (int i = 0; i < num; i++)
+        {
+            EXPECT_TRUE(found[i]);
+        }
+
+        delete g;
+    }
+}
+
+    /*
+     *  HASH : grow, replace, remove and re-add
+     */
+
+TEST(Objects, Hash)
+{
+    Objects *g = Objects::create(false, Objects::HASH);
     ASSERT(g);
 
-    const int num = 10;
-    char name[num][16];
-    bool found[num];
+    const int num = 1000;
+    char name[32];
+
+    for (int i = 0; i < num; i++)
+    {
+        // the names are copied
+        snprintf(name, sizeof(name), "obj_%d", i);
+        g->add(name, (void*) (intptr_t) (i + 1));
+    }
 
     for (int i = 0; i < num; i++)
     {
-        found[i] = false;
-        snprintf(name[i], sizeof(name[i]), "obj_%d", i);
-        g->add(name[i], (void*) name[i]);
+        snprintf(name, sizeof(name), "obj_%d", i);
+        EXPECT_EQ((void*) (intptr_t) (i + 1), g->get(name));
     }
 
-    Objects::visit(g, test_visit, found);
+    // replace
+    g->add("obj_10", (void*) 1234);
+    EXPECT_EQ((void*) 1234, g->get("obj_10"));
+
+    // remove the even ones
+    for (int i = 0; i < num; i += 2)
+    {
+        snprintf(name, sizeof(name), "obj_%d", i);
+        EXPECT_TRUE(g->remove(name));
+        EXPECT_FALSE(g->remove(name));
+    }
 
     for (int i = 0; i < num; i++)
     {
-        EXPECT_TRUE(found[i]);
+        snprintf(name, sizeof(name), "obj_%d", i);
+        void *v = g->get(name);
+        if (i & 1)
+        {
+            EXPECT_EQ((void*) (intptr_t) (i + 1), v);
+        }
+        else
+        {
+            EXPECT_FALSE(v);
+        }
     }
 
+    // churn : forces rehashing to purge the deleted markers
+    for (int i = 0; i < 10 * num; i++)
+    {
+        g->add("churn", (void*) 1);
+        EXPECT_TRUE(g->remove("churn"));
+        snprintf(name, sizeof(name), "x_%d", i);
+        g->add(name, (void*) 2);
+        EXPECT_TRUE(g->remove(name));
+    }
+
+    EXPECT_EQ((void*) (intptr_t) 2, g->get("obj_1"));
+    EXPECT_FALSE(g->get("churn"));
+
     delete g;
 }
 
+    /*
+     *  Lookup cost for each implementation
+     */
+
+TEST(Objects, Bench)
+{
+    const int sizes[] = { 10, 100, 10000, };
+
+    for (auto size : sizes)
+    {
+        char (*names)[24] = new char[size][24];
+        for (int i = 0; i < size; i++)
+        {
+            snprintf(names[i], sizeof(names[i]), "object_%d", i);
+        }
+
+        for (auto type : types)
+        {
+            Objects *g = Objects::create(false, type);
+            for (int i = 0; i < size; i++)
+            {
+                g->add(names[i], names[i]);
+            }
+
+            const int loops = 10000;
+            Stopwatch sw;
+            for (int i = 0; i < loops; i++)
+            {
+                const int idx = (i * 7919) % size;
+                void *v = g->get(names[idx]);
+                EXPECT_EQ(names[idx], v);
+            }
+            const double t = sw.elapsed();
+
+            PO_INFO("%s size=%d get=%.1f ns", (type == Objects::LIST) ? "list" : "hash",
+                    size, (t * 1e9) / loops);
+            delete g;
+        }
+
+        delete[] names;
+    }
+}
+
 //  FIN
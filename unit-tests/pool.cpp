@@ -0,0 +1,238 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "panglos/debug.h"
+#include "panglos/thread.h"
+
+#include "panglos/pool.h"
+
+#include "bench.h"
+
+using namespace panglos;
+
+    /*
+     *
+     */
+
+TEST(Pool, Basic)
+{
+    BlockPool pool(24, 4);
+    EXPECT_EQ(32u, pool.get_block_size());
+
+    std::set<void*> blocks;
+    for (int i = 0; i < 10; i++)
+    {
+        void *p = pool.alloc();
+        ASSERT_TRUE(p);
+        EXPECT_EQ(0u, uintptr_t(p) % (2 * sizeof(void*)));
+        memset(p, 0xaa, 24);
+        blocks.insert(p);
+    }
+    EXPECT_EQ(10u, blocks.size());
+
+    // 3 chunks of 4
+    BlockPool::Stats stats = pool.get_stats();
+    EXPECT_EQ(12, stats.blocks);
+    EXPECT_EQ(10, stats.used);
+
+    // freed blocks are reused
+    for (void *p : blocks)
+    {
+        pool.free(p);
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_TRUE(blocks.count(pool.alloc()));
+    }
+    EXPECT_EQ(12, pool.get_stats().blocks);
+}
+
+TEST(Pool, Static)
+{
+    // no heap
+    BlockPool pool(16, 0);
+    EXPECT_EQ(0, pool.alloc());
+
+    static uint8_t mem[100];
+    pool.add_memory(& mem[1], sizeof(mem) - 1);
+
+    int n = 0;
+    while (void *p = pool.alloc())
+    {
+        EXPECT_TRUE((p >= mem) && (p < & mem[sizeof(mem)]));
+        n += 1;
+    }
+    // some lost to alignment
+    EXPECT_TRUE((n == 5) || (n == 6));
+    EXPECT_EQ(n, pool.get_stats().used);
+}
+
+    /*
+     *  Size class pools from static memory only
+     */
+
+TEST(Pool, ClassStatic)
+{
+    BlockPool *pool = PoolAllocator::get_pool(128);
+    ASSERT_TRUE(pool);
+
+    static uint8_t mem[(128 * 8) + 16];
+    PoolAllocator::add_memory(128, mem, sizeof(mem));
+    PoolAllocator::set_chunk(0);
+
+    const BlockPool::Stats stats = pool->get_stats();
+    const int n = stats.blocks - stats.used;
+    EXPECT_TRUE(n >= 8);
+
+    // every free block, then no more : the heap is not used
+    void *blocks[256];
+    ASSERT_TRUE(n <= 256);
+    for (int i = 0; i < n; i++)
+    {
+        blocks[i] = pool->alloc();
+        EXPECT_TRUE(blocks[i]);
+    }
+    EXPECT_EQ(0, pool->alloc());
+    EXPECT_EQ(stats.blocks, pool->get_stats().blocks);
+
+    for (int i = 0; i < n; i++)
+    {
+        pool->free(blocks[i]);
+    }
+    PoolAllocator::set_chunk(16);
+}
+
+    /*
+     *  Classes that opt in
+     */
+
+class Node : public Pooled
+{
+public:
+    Node *next;
+    int value;
+    char name[20];
+
+    Node(int v) : next(0), value(v) { }
+};
+
+class BigNode : public Node
+{
+public:
+    char data[300];
+
+    BigNode() : Node(0) { }
+};
+
+TEST(Pool, Pooled)
+{
+    BlockPool *pool = PoolAllocator::get_pool(sizeof(Node));
+    ASSERT_TRUE(pool);
+    const int used = pool->get_stats().used;
+
+    Node *nodes[10];
+    for (int i = 0; i < 10; i++)
+    {
+        nodes[i] = new Node(i);
+    }
+    EXPECT_EQ(used + 10, pool->get_stats().used);
+
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(i, nodes[i]->value);
+        delete nodes[i];
+    }
+    EXPECT_EQ(used, pool->get_stats().used);
+
+    // too big for the pools : uses the heap
+    EXPECT_EQ(0, PoolAllocator::get_pool(sizeof(BigNode)));
+    BigNode *big = new BigNode;
+    delete big;
+}
+
+    /*
+     *
+     */
+
+static void thread_alloc(void *arg)
+{
+    ASSERT(arg);
+    BlockPool *pool = (BlockPool*) arg;
+
+    void *blocks[64];
+    for (int loop = 0; loop < 1000; loop++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            blocks[i] = pool->alloc();
+            ASSERT(blocks[i]);
+            *(int*) blocks[i] = i;
+        }
+        for (int i = 0; i < 64; i++)
+        {
+            ASSERT(*(int*) blocks[i] == i);
+            pool->free(blocks[i]);
+        }
+    }
+}
+
+TEST(Pool, Threads)
+{
+    BlockPool pool(32);
+    ThreadPool threads("x", 8);
+
+    threads.start(thread_alloc, & pool);
+    threads.join();
+
+    EXPECT_EQ(0, pool.get_stats().used);
+}
+
+    /*
+     *  Allocation latency, pool vs malloc
+     */
+
+TEST(Pool, Bench)
+{
+    const int loops = 1000;
+    const int n = 256;
+    void *blocks[n];
+    BlockPool pool(64);
+
+    for (int use_pool = 0; use_pool < 2; use_pool++)
+    {
+        double total = 0;
+        double worst = 0;
+
+        for (int loop = 0; loop < loops; loop++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                // vary the malloc sizes, as a real heap would see
+                const size_t size = size_t(16 + ((i * 7) % 48));
+                Stopwatch sw;
+                blocks[i] = use_pool ? pool.alloc() : malloc(size);
+                const double t = sw.elapsed();
+                total += t;
+                if (t > worst) worst = t;
+            }
+            for (int i = 0; i < n; i += 2)
+            {
+                use_pool ? pool.free(blocks[i]) : free(blocks[i]);
+            }
+            for (int i = 1; i < n; i += 2)
+            {
+                use_pool ? pool.free(blocks[i]) : free(blocks[i]);
+            }
+        }
+
+        PO_INFO("%s alloc : mean=%.0f ns max=%.0f ns", use_pool ? "pool" : "malloc",
+                (total * 1e9) / (loops * n), worst * 1e9);
+    }
+}
+
+//  FIN
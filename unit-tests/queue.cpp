@@ -8,6 +8,9 @@
 #include "panglos/queue.h"
 #include "panglos/mutex.h"
 #include "panglos/thread.h"
+#include "panglos/semaphore.h"
+
+#include "bench.h"
 
 //#include "event.h"
 
@@ -117,7 +120,8 @@ TEST(Queue, Thread)
 
     push.start(qt_test, & qt);
 
-    while ((qt.count < total) || (queue->queued()))
+    // qt.count is incremented before the put(), so count the messages read
+    for (int i = 0; i < total; i++)
     {
         struct Event event;
         bool ok = queue->get((Queue::Message*) & event, 0);
@@ -139,6 +143,288 @@ TEST(Queue, Thread)
 
 #endif
 
+    /*
+     *  Timeouts
+     */
+
+TEST(Queue, Timeout)
+{
+    Queue *queue = Queue::create(sizeof(struct Event), 10, 0);
+
+    struct Event e;
+    Stopwatch sw;
+    bool ok = queue->get((Queue::Message *) & e, 50);
+    const double t = sw.elapsed();
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(t >= 0.045);
+    EXPECT_TRUE(t < 1.0);
+
+    // no wait if there is data
+    struct Event event = { .num = 123, };
+    queue->put((Queue::Message *) & event);
+    ok = queue->get((Queue::Message *) & e, 1000);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(123, e.num);
+
+    delete queue;
+}
+
+TEST(Queue, SemaphoreTimeout)
+{
+    Semaphore *s = Semaphore::create();
+
+    Stopwatch sw;
+    s->wait_timeout(50);
+    const double t = sw.elapsed();
+    EXPECT_TRUE(t >= 0.045);
+    EXPECT_TRUE(t < 1.0);
+
+    s->post();
+    sw.reset();
+    s->wait_timeout(1000);
+    EXPECT_TRUE(sw.elapsed() < 0.5);
+
+    delete s;
+}
+
+    /*
+     *  Batch get / put
+     */
+
+TEST(Queue, Many)
+{
+    const int num = 10;
+    Queue *queue = Queue::create(sizeof(struct Event), num, 0);
+
+    struct Event in[num];
+    for (int i = 0; i < num; i++)
+    {
+        in[i].num = 100 + i;
+    }
+
+    // the whole queue can be filled
+    EXPECT_EQ(num, queue->put_many((Queue::Message *) in, num));
+    EXPECT_EQ(num, queue->queued());
+
+    struct Event out[num];
+    memset(out, 0, sizeof(out));
+    EXPECT_EQ(4, queue->get_many((Queue::Message *) out, 4, 1));
+    EXPECT_EQ(num - 4, queue->queued());
+    EXPECT_EQ(num - 4, queue->get_many((Queue::Message *) & out[4], num, 1));
+    EXPECT_EQ(0, queue->queued());
+    EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+
+    // times out when empty
+    EXPECT_EQ(0, queue->get_many((Queue::Message *) out, num, 10));
+
+    delete queue;
+}
+
+    /*
+     *  Benchmark : draining bursts with get() vs get_many()
+     */
+
+struct Burst
+{
+    Queue *queue;
+    int loops;
+    int burst;
+};
+
+static void burst_put(void *arg)
+{
+    ASSERT(arg);
+    struct Burst *b = (struct Burst *) arg;
+    struct Event events[64];
+    ASSERT(b->burst <= 64);
+
+    for (int i = 0; i < b->loops; i++)
+    {
+        for (int j = 0; j < b->burst; j++)
+        {
+            events[j].num = (i * b->burst) + j;
+        }
+        b->queue->put_many((Queue::Message *) events, b->burst);
+    }
+}
+
+TEST(Queue, Bench)
+{
+    const int burst = 32;
+    const int loops = 5000;
+    const int total = burst * loops;
+
+    for (int many = 0; many < 2; many++)
+    {
+        Queue *queue = Queue::create(sizeof(struct Event), 128, 0);
+        struct Burst b = { .queue = queue, .loops = loops, .burst = burst, };
+
+        Thread *thread = Thread::create("burst");
+        Stopwatch sw;
+        thread->start(burst_put, & b);
+
+        int next = 0;
+        while (next < total)
+        {
+            struct Event events[burst];
+            const int n = many ? queue->get_many((Queue::Message *) events, burst, 0)
+                               : (queue->get((Queue::Message *) events, 0) ? 1 : 0);
+            for (int i = 0; i < n; i++)
+            {
+                EXPECT_EQ(next, events[i].num);
+                next += 1;
+            }
+        }
+        const double t = sw.elapsed();
+
+        thread->join();
+        delete thread;
+        delete queue;
+
+        PO_INFO("%-8s msgs=%d %.2f M msgs/s", many ? "get_many" : "get", total, (total / t) / 1e6);
+    }
+}
+
+    /*
+     *  In-place reserve / commit, peek / release
+     */
+
+TEST(Queue, InPlace)
+{
+    const int num = 3;
+    Queue *queue = Queue::create(sizeof(struct Event), num, 0);
+
+    struct Event *e1 = (struct Event *) queue->reserve();
+    struct Event *e2 = (struct Event *) queue->reserve();
+    struct Event *e3 = (struct Event *) queue->reserve();
+    e1->num = 1;
+    e2->num = 2;
+    e3->num = 3;
+
+    // committed out of order : nothing readable until e1 is committed
+    queue->commit((Queue::Message *) e3);
+    queue->commit((Queue::Message *) e2);
+    EXPECT_EQ(0, queue->queued());
+    EXPECT_FALSE(queue->peek(1));
+    queue->commit((Queue::Message *) e1);
+    EXPECT_EQ(3, queue->queued());
+
+    struct Event *p1 = (struct Event *) queue->peek(1);
+    struct Event *p2 = (struct Event *) queue->peek(1);
+    struct Event *p3 = (struct Event *) queue->peek(1);
+    EXPECT_EQ(e1, p1);
+    EXPECT_EQ(1, p1->num);
+    EXPECT_EQ(2, p2->num);
+    EXPECT_EQ(3, p3->num);
+    EXPECT_EQ(0, queue->queued());
+
+    // released out of order
+    queue->release((Queue::Message *) p2);
+    queue->release((Queue::Message *) p3);
+    queue->release((Queue::Message *) p1);
+
+    // the copying API still works, and wraps round the slots
+    for (int i = 0; i < (num * 2); i++)
+    {
+        struct Event event = { .num = 100 + i, };
+        EXPECT_TRUE(queue->put((Queue::Message *) & event));
+        struct Event *p = (struct Event *) queue->peek(1);
+        EXPECT_TRUE(p);
+        EXPECT_EQ(100 + i, p->num);
+        queue->release((Queue::Message *) p);
+    }
+    EXPECT_EQ(0, queue->queued());
+
+    delete queue;
+}
+
+    /*
+     *  Benchmark : large messages, copied vs in-place
+     */
+
+struct Big
+{
+    int seq;
+    uint8_t data[4096 - sizeof(int)];
+};
+
+struct BigDef
+{
+    Queue *queue;
+    int loops;
+    bool in_place;
+};
+
+static void big_put(void *arg)
+{
+    ASSERT(arg);
+    struct BigDef *def = (struct BigDef *) arg;
+    struct Big *big = new struct Big;
+
+    for (int i = 0; i < def->loops; i++)
+    {
+        struct Big *b = def->in_place ? (struct Big *) def->queue->reserve() : big;
+        b->seq = i;
+        memset(b->data, i & 0xff, sizeof(b->data));
+        if (def->in_place)
+        {
+            def->queue->commit((Queue::Message *) b);
+        }
+        else
+        {
+            def->queue->put((Queue::Message *) b);
+        }
+    }
+
+    delete big;
+}
+
+TEST(Queue, InPlaceBench)
+{
+    const int loops = 20000;
+
+    for (int in_place = 0; in_place < 2; in_place++)
+    {
+        Queue *queue = Queue::create(sizeof(struct Big), 16, 0);
+        struct BigDef def = { .queue = queue, .loops = loops, .in_place = bool(in_place), };
+        struct Big *big = new struct Big;
+
+        Thread *thread = Thread::create("big");
+        Stopwatch sw;
+        thread->start(big_put, & def);
+
+        int sum = 0;
+        for (int i = 0; i < loops; i++)
+        {
+            struct Big *b = big;
+            if (in_place)
+            {
+                b = (struct Big *) queue->peek(0);
+            }
+            else
+            {
+                queue->get((Queue::Message *) b, 0);
+            }
+            EXPECT_EQ(i, b->seq);
+            sum += b->data[i % sizeof(b->data)];
+            if (in_place)
+            {
+                queue->release((Queue::Message *) b);
+            }
+        }
+        const double t = sw.elapsed();
+        IGNORE(sum);
+
+        thread->join();
+        delete thread;
+        delete big;
+        delete queue;
+
+        PO_INFO("%-8s msg=%dB %.0f MB/s", in_place ? "in-place" : "copy",
+                int(sizeof(struct Big)), ((loops * sizeof(struct Big)) / t) / 1e6);
+    }
+}
+
 // Linker fooling
 void force_test_queue() { }
 
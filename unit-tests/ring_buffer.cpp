@@ -0,0 +1,234 @@
+
+#include <sched.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "panglos/debug.h"
+#include "panglos/thread.h"
+
+#include "panglos/ring_buffer.h"
+
+#include "bench.h"
+
+using namespace panglos;
+
+    /*
+     *
+     */
+
+TEST(SpscRing, Basic)
+{
+    SpscRing<int> ring(8);
+
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(8u, ring.capacity());
+
+    int v;
+    EXPECT_FALSE(ring.pop(& v));
+
+    for (int i = 0; i < 8; i++)
+    {
+        EXPECT_TRUE(ring.push(i));
+    }
+    // full
+    EXPECT_FALSE(ring.push(100));
+    EXPECT_EQ(8u, ring.size());
+
+    for (int i = 0; i < 8; i++)
+    {
+        EXPECT_TRUE(ring.pop(& v));
+        EXPECT_EQ(i, v);
+    }
+    EXPECT_TRUE(ring.empty());
+
+    // wrap the indices many times
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_TRUE(ring.push(i));
+        EXPECT_TRUE(ring.push(i + 1000));
+        EXPECT_TRUE(ring.pop(& v));
+        EXPECT_EQ(i, v);
+        EXPECT_TRUE(ring.pop(& v));
+        EXPECT_EQ(i + 1000, v);
+    }
+}
+
+TEST(SpscRing, Span)
+{
+    SpscRing<uint8_t, uint16_t> ring(16);
+    uint8_t *p;
+
+    EXPECT_EQ(16, ring.write_span(& p));
+    EXPECT_EQ(0, ring.read_span(& p));
+
+    // move the indices near the end
+    uint8_t buff[32];
+    memset(buff, 0, sizeof(buff));
+    EXPECT_EQ(12, ring.write(buff, 12));
+    EXPECT_EQ(12, ring.read(buff, 12));
+
+    // the span stops at the end of the buffer
+    EXPECT_EQ(4, ring.write_span(& p));
+    memcpy(p, "abcd", 4);
+    ring.commit(4);
+    EXPECT_EQ(12, ring.write_span(& p));
+    memcpy(p, "efgh", 4);
+    ring.commit(4);
+
+    EXPECT_EQ(4, ring.read_span(& p));
+    EXPECT_EQ(0, memcmp(p, "abcd", 4));
+    ring.consume(4);
+    EXPECT_EQ(4, ring.read_span(& p));
+    EXPECT_EQ(0, memcmp(p, "efgh", 4));
+    ring.consume(2);
+    EXPECT_EQ(2, ring.read_span(& p));
+    EXPECT_EQ(0, memcmp(p, "gh", 2));
+    ring.consume(2);
+    EXPECT_TRUE(ring.empty());
+
+    // bulk write / read across the end
+    for (int i = 0; i < 20; i++)
+    {
+        buff[i] = uint8_t(i);
+    }
+    EXPECT_EQ(16, ring.write(buff, 20));
+    uint8_t out[32];
+    EXPECT_EQ(16, ring.read(out, 32));
+    EXPECT_EQ(0, memcmp(buff, out, 16));
+}
+
+    /*
+     *  Producer / consumer on two threads, pinned to separate cpus
+     */
+
+struct Pipe
+{
+    SpscRing<uint32_t> *ring;
+    uint32_t count;
+    bool bulk;
+    bool ok;
+};
+
+static void producer(void *arg)
+{
+    ASSERT(arg);
+    Pipe *pipe = (Pipe*) arg;
+    SpscRing<uint32_t> *ring = pipe->ring;
+
+    uint32_t next = 0;
+    while (next < pipe->count)
+    {
+        if (!pipe->bulk)
+        {
+            if (ring->push(next))
+            {
+                next += 1;
+            }
+            else
+            {
+                // full : let the consumer run, if it shares our cpu
+                sched_yield();
+            }
+            continue;
+        }
+
+        uint32_t *p;
+        uint32_t n = ring->write_span(& p);
+        if (!n)
+        {
+            sched_yield();
+            continue;
+        }
+        if (n > (pipe->count - next))
+        {
+            n = pipe->count - next;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            p[i] = next++;
+        }
+        ring->commit(n);
+    }
+}
+
+static void consumer(void *arg)
+{
+    ASSERT(arg);
+    Pipe *pipe = (Pipe*) arg;
+    SpscRing<uint32_t> *ring = pipe->ring;
+
+    uint32_t next = 0;
+    while (next < pipe->count)
+    {
+        if (!pipe->bulk)
+        {
+            uint32_t v;
+            if (ring->pop(& v))
+            {
+                pipe->ok &= (v == next);
+                next += 1;
+            }
+            else
+            {
+                sched_yield();
+            }
+            continue;
+        }
+
+        uint32_t *p;
+        const uint32_t n = ring->read_span(& p);
+        if (!n)
+        {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            pipe->ok &= (p[i] == next++);
+        }
+        ring->consume(n);
+    }
+}
+
+static double run_pipe(uint32_t count, bool bulk)
+{
+    SpscRing<uint32_t> ring(1024);
+    Pipe pipe = { .ring = & ring, .count = count, .bulk = bulk, .ok = true, };
+
+    Thread *tx = Thread::create("tx");
+    Thread *rx = Thread::create("rx");
+
+    Stopwatch sw;
+    rx->start(consumer, & pipe, 1);
+    tx->start(producer, & pipe, 0);
+    tx->join();
+    rx->join();
+    const double t = sw.elapsed();
+
+    EXPECT_TRUE(pipe.ok);
+    EXPECT_TRUE(ring.empty());
+
+    delete rx;
+    delete tx;
+    return t;
+}
+
+TEST(SpscRing, Threads)
+{
+    run_pipe(100000, false);
+    run_pipe(100000, true);
+}
+
+TEST(SpscRing, Bench)
+{
+    const uint32_t count = 4000000;
+
+    const double t_item = run_pipe(count, false);
+    const double t_bulk = run_pipe(count, true);
+
+    PO_INFO("items=%u push/pop=%.1f M/s span=%.1f M/s", count,
+            double(count) / (t_item * 1e6), double(count) / (t_bulk * 1e6));
+}
+
+//  FIN
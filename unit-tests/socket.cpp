@@ -1,4 +1,11 @@
 
+#include <atomic>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netdb.h>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
@@ -7,6 +14,8 @@
 #include "panglos/time.h"
 #include "panglos/socket.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
     /*
@@ -138,4 +147,434 @@ TEST(Socket, Test)
     delete s;
 }
 
+    /*
+     *  REACTOR mode : load test
+     */
+
+struct ReactorStats
+{
+    std::atomic<int> connected;
+    std::atomic<int> bytes;
+    std::atomic<int> closed;
+};
+
+class ReactorEcho : public Client
+{
+    struct ReactorStats *stats;
+
+    virtual void run() override { ASSERT(0); }
+
+    virtual void on_connect() override
+    {
+        stats->connected += 1;
+    }
+
+    virtual void on_read(const uint8_t *data, int n) override
+    {
+        stats->bytes += n;
+        const int s = sock->send(data, size_t(n));
+        EXPECT_EQ(s, n);
+    }
+
+    virtual void on_close() override
+    {
+        stats->closed += 1;
+    }
+
+public:
+    ReactorEcho(SocketServer *ss, struct ReactorStats *s)
+    :   Client(ss),
+        stats(s)
+    {
+    }
+};
+
+class ReactorFactory : public Client::Factory
+{
+public:
+    Socket *socket;
+    struct ReactorStats *stats;
+    SocketServer *ss;
+
+    virtual Client *create_client(SocketServer *_ss) override
+    {
+        ss = _ss;
+        return new ReactorEcho(_ss, stats);
+    }
+
+    static void run(void *arg)
+    {
+        ASSERT(arg);
+        ReactorFactory *factory = (ReactorFactory *) arg;
+        run_socket_server(factory->socket, factory, REACTOR);
+    }
+};
+
+static int connect_local(const char *port)
+{
+    struct addrinfo *addr = 0;
+    int err = getaddrinfo("localhost", port, 0, & addr);
+    EXPECT_EQ(0, err);
+    int fd = -1;
+    // the server may not be listening yet
+    for (int retry = 0; retry < 100; retry++)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        err = connect(fd, addr->ai_addr, addr->ai_addrlen);
+        if (err == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+        Time::msleep(10);
+    }
+    freeaddrinfo(addr);
+    return fd;
+}
+
+// each connection uses 2 fds in this process : scale to the fd limit
+static int max_connections(int want)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, & rl) != 0)
+    {
+        return 0;
+    }
+    if (rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, & rl);
+        getrlimit(RLIMIT_NOFILE, & rl);
+    }
+    // leave some for the test harness
+    const rlim_t spare = 64;
+    if (rl.rlim_cur < (2 * rlim_t(want)) + spare)
+    {
+        return (rl.rlim_cur > spare) ? int((rl.rlim_cur - spare) / 2) : 0;
+    }
+    return want;
+}
+
+TEST(Socket, Reactor)
+{
+    const char *port = "6668";
+    const int num = max_connections(1000);
+    ASSERT_TRUE(num > 0);
+
+    struct ReactorStats stats;
+    stats.connected = 0;
+    stats.bytes = 0;
+    stats.closed = 0;
+
+    ReactorFactory factory;
+    factory.socket = Socket::open_tcpip("localhost", port, Socket::SERVER);
+    ASSERT_TRUE(factory.socket);
+    factory.stats = & stats;
+    factory.ss = 0;
+
+    Thread *server = Thread::create("reactor");
+    server->start(ReactorFactory::run, & factory);
+
+    Stopwatch sw;
+    int *fds = new int[num];
+    for (int i = 0; i < num; i++)
+    {
+        fds[i] = connect_local(port);
+        ASSERT_TRUE(fds[i] >= 0);
+    }
+    const double t_connect = sw.elapsed();
+
+    // send a message on every connection, check the echo
+    sw.reset();
+    for (int i = 0; i < num; i++)
+    {
+        char msg[32];
+        const int n = snprintf(msg, sizeof(msg), "hello %d", i);
+        EXPECT_EQ(n, (int) send(fds[i], msg, size_t(n), 0));
+    }
+    for (int i = 0; i < num; i++)
+    {
+        char expect[32];
+        const int n = snprintf(expect, sizeof(expect), "hello %d", i);
+        char buff[32] = { 0 };
+        int got = 0;
+        while (got < n)
+        {
+            const int r = int(recv(fds[i], & buff[got], size_t(n - got), 0));
+            ASSERT_TRUE(r > 0);
+            got += r;
+        }
+        EXPECT_STREQ(expect, buff);
+    }
+    const double t_echo = sw.elapsed();
+
+    EXPECT_EQ(num, stats.connected);
+
+    for (int i = 0; i < num; i++)
+    {
+        close(fds[i]);
+    }
+
+    // wait for the server to see the connections close
+    for (int i = 0; (i < 500) && (stats.closed < num); i++)
+    {
+        Time::msleep(10);
+    }
+    EXPECT_EQ(num, stats.closed);
+
+    PO_INFO("connections=%d connect=%.1fms echo=%.1fms", num, t_connect * 1e3, t_echo * 1e3);
+
+    ASSERT_TRUE(factory.ss);
+    factory.ss->kill();
+    server->join();
+    delete server;
+    delete factory.socket;
+    delete[] fds;
+}
+
+    /*
+     *  REACTOR mode : a writer thread, and a close requested by the client
+     */
+
+class ReactorPusher : public Client
+{
+    struct ReactorStats *stats;
+    Thread *thread;
+
+    virtual void run() override { ASSERT(0); }
+
+    static void push(void *arg)
+    {
+        ReactorPusher *client = (ReactorPusher *) arg;
+        const uint8_t data[] = "data";
+        while (client->sock->send(data, sizeof(data)) >= 0)
+        {
+            client->stats->bytes += int(sizeof(data));
+            Time::msleep(1);
+        }
+    }
+
+    virtual void on_connect() override
+    {
+        stats->connected += 1;
+        thread = Thread::create("pusher");
+        thread->start(push, this);
+    }
+
+    virtual void on_read(const uint8_t *, int) override
+    {
+        // any input asks the server to close the connection
+        request_close();
+    }
+
+    virtual void on_close() override
+    {
+        // send() now fails, so the thread exits
+        thread->join();
+        delete thread;
+        thread = 0;
+        stats->closed += 1;
+    }
+
+public:
+    ReactorPusher(SocketServer *ss, struct ReactorStats *s)
+    :   Client(ss),
+        stats(s),
+        thread(0)
+    {
+    }
+};
+
+class PusherFactory : public ReactorFactory
+{
+public:
+    virtual Client *create_client(SocketServer *_ss) override
+    {
+        ss = _ss;
+        return new ReactorPusher(_ss, stats);
+    }
+};
+
+TEST(Socket, ReactorClose)
+{
+    const char *port = "6671";
+
+    struct ReactorStats stats;
+    stats.connected = 0;
+    stats.bytes = 0;
+    stats.closed = 0;
+
+    PusherFactory factory;
+    factory.socket = Socket::open_tcpip("localhost", port, Socket::SERVER);
+    ASSERT_TRUE(factory.socket);
+    factory.stats = & stats;
+    factory.ss = 0;
+
+    Thread *server = Thread::create("reactor");
+    server->start(ReactorFactory::run, & factory);
+
+    for (int cycle = 0; cycle < 20; cycle++)
+    {
+        const int fd = connect_local(port);
+        ASSERT_TRUE(fd >= 0);
+
+        // wait for some data from the writer thread
+        char buff[64];
+        ASSERT_TRUE(recv(fd, buff, sizeof(buff), 0) > 0);
+
+        EXPECT_EQ(1, (int) send(fd, "q", 1, 0));
+
+        // drain until the server closes the connection
+        while (recv(fd, buff, sizeof(buff), 0) > 0)
+        {
+        }
+        close(fd);
+
+        for (int i = 0; (i < 500) && (stats.closed <= cycle); i++)
+        {
+            Time::msleep(10);
+        }
+        EXPECT_EQ(cycle + 1, stats.closed);
+    }
+
+    EXPECT_EQ(20, stats.connected);
+    EXPECT_TRUE(stats.bytes > 0);
+
+    ASSERT_TRUE(factory.ss);
+    factory.ss->kill();
+    server->join();
+    delete server;
+    delete factory.socket;
+}
+
+    /*
+     *  REACTOR mode : a writer faster than the peer waits for space
+     */
+
+class ReactorBulk : public Client
+{
+    struct ReactorStats *stats;
+    Thread *thread;
+
+    virtual void run() override { ASSERT(0); }
+
+    static void push(void *arg)
+    {
+        ReactorBulk *client = (ReactorBulk *) arg;
+        uint8_t data[4096];
+        memset(data, 'x', sizeof(data));
+        int sent = 0;
+        while (sent < client->total)
+        {
+            const size_t len = size_t(client->total - sent);
+            const int n = client->sock->send(data, (len < sizeof(data)) ? len : sizeof(data));
+            if (n < 0)
+            {
+                break;
+            }
+            if (n == 0)
+            {
+                client->waits += 1;
+                if (!client->sock->wait_send(100))
+                {
+                    break;
+                }
+            }
+            sent += n;
+        }
+        client->stats->bytes += sent;
+    }
+
+    virtual void on_connect() override
+    {
+        stats->connected += 1;
+        thread = Thread::create("bulk");
+        thread->start(push, this);
+    }
+
+    virtual void on_close() override
+    {
+        thread->join();
+        delete thread;
+        thread = 0;
+        stats->closed += 1;
+    }
+
+public:
+    static const int total = 8 * 1024 * 1024;
+    static std::atomic<int> waits;
+
+    ReactorBulk(SocketServer *ss, struct ReactorStats *s)
+    :   Client(ss),
+        stats(s),
+        thread(0)
+    {
+    }
+};
+
+const int ReactorBulk::total;
+std::atomic<int> ReactorBulk::waits(0);
+
+class BulkFactory : public ReactorFactory
+{
+public:
+    virtual Client *create_client(SocketServer *_ss) override
+    {
+        ss = _ss;
+        return new ReactorBulk(_ss, stats);
+    }
+};
+
+TEST(Socket, ReactorWaitSend)
+{
+    const char *port = "6672";
+
+    struct ReactorStats stats;
+    stats.connected = 0;
+    stats.bytes = 0;
+    stats.closed = 0;
+    ReactorBulk::waits = 0;
+
+    BulkFactory factory;
+    factory.socket = Socket::open_tcpip("localhost", port, Socket::SERVER);
+    ASSERT_TRUE(factory.socket);
+    factory.stats = & stats;
+    factory.ss = 0;
+
+    Thread *server = Thread::create("reactor");
+    server->start(ReactorFactory::run, & factory);
+
+    const int fd = connect_local(port);
+    ASSERT_TRUE(fd >= 0);
+
+    // let the writer fill the socket and its output buffer
+    Time::msleep(100);
+
+    int got = 0;
+    while (got < ReactorBulk::total)
+    {
+        char buff[4096];
+        const int n = int(recv(fd, buff, sizeof(buff), 0));
+        ASSERT_TRUE(n > 0);
+        got += n;
+    }
+    close(fd);
+
+    for (int i = 0; (i < 500) && (stats.closed < 1); i++)
+    {
+        Time::msleep(10);
+    }
+    EXPECT_EQ(1, stats.closed);
+    EXPECT_EQ(ReactorBulk::total, got);
+    EXPECT_EQ(ReactorBulk::total, stats.bytes);
+    EXPECT_TRUE(ReactorBulk::waits > 0);
+
+    ASSERT_TRUE(factory.ss);
+    factory.ss->kill();
+    server->join();
+    delete server;
+    delete factory.socket;
+}
+
 //  FIN
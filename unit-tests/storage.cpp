@@ -1,8 +1,16 @@
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "gtest/gtest.h"
 
+#include "panglos/debug.h"
+#include "panglos/hash.h"
 #include "panglos/storage.h"
 
+#include "bench.h"
+
 using namespace panglos;
 
 TEST(Storage, String)
@@ -358,4 +366,341 @@ TEST(Storage, GetParams32)
     EXPECT_EQ(e, 5);
 }
 
+    /*
+     *  Persistence : append-only log
+     */
+
+static const char *log_path = "/tmp/panglos_storage_test.log";
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    if (stat(path, & st)) return 0;
+    return size_t(st.st_size);
+}
+
+TEST(Storage, Persist)
+{
+    Storage::clear_all();
+    unlink(log_path);
+
+    bool ok;
+    ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+
+    {
+        Storage db("test");
+        db.set("i8", int8_t(12));
+        db.set("i16", int16_t(1234));
+        db.set("i32", int32_t(12345678));
+        db.set("str", "hello");
+        const uint8_t blob[] = { 1, 2, 3, 4, 5 };
+        db.set_blob("blob", (void*) blob, sizeof(blob));
+        db.set("gone", int32_t(1));
+        db.erase("gone");
+        ok = db.commit();
+        EXPECT_TRUE(ok);
+
+        // not committed
+        db.set("lost", int32_t(2));
+    }
+
+    // restart
+    Storage::clear_all();
+    ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+
+    {
+        Storage db("test");
+        int8_t i8 = 0;
+        int16_t i16 = 0;
+        int32_t i32 = 0;
+        EXPECT_TRUE(db.get("i8", & i8));
+        EXPECT_EQ(12, i8);
+        EXPECT_TRUE(db.get("i16", & i16));
+        EXPECT_EQ(1234, i16);
+        EXPECT_TRUE(db.get("i32", & i32));
+        EXPECT_EQ(12345678, i32);
+
+        char buff[16];
+        size_t sz = sizeof(buff);
+        EXPECT_TRUE(db.get("str", buff, & sz));
+        EXPECT_STREQ("hello", buff);
+
+        uint8_t blob[8];
+        sz = sizeof(blob);
+        EXPECT_TRUE(db.get_blob("blob", blob, & sz));
+        EXPECT_EQ(5, int(sz));
+        EXPECT_EQ(5, blob[4]);
+
+        EXPECT_EQ(Storage::VAL_NONE, db.get_type("gone"));
+        EXPECT_EQ(Storage::VAL_NONE, db.get_type("lost"));
+    }
+
+    Storage::clear_all();
+    unlink(log_path);
+}
+
+TEST(Storage, Torn)
+{
+    Storage::clear_all();
+    unlink(log_path);
+
+    bool ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    {
+        Storage db("test");
+        db.set("a", int32_t(1));
+        EXPECT_TRUE(db.commit());
+        db.set("b", int32_t(2));
+        EXPECT_TRUE(db.commit());
+    }
+    Storage::clear_all();
+
+    // simulate a crash part way through the 2nd commit
+    const size_t size = file_size(log_path);
+    int err = truncate(log_path, off_t(size - 3));
+    EXPECT_EQ(0, err);
+
+    ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    {
+        Storage db("test");
+        int32_t v = 0;
+        EXPECT_TRUE(db.get("a", & v));
+        EXPECT_EQ(1, v);
+        EXPECT_FALSE(db.get("b", & v));
+
+        // the torn frame has been removed, so we can append to the log
+        db.set("c", int32_t(3));
+        EXPECT_TRUE(db.commit());
+    }
+    Storage::clear_all();
+
+    ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    {
+        Storage db("test");
+        int32_t v = 0;
+        EXPECT_TRUE(db.get("a", & v));
+        EXPECT_TRUE(db.get("c", & v));
+        EXPECT_EQ(3, v);
+    }
+
+    Storage::clear_all();
+    unlink(log_path);
+}
+
+TEST(Storage, BadLength)
+{
+    Storage::clear_all();
+    unlink(log_path);
+
+    bool ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    size_t first = 0;
+    {
+        Storage db("test");
+        db.set("a", int32_t(1));
+        EXPECT_TRUE(db.commit());
+        first = file_size(log_path);
+        db.set("b", int32_t(2));
+        EXPECT_TRUE(db.commit());
+    }
+    Storage::clear_all();
+
+    // corrupt the length of the 2nd frame : { magic, len, crc }
+    const uint32_t lens[] = { 0xffffffff, 0x7fffffff, 100000 };
+    for (uint32_t len : lens)
+    {
+        int fd = open(log_path, O_WRONLY);
+        ASSERT_NE(-1, fd);
+        EXPECT_EQ(ssize_t(sizeof(len)), pwrite(fd, & len, sizeof(len), off_t(first + sizeof(uint32_t))));
+        close(fd);
+
+        // treated as a torn tail, and truncated
+        ok = Storage::load(log_path);
+        EXPECT_TRUE(ok);
+        EXPECT_EQ(first, file_size(log_path));
+        {
+            Storage db("test");
+            int32_t v = 0;
+            EXPECT_TRUE(db.get("a", & v));
+            EXPECT_FALSE(db.get("b", & v));
+            db.set("b", int32_t(2));
+            EXPECT_TRUE(db.commit());
+        }
+        Storage::clear_all();
+    }
+
+    unlink(log_path);
+}
+
+TEST(Storage, BadOp)
+{
+    // corrupt the 2nd op of a frame, with a valid checksum : { offset in op, byte }
+    const struct Corrupt { size_t at; uint8_t v; } corrupt[] = {
+        { 0, 9 },                   // unknown op
+        { 1, 99 },                  // unknown type
+        { 1, Storage::VAL_NONE },   // no value type
+        { 1, Storage::VAL_INT8 },   // value_len 4 for an int8
+        { 10 + 4, 'x' },            // ns not '\0' terminated
+        { 10 + 5 + 1, 'x' },        // key not '\0' terminated
+    };
+
+    for (const struct Corrupt & c : corrupt)
+    {
+        Storage::clear_all();
+        unlink(log_path);
+
+        bool ok = Storage::load(log_path);
+        EXPECT_TRUE(ok);
+        size_t first = 0;
+        {
+            Storage db("test");
+            db.set("a", int32_t(1));
+            EXPECT_TRUE(db.commit());
+            first = file_size(log_path);
+            db.set("b", int32_t(2));
+            db.set("c", int32_t(3));
+            EXPECT_TRUE(db.commit());
+        }
+        Storage::clear_all();
+
+        // frame { magic, len, sum } then 2 ops of { hdr[10], "test", "b", int32 }
+        const size_t hdr = 3 * sizeof(uint32_t);
+        const size_t op_len = 10 + 5 + 2 + 4;
+        const size_t len = file_size(log_path) - first - hdr;
+        ASSERT_EQ(2 * op_len, len);
+
+        uint8_t buff[2 * op_len];
+        int fd = open(log_path, O_RDWR);
+        ASSERT_NE(-1, fd);
+        EXPECT_EQ(ssize_t(len), pread(fd, buff, len, off_t(first + hdr)));
+        buff[op_len + c.at] = c.v;
+        const uint32_t sum = fnv1a(buff, len);
+        EXPECT_EQ(ssize_t(len), pwrite(fd, buff, len, off_t(first + hdr)));
+        EXPECT_EQ(ssize_t(sizeof(sum)), pwrite(fd, & sum, sizeof(sum), off_t(first + (2 * sizeof(uint32_t)))));
+        close(fd);
+
+        // none of the frame is applied, and it is truncated
+        ok = Storage::load(log_path);
+        EXPECT_TRUE(ok);
+        EXPECT_EQ(first, file_size(log_path));
+        {
+            Storage db("test");
+            int32_t v = 0;
+            EXPECT_TRUE(db.get("a", & v));
+            EXPECT_FALSE(db.get("b", & v));
+            EXPECT_FALSE(db.get("c", & v));
+        }
+    }
+
+    Storage::clear_all();
+    unlink(log_path);
+}
+
+TEST(Storage, Compact)
+{
+    Storage::clear_all();
+    unlink(log_path);
+
+    bool ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    {
+        // overwrite a few keys many times
+        Storage db("test");
+        for (int i = 0; i < 10000; i++)
+        {
+            db.set("a", int32_t(i));
+            db.set("b", "some string or other");
+            EXPECT_TRUE(db.commit());
+        }
+    }
+
+    // the log has been compacted
+    EXPECT_TRUE(file_size(log_path) < (128 * 1024));
+    Storage::clear_all();
+
+    ok = Storage::load(log_path);
+    EXPECT_TRUE(ok);
+    {
+        Storage db("test");
+        int32_t v = 0;
+        EXPECT_TRUE(db.get("a", & v));
+        EXPECT_EQ(9999, v);
+    }
+
+    // save() writes a snapshot
+    const char *snap = "/tmp/panglos_storage_test.snap";
+    ok = Storage::save(snap);
+    EXPECT_TRUE(ok);
+    Storage::clear_all();
+    ok = Storage::load(snap);
+    EXPECT_TRUE(ok);
+    {
+        Storage db("test");
+        int32_t v = 0;
+        EXPECT_TRUE(db.get("a", & v));
+        EXPECT_EQ(9999, v);
+    }
+
+    Storage::clear_all();
+    unlink(snap);
+    unlink(log_path);
+}
+
+TEST(Storage, Bench)
+{
+    Storage::clear_all();
+    unlink(log_path);
+
+    const int num = 10000;
+    char (*keys)[16] = new char[num][16];
+    for (int i = 0; i < num; i++)
+    {
+        snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+    }
+
+    Storage db("bench");
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const bool logged = pass == 1;
+        if (logged)
+        {
+            Storage::clear_all();
+            EXPECT_TRUE(Storage::load(log_path));
+        }
+
+        Stopwatch sw;
+        for (int i = 0; i < num; i++)
+        {
+            db.set(keys[i], int32_t(i));
+        }
+        const double set = sw.elapsed();
+
+        sw.reset();
+        for (int i = 0; i < num; i++)
+        {
+            int32_t v = 0;
+            const int idx = (i * 7919) % num;
+            EXPECT_TRUE(db.get(keys[idx], & v));
+            EXPECT_EQ(idx, v);
+        }
+        const double get = sw.elapsed();
+
+        sw.reset();
+        EXPECT_TRUE(db.commit());
+        const double commit = sw.elapsed();
+
+        PO_INFO("%s keys=%d set=%.0f/s get=%.0f/s commit=%.3f ms",
+                logged ? "log" : "ram", num, num / set, num / get, commit * 1e3);
+    }
+
+    delete[] keys;
+    Storage::clear_all();
+    unlink(log_path);
+}
+
 //  FIN
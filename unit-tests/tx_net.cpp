@@ -0,0 +1,215 @@
+
+#include <atomic>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "panglos/debug.h"
+#include "panglos/thread.h"
+#include "panglos/time.h"
+#include "panglos/socket.h"
+#include "panglos/tx_net.h"
+
+#include "bench.h"
+
+using namespace panglos;
+
+    /*
+     *  Wrap the TxFactory, so the test can kill the server.
+     *
+     *  Any connection after the first two is only used to unblock accept()
+     */
+
+class NullClient : public Client
+{
+    virtual void run() override { }
+public:
+    NullClient(SocketServer *ss) : Client(ss) { }
+};
+
+class Wrap : public Client::Factory
+{
+public:
+    Client::Factory *factory;
+    Socket *socket;
+    SocketServer *ss;
+    std::atomic<int> count;
+
+    Wrap(Client::Factory *f, Socket *s) : factory(f), socket(s), ss(0), count(0) { }
+
+    virtual Client *create_client(SocketServer *_ss) override
+    {
+        ss = _ss;
+        count += 1;
+        if (count > 2)
+        {
+            return new NullClient(_ss);
+        }
+        return factory->create_client(_ss);
+    }
+
+    static void run(void *arg)
+    {
+        ASSERT(arg);
+        Wrap *wrap = (Wrap *) arg;
+        run_socket_server(wrap->socket, wrap);
+    }
+};
+
+static int connect_local(const char *port, int rcvbuf=0)
+{
+    struct addrinfo *addr = 0;
+    int err = getaddrinfo("localhost", port, 0, & addr);
+    EXPECT_EQ(0, err);
+    int fd = -1;
+    // the server may not be listening yet
+    for (int retry = 0; retry < 100; retry++)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (rcvbuf)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, & rcvbuf, sizeof(rcvbuf));
+        }
+        err = connect(fd, addr->ai_addr, addr->ai_addrlen);
+        if (err == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+        Time::msleep(10);
+    }
+    freeaddrinfo(addr);
+    return fd;
+}
+
+struct Reader
+{
+    int fd;
+    std::atomic<int> bytes;
+};
+
+static void reader(void *arg)
+{
+    ASSERT(arg);
+    struct Reader *r = (struct Reader *) arg;
+    uint8_t buff[4096];
+    while (true)
+    {
+        const int n = int(recv(r->fd, buff, sizeof(buff), 0));
+        if (n <= 0)
+        {
+            break;
+        }
+        r->bytes += n;
+    }
+}
+
+    /*
+     *  One fast and one stalled client. The source must never block.
+     */
+
+static void tx_run(const char *port, TxFactory::Policy policy, struct TxFactory::Stats *stats, int *fast_bytes)
+{
+    TxFactory *factory = TxFactory::create(8, policy);
+    Socket *sock = Socket::open_tcpip("localhost", port, Socket::SERVER);
+    ASSERT_TRUE(sock);
+    Wrap wrap(factory, sock);
+
+    Thread *server = Thread::create("tx_server");
+    server->start(Wrap::run, & wrap);
+
+    struct Reader fast;
+    fast.fd = connect_local(port);
+    fast.bytes = 0;
+    Thread *thread = Thread::create("tx_reader");
+    thread->start(reader, & fast);
+
+    // stalled client, never reads
+    const int slow = connect_local(port, 4096);
+    ASSERT_TRUE(slow >= 0);
+
+    // wait for both clients to be registered
+    while (wrap.count < 2)
+    {
+        Time::msleep(1);
+    }
+    Time::msleep(50);
+
+    Socket *tx = factory->get_socket();
+    uint8_t block[4096];
+    memset(block, 'x', sizeof(block));
+    const int loops = 3000;
+
+    // paced source, ~16MB/s : time only the send() calls
+    double t = 0;
+    Stopwatch sw;
+    for (int i = 0; i < loops; i++)
+    {
+        sw.reset();
+        tx->send(block, sizeof(block));
+        t += sw.elapsed();
+        if ((i % 4) == 3)
+        {
+            Time::msleep(1);
+        }
+    }
+
+    // let the writers finish
+    Time::msleep(200);
+    // before closing the clients, which can count as a disconnect
+    factory->get_stats(stats);
+
+    close(slow);
+    shutdown(fast.fd, SHUT_RDWR);
+    thread->join();
+    delete thread;
+    close(fast.fd);
+    *fast_bytes = fast.bytes;
+
+    // stop the server : it is blocked in accept()
+    ASSERT_TRUE(wrap.ss);
+    wrap.ss->kill();
+    const int dummy = connect_local(port);
+    server->join();
+    close(dummy);
+    delete server;
+
+    PO_INFO("policy=%s send=%.2f us/block fast=%d sent=%llu dropped=%d/%llu disconnects=%d",
+            (policy == TxFactory::DROP_OLDEST) ? "drop_oldest" : "disconnect",
+            (t * 1e6) / loops, *fast_bytes,
+            (unsigned long long) stats->sent_bytes, stats->dropped_blocks,
+            (unsigned long long) stats->dropped_bytes, stats->disconnects);
+
+    delete factory;
+    delete sock;
+}
+
+TEST(TxNet, DropOldest)
+{
+    struct TxFactory::Stats stats;
+    int fast = 0;
+    tx_run("6669", TxFactory::DROP_OLDEST, & stats, & fast);
+
+    // the stalled client must not stop the fast one
+    EXPECT_TRUE(fast > 0);
+    EXPECT_TRUE(stats.dropped_blocks > 0);
+    EXPECT_EQ(uint64_t(stats.dropped_blocks) * 4096, stats.dropped_bytes);
+    EXPECT_EQ(0, stats.disconnects);
+}
+
+TEST(TxNet, Disconnect)
+{
+    struct TxFactory::Stats stats;
+    int fast = 0;
+    tx_run("6670", TxFactory::DISCONNECT, & stats, & fast);
+
+    // only the stalled client is disconnected
+    EXPECT_TRUE(fast > 0);
+    EXPECT_EQ(1, stats.disconnects);
+}
+
+//  FIN
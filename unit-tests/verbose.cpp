@@ -2,9 +2,14 @@
 #include <gtest/gtest.h>
 
 #include "panglos/debug.h"
+#include "panglos/mutex.h"
+#include "panglos/logger.h"
+#include "panglos/storage.h"
 
 #include "panglos/verbose.h"
 
+#include "bench.h"
+
     /*
      *
      */
@@ -15,6 +20,9 @@ static VERBOSE(test, "test", true);
 static VERBOSE(one, "one", true);
 static VERBOSE(two, "two", false);
 
+// filter this file's logging with 'test'
+PO_MODULE(test);
+
 TEST(Verbose, Test)
 {
     for (struct Verbose *v = Verbose::verboses; v; v = v->next)
@@ -30,4 +38,148 @@ TEST(Verbose, Test)
     }
 }
 
+TEST(Verbose, Persist)
+{
+    Storage::clear_all();
+    {
+        Storage db("verbose");
+        EXPECT_TRUE(db.set("two", int32_t(1)));
+        Storage sdb("severity");
+        EXPECT_TRUE(sdb.set("one", "WARNING"));
+        // NONE has the same code as 'not found'
+        EXPECT_TRUE(sdb.set("two", "NONE"));
+        EXPECT_TRUE(sdb.set("test", "BOGUS"));
+    }
+
+    verbose_init();
+
+    EXPECT_TRUE(two.verbose);
+    EXPECT_EQ(S_WARNING, one.severity);
+    EXPECT_EQ(S_NONE, two.severity);
+    EXPECT_EQ(S_DEBUG, test.severity);
+
+    two.verbose = false;
+    one.severity = S_DEBUG;
+    two.severity = S_DEBUG;
+    Storage::clear_all();
+}
+
+TEST(Verbose, Lut)
+{
+    const LUT *code = lut_find(Severity_lut, "NONE");
+    ASSERT_TRUE(code);
+    EXPECT_EQ(S_NONE, code->code);
+    EXPECT_FALSE(lut_find(Severity_lut, "BOGUS"));
+    EXPECT_EQ(S_ERROR, rlut(Severity_lut, "ERROR"));
+}
+
+    /*
+     *  Filtered calls must not evaluate their args
+     */
+
+static int count = 0;
+
+static int next_value()
+{
+    return count++;
+}
+
+TEST(Verbose, Module)
+{
+    count = 0;
+    EXPECT_EQ(& test.severity, po_module_severity);
+
+    test.severity = S_WARNING;
+    PO_INFO("%d", next_value());
+    PO_DEBUG("%d", next_value());
+    EXPECT_EQ(0, count);
+
+    PO_WARNING("%d", next_value());
+    PO_ERROR("%d", next_value());
+    EXPECT_EQ(2, count);
+
+    test.severity = S_INFO;
+    PO_INFO("%d", next_value());
+    PO_DEBUG("%d", next_value());
+    EXPECT_EQ(3, count);
+
+    test.severity = S_DEBUG;
+}
+
+    /*
+     *  Compile-time minimum severity
+     */
+
+#undef PO_MIN_SEVERITY
+#define PO_MIN_SEVERITY S_INFO
+
+static void min_info()
+{
+    PO_DEBUG("%d", next_value());
+    PO_INFO("%d", next_value());
+}
+
+#undef PO_MIN_SEVERITY
+#define PO_MIN_SEVERITY S_DEBUG
+
+TEST(Verbose, MinSeverity)
+{
+    count = 0;
+    min_info();
+    EXPECT_EQ(1, count);
+}
+
+    /*
+     *  Cost of a disabled log call
+     */
+
+#undef PO_MIN_SEVERITY
+#define PO_MIN_SEVERITY S_INFO
+
+static void compiled_out(int i)
+{
+    PO_DEBUG("value=%d %s", i, get_task());
+}
+
+#undef PO_MIN_SEVERITY
+#define PO_MIN_SEVERITY S_DEBUG
+
+TEST(Verbose, Bench)
+{
+    const int loops = 1000000;
+    Logging *logging = new Logging(S_INFO, 0);
+    test.severity = S_INFO;
+
+    // the old way : evaluate all the args, then discard it in Logging::log()
+    Stopwatch sw;
+    for (int i = 0; i < loops; i++)
+    {
+        Logging::printf(logging, S_DEBUG, "%d %s %s %s +%d %s() : value=%d %s\r\n",
+                int(get_time()), get_task(), lut(Severity_lut, S_DEBUG),
+                __FILE__, __LINE__, __FUNCTION__, i, get_task());
+    }
+    const double t_log = sw.elapsed();
+
+    // filtered by the module severity
+    sw.reset();
+    for (int i = 0; i < loops; i++)
+    {
+        PO_DEBUG("value=%d %s", i, get_task());
+    }
+    const double t_module = sw.elapsed();
+
+    sw.reset();
+    for (int i = 0; i < loops; i++)
+    {
+        compiled_out(i);
+    }
+    const double t_compiled = sw.elapsed();
+
+    PO_INFO("disabled log : Logging::log=%.1f ns module=%.1f ns compiled out=%.1f ns",
+            (t_log * 1e9) / loops, (t_module * 1e9) / loops, (t_compiled * 1e9) / loops);
+
+    test.severity = S_DEBUG;
+    delete logging;
+}
+
 //  FIN